@@ -48,7 +48,13 @@
 
 static char* mallocErrorMsg = "array: malloc/realloc/calloc failed." ;
 
-static int nArrays = 0 ;
+static int nArrays = 0 ;  /* updated atomically, arrays may be created on several threads */
+
+#ifdef __GNUC__
+#define nArraysAdd(d) __sync_add_and_fetch(&nArrays, (d))
+#else
+#define nArraysAdd(d) (nArrays += (d))
+#endif
 
 
 Array uArrayCreate(int n, int size)
@@ -67,7 +73,7 @@ Array uArrayCreate(int n, int size)
 	new->dim = n ;
 	new->max = 0 ;
 	new->size = size ;
-	nArrays++ ;
+	nArraysAdd(1) ;
 	return new ;
 }
 
@@ -119,7 +125,7 @@ void uArrayDestroy (Array a)
 	if (a) {
 		free (a->base) ;
 		free(a) ;
-		nArrays-- ;
+		nArraysAdd(-1) ;
 	}
 }
 
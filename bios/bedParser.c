@@ -19,6 +19,7 @@ static LineStream ls = NULL;
 void bedParser_initFromFile (char *fileName)
 {  
   ls = ls_createFromFile (fileName);
+  ls_statsLabelSet (ls,"bedParser");
   ls_bufferSet (ls,1);
 }
 
@@ -31,6 +32,7 @@ void bedParser_initFromFile (char *fileName)
 void bedParser_initFromPipe (char *command)
 {
   ls = ls_createFromPipe (command);
+  ls_statsLabelSet (ls,"bedParser");
   ls_bufferSet (ls,1);
 }
 
@@ -23,6 +23,7 @@ static LineStream ls = NULL;
 void bgrParser_initFromFile (char *fileName)
 {  
   ls = ls_createFromFile (fileName);
+  ls_statsLabelSet (ls,"bgrParser");
   ls_bufferSet (ls,1);
 }
 
@@ -35,6 +36,7 @@ void bgrParser_initFromFile (char *fileName)
 void bgrParser_initFromPipe (char *command)
 {
   ls = ls_createFromPipe (command);
+  ls_statsLabelSet (ls,"bgrParser");
   ls_bufferSet (ls,1);
 }
 
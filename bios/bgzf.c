@@ -0,0 +1,616 @@
+/**
+ *   \file bgzf.c Read and write BGZF (blocked gzip) files
+ */
+
+
+/*
+   Module bgzf
+   BGZF files, as written by bgzip, are a series of independent gzip
+   members ("blocks") of at most 64 kB each. Every block carries its
+   own compressed size in an extra header field, so blocks can be read
+   from disk sequentially and inflated (or deflated) independently on a
+   pool of worker threads. A position in the uncompressed data is
+   addressed by a virtual offset: the file offset of the block shifted
+   left by 16 bits, or'ed with the offset within the uncompressed block.
+*/
+
+
+#include <errno.h>
+#include <zlib.h>
+
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "bgzf.h"
+
+
+
+#define BGZF_HEADER_SIZE 18
+#define BGZF_FOOTER_SIZE 8
+#define BGZF_BLOCKS_PER_THREAD 4
+
+#define BGZF_ERROR_INFLATE 1
+#define BGZF_ERROR_CRC 2
+#define BGZF_ERROR_DEFLATE 3
+
+
+static unsigned char bgzfHeader[BGZF_HEADER_SIZE] = {
+  31,139,8,4,0,0,0,0,0,255,6,0,'B','C',2,0,0,0
+};
+
+
+static unsigned char bgzfEofMarker[28] = {
+  31,139,8,4,0,0,0,0,0,255,6,0,'B','C',2,0,27,0,3,0,0,0,0,0,0,0,0,0
+};
+
+
+
+static int bgzf_unpackInt16 (unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+
+
+static unsigned int bgzf_unpackInt32 (unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+
+
+static void bgzf_packInt16 (unsigned char *p, int v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+
+
+static void bgzf_packInt32 (unsigned char *p, unsigned int v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+
+
+static void bgzf_allocBlocks (BgzfBlock **blocks, int nBlocks)
+{
+  int i;
+
+  *blocks = (BgzfBlock *) hlr_malloc (nBlocks * sizeof (BgzfBlock));
+  for (i = 0; i < nBlocks; i++) {
+    (*blocks)[i].cdata = (unsigned char *) hlr_malloc (BGZF_MAX_BLOCK_SIZE);
+    (*blocks)[i].udata = (char *) hlr_malloc (BGZF_MAX_BLOCK_SIZE);
+    (*blocks)[i].clen = 0;
+    (*blocks)[i].ulen = 0;
+    (*blocks)[i].address = 0;
+    (*blocks)[i].level = 0;
+    (*blocks)[i].error = 0;
+  }
+}
+
+
+
+static void bgzf_freeBlocks (BgzfBlock *blocks, int nBlocks)
+{
+  int i;
+
+  for (i = 0; i < nBlocks; i++) {
+    hlr_free (blocks[i].cdata);
+    hlr_free (blocks[i].udata);
+  }
+  hlr_free (blocks);
+}
+
+
+
+/**
+ * Check whether a file starts with a BGZF block.
+ * @param[in] fileName Name of the file
+ * @return 1 if the file is BGZF compressed, 0 otherwise (including unreadable files)
+ */
+int bgzf_isBgzf (char *fileName)
+{
+  FILE *fp;
+  unsigned char h[BGZF_HEADER_SIZE];
+  int n;
+
+  if ((fp = fopen (fileName,"rb")) == NULL)
+    return 0;
+  n = fread (h,1,BGZF_HEADER_SIZE,fp);
+  fclose (fp);
+  return n == BGZF_HEADER_SIZE && h[0] == 31 && h[1] == 139 && h[2] == 8 && (h[3] & 4) &&
+    h[12] == 'B' && h[13] == 'C';
+}
+
+
+
+/* ------------------------------------------------------------------ */
+/*  reader                                                             */
+/* ------------------------------------------------------------------ */
+
+
+
+static void bgzf_inflateBlock (void *arg)
+{ /* runs on a worker thread: errors are passed back in blk->error, die() is not called here */
+  BgzfBlock *blk = (BgzfBlock *)arg;
+  z_stream zs;
+  int hlen;
+
+  blk->error = 0;
+  blk->ulen = 0;
+  hlen = 12 + bgzf_unpackInt16 (blk->cdata + 10);
+  memset (&zs,0,sizeof (zs));
+  zs.next_in = blk->cdata + hlen;
+  zs.avail_in = blk->clen - hlen - BGZF_FOOTER_SIZE;
+  zs.next_out = (unsigned char *)blk->udata;
+  zs.avail_out = BGZF_MAX_BLOCK_SIZE;
+  if (inflateInit2 (&zs,-15) != Z_OK) {
+    blk->error = BGZF_ERROR_INFLATE;
+    return;
+  }
+  if (inflate (&zs,Z_FINISH) != Z_STREAM_END) {
+    inflateEnd (&zs);
+    blk->error = BGZF_ERROR_INFLATE;
+    return;
+  }
+  blk->ulen = zs.total_out;
+  inflateEnd (&zs);
+  if (bgzf_unpackInt32 (blk->cdata + blk->clen - 4) != (unsigned int)blk->ulen ||
+      bgzf_unpackInt32 (blk->cdata + blk->clen - 8) != crc32 (crc32 (0L,Z_NULL,0),(unsigned char *)blk->udata,blk->ulen))
+    blk->error = BGZF_ERROR_CRC;
+}
+
+
+
+static int bgzf_loadBlock (BgzfReader this1, BgzfBlock *blk)
+{ /* reads the next compressed block from disk into blk;
+     returns 0 at end of file */
+  unsigned char *h = blk->cdata;
+  int n,xlen,slen,bsize,i;
+
+  n = fread (h,1,12,this1->fp);
+  if (n == 0)
+    return 0;
+  if (n != 12 || h[0] != 31 || h[1] != 139 || h[2] != 8 || !(h[3] & 4))
+    die ("bgzf: no BGZF block at file offset %lld",this1->nextAddress);
+  xlen = bgzf_unpackInt16 (h + 10);
+  if (12 + xlen + BGZF_FOOTER_SIZE > BGZF_MAX_BLOCK_SIZE)
+    die ("bgzf: extra field too long at file offset %lld",this1->nextAddress);
+  if (fread (h + 12,1,xlen,this1->fp) != (size_t)xlen)
+    die ("bgzf: truncated block header at file offset %lld",this1->nextAddress);
+  bsize = -1;
+  for (i = 12; i + 4 <= 12 + xlen; i += 4 + slen) {
+    slen = bgzf_unpackInt16 (h + i + 2);
+    if (i + 4 + slen > 12 + xlen)
+      die ("bgzf: invalid extra subfield at file offset %lld",this1->nextAddress);
+    if (h[i] == 'B' && h[i+1] == 'C' && slen == 2)
+      bsize = bgzf_unpackInt16 (h + i + 4);
+  }
+  if (bsize < 0)
+    die ("bgzf: block without BSIZE field at file offset %lld",this1->nextAddress);
+  blk->clen = bsize + 1;
+  if (blk->clen < 12 + xlen + BGZF_FOOTER_SIZE)
+    die ("bgzf: invalid block size at file offset %lld",this1->nextAddress);
+  n = blk->clen - 12 - xlen;
+  if (fread (h + 12 + xlen,1,n,this1->fp) != (size_t)n)
+    die ("bgzf: truncated block at file offset %lld",this1->nextAddress);
+  blk->address = this1->nextAddress;
+  this1->nextAddress += blk->clen;
+  return 1;
+}
+
+
+
+static void bgzf_fillQueue (BgzfReader this1)
+{ /* reads blocks from disk until the ring is full and hands them
+     to the workers */
+  BgzfBlock *blk;
+
+  while (this1->nQueued < this1->nBlocks && !this1->atEof) {
+    blk = &this1->blocks[(this1->head + this1->nQueued) % this1->nBlocks];
+    if (!bgzf_loadBlock (this1,blk)) {
+      this1->atEof = 1;
+      break;
+    }
+    if (this1->pool)
+      threadPool_submit (this1->pool,&blk->job,bgzf_inflateBlock,blk);
+    else
+      bgzf_inflateBlock (blk);
+    this1->nQueued++;
+  }
+}
+
+
+
+static BgzfBlock *bgzf_headBlock (BgzfReader this1)
+{ /* returns the oldest block that still has unread data,
+     NULL at end of file */
+  BgzfBlock *blk;
+
+  for (;;) {
+    if (this1->nQueued > 0) {
+      blk = &this1->blocks[this1->head];
+      if (this1->pool)
+        threadPool_waitJob (this1->pool,&blk->job);
+      if (blk->error)
+        die ("bgzf: %s in block at file offset %lld",
+             blk->error == BGZF_ERROR_CRC ? "CRC mismatch" : "cannot inflate",blk->address);
+      if (this1->upos < blk->ulen)
+        return blk;
+      this1->head = (this1->head + 1) % this1->nBlocks;
+      this1->nQueued--;
+      this1->upos = 0;
+    }
+    bgzf_fillQueue (this1);
+    if (this1->nQueued == 0)
+      return NULL;
+  }
+}
+
+
+
+/**
+ * Open a BGZF file for reading.
+ * @param[in] fileName File name ("-" means stdin; seeking is then not possible)
+ * @param[in] nThreads Number of threads inflating blocks; 0 means inflate in the calling thread
+ * @return A BGZF reader, NULL if the file could not be opened; to learn details call warnReport() from module log.c
+ * @see threadPool_cpuCount()
+ */
+BgzfReader bgzf_readerCreate (const char *fileName, int nThreads)
+{
+  BgzfReader this1;
+
+  if (!fileName)
+    die ("bgzf_readerCreate: no file name given");
+  this1 = (BgzfReader) hlr_malloc (sizeof (struct _bgzfReaderStruct_));
+  if (strcmp (fileName,"-") == 0)
+    this1->fp = stdin;
+  else
+    this1->fp = fopen (fileName,"rb");
+  if (!this1->fp) {
+    warnAdd ("bgzf_readerCreate",
+             stringPrintBuf ("'%s': %s",fileName,strerror (errno)));
+    hlr_free (this1);
+    return NULL;
+  }
+  this1->pool = nThreads > 0 ? threadPool_create (nThreads) : NULL;
+  this1->nBlocks = nThreads > 0 ? nThreads * BGZF_BLOCKS_PER_THREAD : 1;
+  bgzf_allocBlocks (&this1->blocks,this1->nBlocks);
+  this1->head = 0;
+  this1->nQueued = 0;
+  this1->upos = 0;
+  this1->nextAddress = 0;
+  this1->atEof = 0;
+  return this1;
+}
+
+
+
+/**
+ * Read uncompressed data.
+ * Like read(2), this function may return fewer bytes than requested: it never reads beyond the end of the current block.
+ * @param[in] this1 A BGZF reader
+ * @param[in] buf Where to put the data
+ * @param[in] n Maximum number of bytes to read
+ * @return Number of bytes read, 0 at end of file
+ */
+int bgzf_read (BgzfReader this1, void *buf, int n)
+{
+  BgzfBlock *blk;
+
+  if (n <= 0 || (blk = bgzf_headBlock (this1)) == NULL)
+    return 0;
+  n = MIN (n,blk->ulen - this1->upos);
+  memcpy (buf,blk->udata + this1->upos,n);
+  this1->upos += n;
+  return n;
+}
+
+
+
+/**
+ * Position the reader at a virtual offset.
+ * @param[in] this1 A BGZF reader
+ * @param[in] virtualOffset As returned by bgzf_tell() or found in an index
+ */
+void bgzf_seek (BgzfReader this1, long long virtualOffset)
+{
+  long long address = bgzf_blockAddress (virtualOffset);
+  int within = bgzf_withinBlock (virtualOffset);
+  BgzfBlock *blk;
+
+  if (this1->pool)
+    threadPool_waitAll (this1->pool);
+  this1->head = 0;
+  this1->nQueued = 0;
+  this1->upos = 0;
+  this1->atEof = 0;
+  if (fseeko (this1->fp,(off_t)address,SEEK_SET) != 0)
+    die ("bgzf_seek: cannot seek to file offset %lld: %s",address,strerror (errno));
+  this1->nextAddress = address;
+  if (within == 0)
+    return;
+  bgzf_fillQueue (this1);
+  if (this1->nQueued == 0)
+    die ("bgzf_seek: virtual offset %lld beyond end of file",virtualOffset);
+  blk = &this1->blocks[this1->head];
+  if (this1->pool)
+    threadPool_waitJob (this1->pool,&blk->job);
+  if (blk->error || within > blk->ulen)
+    die ("bgzf_seek: invalid virtual offset %lld",virtualOffset);
+  this1->upos = within;
+}
+
+
+
+/**
+ * Get the virtual offset of the next byte bgzf_read() would return.
+ * @param[in] this1 A BGZF reader
+ */
+long long bgzf_tell (BgzfReader this1)
+{
+  if (this1->nQueued > 0)
+    return bgzf_virtualOffset (this1->blocks[this1->head].address,this1->upos);
+  return bgzf_virtualOffset (this1->nextAddress,0);
+}
+
+
+
+static int bgzf_isBlockHeader (unsigned char *h)
+{ /* h points to BGZF_HEADER_SIZE bytes; returns the size of the block 
+     if they look like the header bgzip writes, else 0 */
+  if (h[0] != 31 || h[1] != 139 || h[2] != 8 || h[3] != 4 ||
+      bgzf_unpackInt16 (h + 10) != 6 || h[12] != 'B' || h[13] != 'C' ||
+      bgzf_unpackInt16 (h + 14) != 2)
+    return 0;
+  return bgzf_unpackInt16 (h + 16) + 1;
+}
+
+
+
+/**
+ * Find the first block that starts at or after a file offset and position the reader there.
+ * Used to split a BGZF file into parts that can be read independently. A candidate 
+   block header is only accepted if the next block (or the end of the file) follows 
+   right behind it, so compressed data that happens to look like a header is skipped.
+ * @param[in] this1 A BGZF reader, not reading from stdin
+ * @param[in] fileOffset Offset in the compressed file
+ * @return File offset of the block; -1 if there is no block behind fileOffset, the reader is then at the end of the file
+ * @post The next bgzf_read() returns data from the start of the block found
+ */
+long long bgzf_blockAlign (BgzfReader this1, long long fileOffset)
+{
+  int bufSize = BGZF_MAX_BLOCK_SIZE + BGZF_HEADER_SIZE;
+  unsigned char *buf;
+  unsigned char next[BGZF_HEADER_SIZE];
+  long long fileSize,address;
+  int n,i,size;
+
+  if (this1->fp == stdin)
+    die ("bgzf_blockAlign: cannot seek in stdin");
+  if (fseeko (this1->fp,0,SEEK_END) != 0)
+    die ("bgzf_blockAlign: %s",strerror (errno));
+  fileSize = ftello (this1->fp);
+  buf = (unsigned char *) hlr_malloc (bufSize);
+  address = -1;
+  while (address < 0 && fileOffset < fileSize) {
+    if (fseeko (this1->fp,(off_t)fileOffset,SEEK_SET) != 0)
+      die ("bgzf_blockAlign: %s",strerror (errno));
+    n = fread (buf,1,bufSize,this1->fp);
+    for (i = 0; i + BGZF_HEADER_SIZE <= n; i++) {
+      if (buf[i] != 31 || (size = bgzf_isBlockHeader (buf + i)) == 0)
+        continue;
+      if (fileOffset + i + size == fileSize) {
+        address = fileOffset + i;
+        break;
+      }
+      if (fileOffset + i + size > fileSize || 
+          fseeko (this1->fp,(off_t)(fileOffset + i + size),SEEK_SET) != 0 ||
+          fread (next,1,BGZF_HEADER_SIZE,this1->fp) != BGZF_HEADER_SIZE ||
+          !bgzf_isBlockHeader (next))
+        continue;
+      address = fileOffset + i;
+      break;
+    }
+    if (n < bufSize)
+      break;
+    fileOffset += n - BGZF_HEADER_SIZE + 1;
+  }
+  hlr_free (buf);
+  bgzf_seek (this1,bgzf_virtualOffset (address < 0 ? fileSize : address,0));
+  return address;
+}
+
+
+
+/**
+ * Close a BGZF reader.
+ * @param[in] this1 A BGZF reader
+ * @note Do not call this function, but use the macro bgzf_readerDestroy
+ */
+void bgzf_readerDestroy_func (BgzfReader this1)
+{
+  if (!this1)
+    return;
+  threadPool_destroy (this1->pool);
+  if (this1->fp != stdin)
+    fclose (this1->fp);
+  bgzf_freeBlocks (this1->blocks,this1->nBlocks);
+  hlr_free (this1);
+}
+
+
+
+/* ------------------------------------------------------------------ */
+/*  writer                                                             */
+/* ------------------------------------------------------------------ */
+
+
+
+static void bgzf_deflateBlock (void *arg)
+{ /* runs on a worker thread: errors are passed back in blk->error, die() is not called here */
+  BgzfBlock *blk = (BgzfBlock *)arg;
+  z_stream zs;
+  unsigned char *c = blk->cdata;
+
+  blk->error = 0;
+  memset (&zs,0,sizeof (zs));
+  zs.next_in = (unsigned char *)blk->udata;
+  zs.avail_in = blk->ulen;
+  zs.next_out = c + BGZF_HEADER_SIZE;
+  zs.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+  if (deflateInit2 (&zs,blk->level,Z_DEFLATED,-15,8,Z_DEFAULT_STRATEGY) != Z_OK) {
+    blk->error = BGZF_ERROR_DEFLATE;
+    return;
+  }
+  if (deflate (&zs,Z_FINISH) != Z_STREAM_END) {
+    deflateEnd (&zs);
+    blk->error = BGZF_ERROR_DEFLATE;
+    return;
+  }
+  blk->clen = BGZF_HEADER_SIZE + zs.total_out + BGZF_FOOTER_SIZE;
+  deflateEnd (&zs);
+  memcpy (c,bgzfHeader,BGZF_HEADER_SIZE);
+  bgzf_packInt16 (c + 16,blk->clen - 1);
+  bgzf_packInt32 (c + blk->clen - 8,crc32 (crc32 (0L,Z_NULL,0),(unsigned char *)blk->udata,blk->ulen));
+  bgzf_packInt32 (c + blk->clen - 4,blk->ulen);
+}
+
+
+
+static void bgzf_writeHead (BgzfWriter this1)
+{ /* waits for the oldest block and writes it to disk */
+  BgzfBlock *blk = &this1->blocks[this1->head];
+
+  if (this1->pool)
+    threadPool_waitJob (this1->pool,&blk->job);
+  if (blk->error)
+    die ("bgzf: cannot deflate block");
+  if (fwrite (blk->cdata,1,blk->clen,this1->fp) != (size_t)blk->clen)
+    die ("bgzf: write error: %s",strerror (errno));
+  blk->ulen = 0;
+  this1->head = (this1->head + 1) % this1->nBlocks;
+  this1->nQueued--;
+}
+
+
+
+static void bgzf_submitBlock (BgzfWriter this1)
+{ /* hands the block currently being filled to the compressors */
+  BgzfBlock *blk = &this1->blocks[(this1->head + this1->nQueued) % this1->nBlocks];
+
+  blk->level = this1->level;
+  if (this1->pool)
+    threadPool_submit (this1->pool,&blk->job,bgzf_deflateBlock,blk);
+  else
+    bgzf_deflateBlock (blk);
+  this1->nQueued++;
+  if (this1->nQueued == this1->nBlocks)
+    bgzf_writeHead (this1);
+}
+
+
+
+/**
+ * Open a BGZF file for writing.
+ * @param[in] fileName File name ("-" means stdout)
+ * @param[in] nThreads Number of threads deflating blocks; 0 means deflate in the calling thread
+ * @param[in] level zlib compression level 0..9, -1 for the zlib default
+ * @return A BGZF writer, NULL if the file could not be opened; to learn details call warnReport() from module log.c
+ */
+BgzfWriter bgzf_writerCreate (const char *fileName, int nThreads, int level)
+{
+  BgzfWriter this1;
+
+  if (!fileName)
+    die ("bgzf_writerCreate: no file name given");
+  this1 = (BgzfWriter) hlr_malloc (sizeof (struct _bgzfWriterStruct_));
+  if (strcmp (fileName,"-") == 0)
+    this1->fp = stdout;
+  else
+    this1->fp = fopen (fileName,"wb");
+  if (!this1->fp) {
+    warnAdd ("bgzf_writerCreate",
+             stringPrintBuf ("'%s': %s",fileName,strerror (errno)));
+    hlr_free (this1);
+    return NULL;
+  }
+  this1->level = level < 0 ? Z_DEFAULT_COMPRESSION : MIN (level,9);
+  this1->pool = nThreads > 0 ? threadPool_create (nThreads) : NULL;
+  this1->nBlocks = nThreads > 0 ? nThreads * BGZF_BLOCKS_PER_THREAD : 1;
+  bgzf_allocBlocks (&this1->blocks,this1->nBlocks);
+  this1->head = 0;
+  this1->nQueued = 0;
+  return this1;
+}
+
+
+
+/**
+ * Write uncompressed data.
+ * @param[in] this1 A BGZF writer
+ * @param[in] data Data to write
+ * @param[in] n Number of bytes
+ */
+void bgzf_write (BgzfWriter this1, const void *data, int n)
+{
+  const char *p = (const char *)data;
+  BgzfBlock *blk;
+  int m;
+
+  while (n > 0) {
+    blk = &this1->blocks[(this1->head + this1->nQueued) % this1->nBlocks];
+    m = MIN (n,BGZF_BLOCK_SIZE - blk->ulen);
+    memcpy (blk->udata + blk->ulen,p,m);
+    blk->ulen += m;
+    p += m;
+    n -= m;
+    if (blk->ulen == BGZF_BLOCK_SIZE)
+      bgzf_submitBlock (this1);
+  }
+}
+
+
+
+/**
+ * Compress and write all buffered data. The data written so far ends at a block boundary.
+ * @param[in] this1 A BGZF writer
+ */
+void bgzf_flush (BgzfWriter this1)
+{
+  if (this1->blocks[(this1->head + this1->nQueued) % this1->nBlocks].ulen > 0)
+    bgzf_submitBlock (this1);
+  while (this1->nQueued > 0)
+    bgzf_writeHead (this1);
+  fflush (this1->fp);
+}
+
+
+
+/**
+ * Flush a BGZF writer, append the end-of-file marker and close the file.
+ * @param[in] this1 A BGZF writer
+ * @note Do not call this function, but use the macro bgzf_writerDestroy
+ */
+void bgzf_writerDestroy_func (BgzfWriter this1)
+{
+  if (!this1)
+    return;
+  bgzf_flush (this1);
+  if (fwrite (bgzfEofMarker,1,sizeof (bgzfEofMarker),this1->fp) != sizeof (bgzfEofMarker))
+    die ("bgzf: write error: %s",strerror (errno));
+  if (this1->fp != stdout) {
+    if (fclose (this1->fp) != 0)
+      die ("bgzf: cannot close file: %s",strerror (errno));
+  }
+  else
+    fflush (this1->fp);
+  threadPool_destroy (this1->pool);
+  bgzf_freeBlocks (this1->blocks,this1->nBlocks);
+  hlr_free (this1);
+}
@@ -0,0 +1,125 @@
+/**
+ *   \file bgzf.h
+ */
+
+
+#ifndef DEF_BGZF_H
+#define DEF_BGZF_H
+
+
+#include <stdio.h>
+#include "threadPool.h"
+
+
+/**
+ * Maximum size of a BGZF block, compressed or uncompressed.
+ */
+#define BGZF_MAX_BLOCK_SIZE 65536
+
+/**
+ * Amount of uncompressed data the writer puts into one block.
+ * Chosen such that even incompressible data fits into BGZF_MAX_BLOCK_SIZE.
+ */
+#define BGZF_BLOCK_SIZE 0xff00
+
+
+/**
+ * Build a BGZF virtual offset from the file offset of a block and an offset within the uncompressed block.
+ */
+#define bgzf_virtualOffset(blockAddress,withinBlock) (((long long)(blockAddress) << 16) | ((withinBlock) & 0xffff))
+
+/**
+ * File offset of the block a virtual offset points to.
+ */
+#define bgzf_blockAddress(virtualOffset) ((long long)(virtualOffset) >> 16)
+
+/**
+ * Offset within the uncompressed block a virtual offset points to.
+ */
+#define bgzf_withinBlock(virtualOffset) ((int)((virtualOffset) & 0xffff))
+
+
+
+/**
+ * BgzfBlock.
+ * One BGZF block in either direction; PRIVATE to the bgzf module.
+ */
+typedef struct {
+  unsigned char *cdata;   /* complete compressed block, header and footer included */
+  int clen;
+  char *udata;            /* uncompressed data */
+  int ulen;
+  long long address;      /* file offset of the block (reader only) */
+  int level;              /* compression level (writer only) */
+  int error;
+  ThreadPoolJob job;
+} BgzfBlock;
+
+
+
+/**
+ * BgzfReader.
+ */
+typedef struct _bgzfReaderStruct_ {
+  /* the members of this struct are PRIVATE for the
+     bgzf module -- DO NOT access from outside
+     the bgzf module */
+  FILE *fp;
+  ThreadPool pool;        /* NULL: inflate in the calling thread */
+  int nBlocks;
+  BgzfBlock *blocks;      /* ring of blocks, oldest is 'head' */
+  int head;
+  int nQueued;            /* blocks read from disk, starting at 'head' */
+  int upos;               /* read position within block 'head' */
+  long long nextAddress;  /* file offset of the next block to read from disk */
+  int atEof;
+} *BgzfReader;
+
+
+
+/**
+ * BgzfWriter.
+ */
+typedef struct _bgzfWriterStruct_ {
+  /* the members of this struct are PRIVATE for the
+     bgzf module -- DO NOT access from outside
+     the bgzf module */
+  FILE *fp;
+  int level;
+  ThreadPool pool;        /* NULL: deflate in the calling thread */
+  int nBlocks;
+  BgzfBlock *blocks;      /* ring of blocks, oldest is 'head' */
+  int head;
+  int nQueued;            /* blocks handed to the compressors, starting at 'head' */
+} *BgzfWriter;
+
+
+
+extern int bgzf_isBgzf (char *fileName);
+
+extern BgzfReader bgzf_readerCreate (const char *fileName, int nThreads);
+extern int bgzf_read (BgzfReader this1, void *buf, int n);
+extern void bgzf_seek (BgzfReader this1, long long virtualOffset);
+extern long long bgzf_tell (BgzfReader this1);
+extern long long bgzf_blockAlign (BgzfReader this1, long long fileOffset);
+extern void bgzf_readerDestroy_func (BgzfReader this1); /* do not use this function */
+
+/**
+ * Destroy a BGZF reader.
+ * @see bgzf_readerDestroy_func()
+ */
+#define bgzf_readerDestroy(this1) (bgzf_readerDestroy_func(this1),this1=NULL) /* use this one */
+
+extern BgzfWriter bgzf_writerCreate (const char *fileName, int nThreads, int level);
+extern void bgzf_write (BgzfWriter this1, const void *data, int n);
+extern void bgzf_flush (BgzfWriter this1);
+extern void bgzf_writerDestroy_func (BgzfWriter this1); /* do not use this function */
+
+/**
+ * Flush and close a BGZF writer.
+ * @see bgzf_writerDestroy_func()
+ */
+#define bgzf_writerDestroy(this1) (bgzf_writerDestroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -24,6 +24,7 @@ static LineStream ls = NULL;
 void blastParser_initFromFile (char* fileName)
 {
   ls = ls_createFromFile (fileName);
+  ls_statsLabelSet (ls,"blastParser");
   ls_bufferSet (ls,1);
 }
 
@@ -38,6 +39,7 @@ void blastParser_initFromFile (char* fileName)
 void blastParser_initFromPipe (char* command)
 {
   ls = ls_createFromPipe (command);
+  ls_statsLabelSet (ls,"blastParser");
   ls_bufferSet (ls,1);
 }
 
@@ -30,6 +30,7 @@ void blatParser_initFromFile (char *fileName)
   int i;
 
   ls = ls_createFromFile (fileName);
+  ls_statsLabelSet (ls,"blatParser");
   ls_bufferSet (ls,1);
   for (i = 0; i < NUM_PSL_HEADER_LINES; i++) {
     ls_nextLine (ls);
@@ -47,6 +48,7 @@ void blatParser_initFromPipe (char *command)
   int i;
 
   ls = ls_createFromPipe (command);
+  ls_statsLabelSet (ls,"blatParser");
   ls_bufferSet (ls,1);
   for (i = 0; i < NUM_PSL_HEADER_LINES; i++) {
     ls_nextLine (ls);
@@ -24,6 +24,7 @@ static LineStream ls = NULL;
 void bowtieParser_initFromFile (char *fileName)
 {
   ls = ls_createFromFile (fileName);
+  ls_statsLabelSet (ls,"bowtieParser");
   ls_bufferSet (ls,1);
 }
 
@@ -36,6 +37,7 @@ void bowtieParser_initFromFile (char *fileName)
 void bowtieParser_initFromPipe (char *command)
 {
   ls = ls_createFromPipe (command);
+  ls_statsLabelSet (ls,"bowtieParser");
   ls_bufferSet (ls,1);
 }
 
@@ -0,0 +1,513 @@
+/**
+ *   \file dedup.c Module for finding duplicate reads
+ */
+
+
+/*
+   Module dedup
+   Each read (or its prefix, or a pair) is reduced to a 64-bit fingerprint
+   of its bases packed 2 bits per base. Fingerprints go into an open
+   addressing hash table of fixed size, which threads fill without locks
+   using compare-and-swap; a read is a duplicate if its fingerprint is
+   already there.
+   When the table is full, it is either frozen (duplicates of reads that
+   did not fit are missed), or, with a spill directory, written to disk
+   as a sorted run and cleared. Duplicates across runs are found
+   afterwards by merging the runs, so dedup_distinctCountGet() stays exact,
+   but a read is only filtered online if its earlier copy is in the current
+   table -- or, with a Bloom filter, if the filter has seen its fingerprint.
+   The Bloom filter remembers all fingerprints at a few bits each and so
+   catches duplicates whose first copy has left the table, at the price of
+   a small rate of reads wrongly reported as duplicates.
+   Two different reads have the same fingerprint with probability 2^-64
+   per pair of reads.
+*/
+
+
+#include <errno.h>
+#include <unistd.h>
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "seq.h"
+#include "dedup.h"
+
+
+
+#define DEDUP_MAX_LOAD 0.7
+#define DEDUP_RUN_BUFFER 4096
+
+
+
+/**
+ * Create a duplicate finder.
+ * @param[in] maxMemory Bytes for the fingerprint table, 8 per slot; it holds 0.7 fingerprints per slot
+ * @param[in] prefixLen If > 0, reads are duplicates if their first prefixLen bases agree;
+   if 0, whole reads are compared
+ * @return A duplicate finder
+ */
+Dedup dedup_create (long long maxMemory, int prefixLen)
+{
+  Dedup this1;
+
+  this1 = (Dedup) hlr_calloc (1,sizeof (struct _dedupStruct_));
+  this1->prefixLen = prefixLen;
+  this1->slotCnt = 1024;
+  while (this1->slotCnt * 2 * (long long)sizeof (unsigned long long) <= maxMemory)
+    this1->slotCnt *= 2;
+  this1->slots = (unsigned long long *) hlr_calloc (this1->slotCnt,sizeof (unsigned long long));
+  this1->maxFill = this1->slotCnt * DEDUP_MAX_LOAD;
+  this1->runs = arrayCreate (10,char *);
+  pthread_rwlock_init (&this1->spillLock,NULL);
+  return this1;
+}
+
+
+
+/**
+ * Add a Bloom filter; call before the first read is added.
+ * @param[in] this1 A duplicate finder
+ * @param[in] bytes Size of the filter; about 1.2 bytes per distinct read give 1% false duplicates with 7 hashes
+ * @param[in] hashes Number of bits set per fingerprint
+ */
+void dedup_bloomSet (Dedup this1, long long bytes, int hashes)
+{
+  if (this1->readCnt > 0)
+    die ("dedup_bloomSet: reads have been added already");
+  hlr_free (this1->bloom);
+  this1->bloomBits = MAX (bytes / 8,1) * 64;
+  this1->bloom = (unsigned long long *) hlr_calloc (this1->bloomBits / 64,sizeof (unsigned long long));
+  this1->bloomHashes = MAX (hashes,1);
+}
+
+
+
+/**
+ * Spill the fingerprint table to sorted files in dir when it is full, instead of freezing it.
+ */
+void dedup_spillSet (Dedup this1, char *dir)
+{
+  if (this1->readCnt > 0)
+    die ("dedup_spillSet: reads have been added already");
+  hlr_free (this1->spillDir);
+  this1->spillDir = hlr_strdup (dir);
+}
+
+
+
+static unsigned long long dedup_mix (unsigned long long x)
+{ /* finalizer of splitmix64 */
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return x;
+}
+
+
+
+/**
+ * Fingerprint of a read: a hash of its bases packed 2 bits per base, its N positions and its length.
+ * @param[in] sequence Bases of the read, case does not matter
+ * @param[in] len Number of bases
+ * @param[in] prefixLen If > 0, only the first prefixLen bases are used
+ * @return Fingerprint, never 0
+ */
+unsigned long long dedup_fingerprint (char *sequence, int len, int prefixLen)
+{
+  unsigned long long h;
+  unsigned long long word;
+  unsigned long long nMask;
+  int val;
+  int i,k;
+
+  if (prefixLen > 0 && len > prefixLen)
+    len = prefixLen;
+  h = dedup_mix (len);
+  for (i = 0; i < len; i += 32) {
+    word = 0;
+    nMask = 0;
+    for (k = i; k < len && k < i + 32; k++) {
+      if ((val = ntVal[(unsigned char)sequence[k]]) < 0) {
+        nMask |= 1ULL << (k - i);
+        val = 0;
+      }
+      word = (word << 2) | val;
+    }
+    h = dedup_mix (h ^ word) + nMask;
+  }
+  h = dedup_mix (h);
+  return h ? h : 1;
+}
+
+
+
+static void dedup_bloomAdd (Dedup this1, unsigned long long fp, int *wasPresent)
+{
+  unsigned long long h2 = (fp >> 32) | 1;
+  unsigned long long bit;
+  unsigned long long mask;
+  int present = 1;
+  int i;
+
+  for (i = 0; i < this1->bloomHashes; i++) {
+    bit = (fp + i * h2) % this1->bloomBits;
+    mask = 1ULL << (bit & 63);
+    if (!(this1->bloom[bit >> 6] & mask)) {
+      present = 0;
+      __sync_fetch_and_or (this1->bloom + (bit >> 6),mask);
+    }
+  }
+  *wasPresent = present;
+}
+
+
+
+static int dedup_fpCmp (unsigned long long *a, unsigned long long *b)
+{
+  return *a < *b ? -1 : *a > *b;
+}
+
+
+
+/*
+ * Sorted fingerprints of the table, which is compacted in place; returns their number.
+ */
+static long long dedup_tableSort (Dedup this1)
+{
+  long long n = 0;
+  long long i;
+
+  for (i = 0; i < this1->slotCnt; i++)
+    if (this1->slots[i])
+      this1->slots[n++] = this1->slots[i];
+  qsort (this1->slots,n,sizeof (unsigned long long),(int (*)(const void *,const void *))dedup_fpCmp);
+  return n;
+}
+
+
+
+static void dedup_spill (Dedup this1)
+{
+  Stringa fileName = stringCreate (100);
+  FILE *fp;
+  long long n;
+
+  stringPrintf (fileName,"%s/dedup_%d_%p_%d.run",this1->spillDir,(int)getpid (),this1,arrayMax (this1->runs));
+  if (!(fp = fopen (string (fileName),"w")))
+    die ("dedup: cannot create '%s': %s",string (fileName),strerror (errno));
+  n = dedup_tableSort (this1);
+  if (fwrite (this1->slots,sizeof (unsigned long long),n,fp) != (size_t)n || fclose (fp) != 0)
+    die ("dedup: cannot write '%s': %s",string (fileName),strerror (errno));
+  array (this1->runs,arrayMax (this1->runs),char *) = hlr_strdup (string (fileName));
+  stringDestroy (fileName);
+  memset (this1->slots,0,this1->slotCnt * sizeof (unsigned long long));
+  this1->fill = 0;
+}
+
+
+
+/*
+ * Looks up fp in the table and inserts it if it is new and there is room.
+ * Returns 1 if it was there already, 0 if it was inserted, -1 if the table is full.
+ */
+static int dedup_tableAdd (Dedup this1, unsigned long long fp)
+{
+  unsigned long long i = fp & (this1->slotCnt - 1);
+  unsigned long long old;
+
+  for (;;) {
+    old = this1->slots[i];
+    if (old == fp)
+      return 1;
+    if (old == 0) {
+      if (this1->fill >= this1->maxFill)
+        return -1;
+      old = __sync_val_compare_and_swap (this1->slots + i,0ULL,fp);
+      if (old == 0) {
+        __sync_fetch_and_add (&this1->fill,1);
+        return 0;
+      }
+      if (old == fp)
+        return 1;
+    }
+    i = (i + 1) & (this1->slotCnt - 1);
+  }
+}
+
+
+
+static int dedup_addFingerprint (Dedup this1, unsigned long long fp)
+{
+  int isDuplicate;
+  int inBloom = 0;
+
+  if (this1->bloom)
+    dedup_bloomAdd (this1,fp,&inBloom);
+  if (this1->spillDir)
+    pthread_rwlock_rdlock (&this1->spillLock);
+  while ((isDuplicate = dedup_tableAdd (this1,fp)) < 0) {
+    if (!this1->spillDir) {
+      this1->saturated = 1;
+      isDuplicate = 0;
+      break;
+    }
+    /* several threads may find the table full; the first one spills, all of them retry */
+    pthread_rwlock_unlock (&this1->spillLock);
+    pthread_rwlock_wrlock (&this1->spillLock);
+    if (this1->fill >= this1->maxFill)
+      dedup_spill (this1);
+    pthread_rwlock_unlock (&this1->spillLock);
+    pthread_rwlock_rdlock (&this1->spillLock);
+  }
+  if (!isDuplicate && inBloom && (arrayMax (this1->runs) > 0 || this1->saturated))
+    isDuplicate = 1;
+  if (this1->spillDir)
+    pthread_rwlock_unlock (&this1->spillLock);
+  __sync_fetch_and_add (&this1->readCnt,1);
+  if (isDuplicate)
+    __sync_fetch_and_add (&this1->duplicateCnt,1);
+  return isDuplicate;
+}
+
+
+
+/**
+ * Add a read.
+ * @param[in] this1 A duplicate finder
+ * @param[in] sequence Bases of the read
+ * @param[in] len Number of bases
+ * @return 1 if the read is a duplicate of an earlier one, 0 if it is the first copy
+ * @note Can be called from several threads at the same time.
+ */
+int dedup_add (Dedup this1, char *sequence, int len)
+{
+  return dedup_addFingerprint (this1,dedup_fingerprint (sequence,len,this1->prefixLen));
+}
+
+
+
+/**
+ * Add a pair; pairs are duplicates if both mates are.
+ * @see dedup_add()
+ */
+int dedup_addPair (Dedup this1, char *sequence1, int len1, char *sequence2, int len2)
+{
+  unsigned long long fp1 = dedup_fingerprint (sequence1,len1,this1->prefixLen);
+  unsigned long long fp2 = dedup_fingerprint (sequence2,len2,this1->prefixLen);
+  unsigned long long fp = dedup_mix (fp1 ^ ((fp2 << 1) | (fp2 >> 63)));
+
+  return dedup_addFingerprint (this1,fp ? fp : 1);
+}
+
+
+
+/**
+ * Add a Fastq record.
+ * @see dedup_add()
+ */
+int dedup_addFastq (Dedup this1, Fastq *fq)
+{
+  return dedup_add (this1,fq->seq->sequence,fq->seq->size);
+}
+
+
+
+typedef struct {
+  Dedup dedup;
+  FILE *fp;
+  long long written;
+} DedupFilter;
+
+
+
+static void dedup_filterHook (Fastq *fq, int rangeIndex, void *arg)
+{
+  DedupFilter *filter = (DedupFilter *)arg;
+
+  (void)rangeIndex;
+
+  if (dedup_addFastq (filter->dedup,fq))
+    return;
+  filter->written++;
+  if (filter->fp)
+    fprintf (filter->fp,"@%s\n%s\n+\n%s\n",fq->seq->name,fq->seq->sequence,fq->quality);
+}
+
+
+
+/**
+ * Copy the first copy of each read of a FASTQ file; the file is parsed on several threads
+   while the calling thread looks up the reads in file order, see fastq_parallel().
+ * The reads are parsed ahead into a bounded number of batches of about FASTQ_PARALLEL_RANGE_SIZE
+   bytes each, so the memory used besides the table does not grow with the size of the file.
+ * @param[in] this1 A duplicate finder
+ * @param[in] inFileName Name of a plain or BGZF compressed FASTQ file (not stdin)
+ * @param[in] outFileName Where to write the reads that are not duplicates; NULL to only count
+ * @param[in] nThreads Number of threads parsing the input
+ * @return Number of reads written, -1 if a file could not be opened (see warnReport())
+ */
+long long dedup_fastqFilter (Dedup this1, char *inFileName, char *outFileName, int nThreads)
+{
+  DedupFilter filter;
+
+  filter.dedup = this1;
+  filter.written = 0;
+  filter.fp = NULL;
+  if (outFileName && !(filter.fp = fopen (outFileName,"w"))) {
+    warnAdd ("dedup_fastqFilter",stringPrintBuf ("'%s': %s",outFileName,strerror (errno)));
+    return -1;
+  }
+  if (fastq_parallel (inFileName,nThreads,0,1,dedup_filterHook,&filter) < 0)
+    filter.written = -1;
+  if (filter.fp)
+    fclose (filter.fp);
+  return filter.written;
+}
+
+
+
+/**
+ * Number of reads (or pairs) added.
+ */
+long long dedup_readCountGet (Dedup this1)
+{
+  return this1->readCnt;
+}
+
+
+
+/**
+ * Number of reads (or pairs) reported as duplicates by dedup_add() and friends.
+ */
+long long dedup_duplicateCountGet (Dedup this1)
+{
+  return this1->duplicateCnt;
+}
+
+
+
+/**
+ * Number of distinct reads (or pairs).
+ * With spill files they are merged, so all reads must have been added.
+ * @param[in] this1 A duplicate finder
+ * @param[out] isExact If not NULL, receives 1 if the count is exact (up to fingerprint collisions),
+   0 if it is an estimate because the table was full and could not be spilled
+ */
+long long dedup_distinctCountGet (Dedup this1, int *isExact)
+{
+  FILE **fps;
+  unsigned long long **bufs;
+  long long *lens;
+  long long *poss;
+  unsigned long long minFp;
+  unsigned long long last = 0;
+  long long distinct = 0;
+  long long n;
+  int runCnt;
+  int i,k;
+
+  if (arrayMax (this1->runs) == 0) {
+    if (isExact)
+      *isExact = !this1->saturated;
+    return this1->readCnt - this1->duplicateCnt;
+  }
+  /* merge the runs and the table, which is sorted into run number runCnt - 1 */
+  runCnt = arrayMax (this1->runs) + 1;
+  fps = (FILE **) hlr_calloc (runCnt,sizeof (FILE *));
+  bufs = (unsigned long long **) hlr_calloc (runCnt,sizeof (unsigned long long *));
+  lens = (long long *) hlr_calloc (runCnt,sizeof (long long));
+  poss = (long long *) hlr_calloc (runCnt,sizeof (long long));
+  for (i = 0; i < runCnt - 1; i++) {
+    if (!(fps[i] = fopen (arru (this1->runs,i,char *),"r")))
+      die ("dedup: cannot read '%s': %s",arru (this1->runs,i,char *),strerror (errno));
+    bufs[i] = (unsigned long long *) hlr_malloc (DEDUP_RUN_BUFFER * sizeof (unsigned long long));
+  }
+  pthread_rwlock_wrlock (&this1->spillLock);
+  bufs[runCnt - 1] = this1->slots;
+  lens[runCnt - 1] = dedup_tableSort (this1);
+  for (;;) {
+    k = -1;
+    for (i = 0; i < runCnt; i++) {
+      if (poss[i] == lens[i] && fps[i]) {
+        lens[i] = fread (bufs[i],sizeof (unsigned long long),DEDUP_RUN_BUFFER,fps[i]);
+        poss[i] = 0;
+        if (lens[i] == 0) {
+          fclose (fps[i]);
+          fps[i] = NULL;
+        }
+      }
+      if (poss[i] < lens[i] && (k < 0 || bufs[i][poss[i]] < minFp)) {
+        k = i;
+        minFp = bufs[i][poss[i]];
+      }
+    }
+    if (k < 0)
+      break;
+    if (minFp != last)
+      distinct++;
+    last = minFp;
+    poss[k]++;
+  }
+  /* the table was compacted by sorting; put the fingerprints back into their slots */
+  n = lens[runCnt - 1];
+  bufs[runCnt - 1] = (unsigned long long *) hlr_malloc (MAX (n,1) * sizeof (unsigned long long));
+  memcpy (bufs[runCnt - 1],this1->slots,n * sizeof (unsigned long long));
+  memset (this1->slots,0,this1->slotCnt * sizeof (unsigned long long));
+  this1->fill = 0;
+  for (n--; n >= 0; n--)
+    dedup_tableAdd (this1,bufs[runCnt - 1][n]);
+  pthread_rwlock_unlock (&this1->spillLock);
+  for (i = 0; i < runCnt; i++)
+    hlr_free (bufs[i]);
+  hlr_free (fps);
+  hlr_free (bufs);
+  hlr_free (lens);
+  hlr_free (poss);
+  if (isExact)
+    *isExact = 1;
+  return distinct;
+}
+
+
+
+/**
+ * Print the number of reads, duplicates and distinct reads and the duplication rate.
+ * @param[in] this1 A duplicate finder
+ * @param[in] fp Where to write to
+ */
+void dedup_report (Dedup this1, FILE *fp)
+{
+  int isExact;
+  long long distinct = dedup_distinctCountGet (this1,&isExact);
+
+  fprintf (fp,"reads\t%lld\n",this1->readCnt);
+  fprintf (fp,"duplicatesFiltered\t%lld\n",this1->duplicateCnt);
+  fprintf (fp,"distinct\t%lld%s\n",distinct,isExact ? "" : " (estimate)");
+  fprintf (fp,"duplicationRate\t%.4f\n",this1->readCnt ? 1.0 - (double)distinct / this1->readCnt : 0.0);
+}
+
+
+
+/**
+ * Destroy a duplicate finder and remove its spill files.
+ * @note Do not call this function, but use the macro dedup_destroy
+ */
+void dedup_destroy_func (Dedup this1)
+{
+  int i;
+
+  if (!this1)
+    return;
+  for (i = 0; i < arrayMax (this1->runs); i++) {
+    unlink (arru (this1->runs,i,char *));
+    hlr_free (arru (this1->runs,i,char *));
+  }
+  arrayDestroy (this1->runs);
+  hlr_free (this1->slots);
+  hlr_free (this1->bloom);
+  hlr_free (this1->spillDir);
+  pthread_rwlock_destroy (&this1->spillLock);
+  hlr_free (this1);
+}
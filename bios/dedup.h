@@ -0,0 +1,63 @@
+/**
+ *   \file dedup.h
+ */
+
+
+#ifndef DEF_DEDUP_H
+#define DEF_DEDUP_H
+
+
+#include <stdio.h>
+#include <pthread.h>
+#include "format.h"
+#include "fastq.h"
+
+
+/**
+ * Dedup.
+ * A set of read fingerprints for finding duplicate reads, see dedup_create().
+ */
+typedef struct _dedupStruct_ {
+  /* the members of this struct are PRIVATE for the
+     dedup module -- DO NOT access from outside
+     the dedup module */
+  int prefixLen;                 /* 0: whole reads are compared */
+  unsigned long long *slots;     /* open addressing; 0 is an empty slot */
+  long long slotCnt;             /* a power of 2 */
+  long long maxFill;             /* slots that may be used before the table counts as full */
+  long long fill;
+  int saturated;                 /* table was full and could not be spilled */
+  unsigned long long *bloom;     /* NULL if there is no Bloom filter */
+  long long bloomBits;
+  int bloomHashes;
+  char *spillDir;                /* NULL if the table is not spilled to disk */
+  Array runs;                    /* of char *: files of spilled fingerprints, sorted */
+  pthread_rwlock_t spillLock;    /* spilling excludes all other access */
+  long long readCnt;
+  long long duplicateCnt;
+} *Dedup;
+
+
+
+extern Dedup dedup_create (long long maxMemory, int prefixLen);
+extern void dedup_bloomSet (Dedup this1, long long bytes, int hashes);
+extern void dedup_spillSet (Dedup this1, char *dir);
+extern unsigned long long dedup_fingerprint (char *sequence, int len, int prefixLen);
+extern int dedup_add (Dedup this1, char *sequence, int len);
+extern int dedup_addPair (Dedup this1, char *sequence1, int len1, char *sequence2, int len2);
+extern int dedup_addFastq (Dedup this1, Fastq *fq);
+extern long long dedup_fastqFilter (Dedup this1, char *inFileName, char *outFileName, int nThreads);
+extern long long dedup_readCountGet (Dedup this1);
+extern long long dedup_duplicateCountGet (Dedup this1);
+extern long long dedup_distinctCountGet (Dedup this1, int *isExact);
+extern void dedup_report (Dedup this1, FILE *fp);
+extern void dedup_destroy_func (Dedup this1); /* do not use this function */
+
+/**
+ * Destroy a duplicate finder and remove its spill files.
+ * @see dedup_destroy_func()
+ */
+#define dedup_destroy(this1) (dedup_destroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -0,0 +1,532 @@
+/**
+ *   \file demux.c Module for demultiplexing reads by barcode
+ */
+
+
+/*
+   Module demux
+   Every barcode and each of its 1-mismatch neighbours is packed 2 bits
+   per base and put into one open addressing hash table, so assigning a
+   read takes a single lookup however many samples there are. A
+   neighbour claimed by two samples is marked ambiguous when the table is
+   built; a read with such a barcode stays undetermined. Exact matches
+   win over neighbours of other barcodes.
+   The write functions can be called from several threads: lookups do not
+   change the table, and each sample's output is protected by its own lock.
+*/
+
+
+#include <errno.h>
+#include <unistd.h>
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "seq.h"
+#include "demux.h"
+
+
+
+#define DEMUX_EMPTY -1
+#define DEMUX_AMBIGUOUS -2
+#define DEMUX_BUFFER_SIZE (1 << 16) /* per sample and mate, so hundreds of samples stay cheap */
+
+
+
+static DemuxSample *demux_sampleCreate (Demux this1, char *name, char *barcode)
+{
+  DemuxSample *sample;
+  Stringa fileName;
+
+  sample = (DemuxSample *) hlr_calloc (1,sizeof (DemuxSample));
+  sample->name = hlr_strdup (name);
+  sample->barcode = hlr_strdup (barcode);
+  pthread_mutex_init (&sample->lock,NULL);
+  if (!this1->outPrefix)
+    return sample;
+  fileName = stringCreate (100);
+  stringPrintf (fileName,"%s%s%s.fastq",this1->outPrefix,name,this1->paired ? "_R1" : "");
+  if (!(sample->fp1 = fopen (string (fileName),"w")))
+    warnAdd ("demux",stringPrintBuf ("'%s': %s",string (fileName),strerror (errno)));
+  if (sample->fp1 && this1->paired) {
+    stringPrintf (fileName,"%s%s_R2.fastq",this1->outPrefix,name);
+    if (!(sample->fp2 = fopen (string (fileName),"w"))) {
+      warnAdd ("demux",stringPrintBuf ("'%s': %s",string (fileName),strerror (errno)));
+      fclose (sample->fp1); /* do not leave an orphaned _R1 file behind */
+      sample->fp1 = NULL;
+      stringPrintf (fileName,"%s%s_R1.fastq",this1->outPrefix,name);
+      unlink (string (fileName));
+    }
+  }
+  stringDestroy (fileName);
+  sample->buf1 = stringCreate (DEMUX_BUFFER_SIZE);
+  sample->buf2 = stringCreate (this1->paired ? DEMUX_BUFFER_SIZE : 1);
+  return sample;
+}
+
+
+
+static int demux_sampleFilesOk (Demux this1, DemuxSample *sample)
+{
+  return !this1->outPrefix || (sample->fp1 && (!this1->paired || sample->fp2));
+}
+
+
+
+static void demux_sampleFlush (DemuxSample *sample)
+{
+  if (sample->fp1 && stringLen (sample->buf1) > 0) {
+    if (fwrite (string (sample->buf1),1,stringLen (sample->buf1),sample->fp1) != (size_t)stringLen (sample->buf1))
+      die ("demux: cannot write sample %s: %s",sample->name,strerror (errno));
+    stringClear (sample->buf1);
+  }
+  if (sample->fp2 && stringLen (sample->buf2) > 0) {
+    if (fwrite (string (sample->buf2),1,stringLen (sample->buf2),sample->fp2) != (size_t)stringLen (sample->buf2))
+      die ("demux: cannot write sample %s: %s",sample->name,strerror (errno));
+    stringClear (sample->buf2);
+  }
+}
+
+
+
+static void demux_sampleDestroy (DemuxSample *sample)
+{
+  demux_sampleFlush (sample);
+  if (sample->fp1)
+    fclose (sample->fp1);
+  if (sample->fp2)
+    fclose (sample->fp2);
+  stringDestroy (sample->buf1);
+  stringDestroy (sample->buf2);
+  pthread_mutex_destroy (&sample->lock);
+  hlr_free (sample->name);
+  hlr_free (sample->barcode);
+  hlr_free (sample);
+}
+
+
+
+/**
+ * Create a demultiplexer.
+ * @param[in] outPrefix Reads of sample S are written to outPrefixS.fastq (or outPrefixS_R1.fastq
+   and outPrefixS_R2.fastq), reads without sample to outPrefixundetermined.fastq; NULL if 
+   only demux_lookup() is used
+ * @param[in] paired 1 if pairs are written, see demux_writePair()
+ * @return A demultiplexer, NULL if an output file could not be opened (see warnReport())
+ */
+Demux demux_create (char *outPrefix, int paired)
+{
+  Demux this1;
+
+  this1 = (Demux) hlr_malloc (sizeof (struct _demuxStruct_));
+  this1->outPrefix = outPrefix ? hlr_strdup (outPrefix) : NULL;
+  this1->paired = paired;
+  this1->barcodeLen = 0;
+  this1->samples = arrayCreate (100,DemuxSample *);
+  this1->tableSize = 1024;
+  this1->table = (DemuxSlot *) hlr_malloc (this1->tableSize * sizeof (DemuxSlot));
+  memset (this1->table,0xff,this1->tableSize * sizeof (DemuxSlot));
+  this1->slotCnt = 0;
+  this1->undetermined = demux_sampleCreate (this1,"undetermined","");
+  if (!demux_sampleFilesOk (this1,this1->undetermined)) {
+    demux_close (this1);
+    return NULL;
+  }
+  return this1;
+}
+
+
+
+/**
+ * Pack a barcode 2 bits per base; '+' (between two indices) is skipped.
+ * @return Number of bases packed (stops at barcodeLen bases), -1 if a base is not A, C, G or T;
+   the position of the first such base is stored in *nPos
+ */
+static int demux_pack (char *barcode, int len, int barcodeLen, unsigned long long *key, int *nPos)
+{
+  int bases = 0;
+  int val;
+  int i;
+
+  *key = 0;
+  for (i = 0; i < len && bases < barcodeLen; i++) {
+    if (barcode[i] == '+')
+      continue;
+    if ((val = ntVal[(unsigned char)barcode[i]]) < 0) {
+      if (*nPos >= 0)
+        return -1;
+      *nPos = bases;
+      val = 0;
+    }
+    *key = (*key << 2) | val;
+    bases++;
+  }
+  return bases;
+}
+
+
+
+static DemuxSlot *demux_slotFind (DemuxSlot *table, int tableSize, unsigned long long key)
+{ /* returns the slot of key or the empty slot where it would go */
+  unsigned int i = (key * 0x9E3779B97F4A7C15ULL) >> 40;
+
+  for (;;) {
+    i &= tableSize - 1;
+    if (table[i].sample == DEMUX_EMPTY || table[i].key == key)
+      return table + i;
+    i++;
+  }
+}
+
+
+
+static void demux_tableGrow (Demux this1)
+{
+  DemuxSlot *old = this1->table;
+  int oldSize = this1->tableSize;
+  int i;
+
+  this1->tableSize *= 2;
+  this1->table = (DemuxSlot *) hlr_malloc (this1->tableSize * sizeof (DemuxSlot));
+  memset (this1->table,0xff,this1->tableSize * sizeof (DemuxSlot));
+  for (i = 0; i < oldSize; i++)
+    if (old[i].sample != DEMUX_EMPTY)
+      *demux_slotFind (this1->table,this1->tableSize,old[i].key) = old[i];
+  hlr_free (old);
+}
+
+
+
+static void demux_insert (Demux this1, unsigned long long key, int sample, int mismatches)
+{
+  DemuxSlot *slot;
+
+  if (2 * (this1->slotCnt + 1) > this1->tableSize)
+    demux_tableGrow (this1);
+  slot = demux_slotFind (this1->table,this1->tableSize,key);
+  if (slot->sample == DEMUX_EMPTY) {
+    slot->key = key;
+    slot->sample = sample;
+    slot->mismatches = mismatches;
+    this1->slotCnt++;
+  }
+  else if (mismatches < slot->mismatches) {
+    slot->sample = sample;
+    slot->mismatches = mismatches;
+  }
+  else if (mismatches == slot->mismatches && slot->sample != sample)
+    slot->sample = DEMUX_AMBIGUOUS;
+}
+
+
+
+/**
+ * Add a sample.
+ * @param[in] this1 A demultiplexer
+ * @param[in] name Name of the sample, used in the output file name
+ * @param[in] barcode Barcode of A, C, G and T; for dual indexing both indices separated by '+';
+   all barcodes must have the same length
+ * @return 1 if ok, 0 if an output file could not be opened (see warnReport())
+ */
+int demux_sampleAdd (Demux this1, char *name, char *barcode)
+{
+  DemuxSample *sample;
+  unsigned long long key;
+  int sampleIndex = arrayMax (this1->samples);
+  int nPos = -1;
+  int len;
+  int shift;
+  int b,i;
+
+  len = demux_pack (barcode,strlen (barcode),DEMUX_MAX_BARCODE + 1,&key,&nPos);
+  if (nPos >= 0 || len < 1 || len > DEMUX_MAX_BARCODE)
+    die ("demux_sampleAdd: sample %s: barcode '%s' must have 1 to %d bases A, C, G or T",
+         name,barcode,DEMUX_MAX_BARCODE);
+  if (this1->barcodeLen == 0)
+    this1->barcodeLen = len;
+  else if (len != this1->barcodeLen)
+    die ("demux_sampleAdd: sample %s: barcode '%s' does not have %d bases",name,barcode,this1->barcodeLen);
+  if (demux_slotFind (this1->table,this1->tableSize,key)->mismatches == 0)
+    die ("demux_sampleAdd: sample %s: barcode '%s' is used twice",name,barcode);
+  sample = demux_sampleCreate (this1,name,barcode);
+  if (!demux_sampleFilesOk (this1,sample)) {
+    demux_sampleDestroy (sample);
+    return 0;
+  }
+  array (this1->samples,sampleIndex,DemuxSample *) = sample;
+  demux_insert (this1,key,sampleIndex,0);
+  for (i = 0; i < len; i++) {
+    shift = 2 * (len - 1 - i);
+    for (b = 1; b < 4; b++)
+      demux_insert (this1,key ^ ((unsigned long long)b << shift),sampleIndex,1);
+  }
+  return 1;
+}
+
+
+
+/**
+ * Number of samples added.
+ */
+int demux_sampleCountGet (Demux this1)
+{
+  return arrayMax (this1->samples);
+}
+
+
+
+static DemuxSample *demux_sampleGet (Demux this1, int sample)
+{
+  return sample == DEMUX_UNDETERMINED ? this1->undetermined : arru (this1->samples,sample,DemuxSample *);
+}
+
+
+
+/**
+ * Name of a sample.
+ * @param[in] this1 A demultiplexer
+ * @param[in] sample 0 .. demux_sampleCountGet()-1, or DEMUX_UNDETERMINED
+ */
+char *demux_sampleNameGet (Demux this1, int sample)
+{
+  return demux_sampleGet (this1,sample)->name;
+}
+
+
+
+/**
+ * Number of reads (or pairs) written for a sample.
+ * @param[in] this1 A demultiplexer
+ * @param[in] sample 0 .. demux_sampleCountGet()-1, or DEMUX_UNDETERMINED
+ */
+long long demux_sampleReadCountGet (Demux this1, int sample)
+{
+  return demux_sampleGet (this1,sample)->readCnt;
+}
+
+
+
+/**
+ * Find the sample of a barcode with at most one mismatch; a single N counts as a mismatch.
+ * @param[in] this1 A demultiplexer
+ * @param[in] barcode Barcode of the read, need not be null-terminated; only its first
+   bases are used if it is longer than the barcodes of the samples
+ * @param[in] len Length of barcode
+ * @param[out] mismatches If not NULL, receives the number of mismatches
+ * @return Index of the sample, DEMUX_UNDETERMINED if there is none or more than one
+ */
+int demux_lookup (Demux this1, char *barcode, int len, int *mismatches)
+{
+  DemuxSlot *slot;
+  unsigned long long key;
+  int nPos = -1;
+  int sample = DEMUX_UNDETERMINED;
+  int shift;
+  int b;
+
+  if (demux_pack (barcode,len,this1->barcodeLen,&key,&nPos) != this1->barcodeLen || this1->barcodeLen == 0)
+    return DEMUX_UNDETERMINED;
+  if (nPos < 0) {
+    slot = demux_slotFind (this1->table,this1->tableSize,key);
+    if (slot->sample < 0)
+      return DEMUX_UNDETERMINED;
+    if (mismatches)
+      *mismatches = slot->mismatches;
+    return slot->sample;
+  }
+  shift = 2 * (this1->barcodeLen - 1 - nPos);
+  for (b = 0; b < 4; b++) {
+    slot = demux_slotFind (this1->table,this1->tableSize,key | ((unsigned long long)b << shift));
+    if (slot->sample < 0 || slot->mismatches > 0)
+      continue;
+    if (sample != DEMUX_UNDETERMINED)
+      return DEMUX_UNDETERMINED;
+    sample = slot->sample;
+  }
+  if (mismatches)
+    *mismatches = 1;
+  return sample;
+}
+
+
+
+/**
+ * Locate the index sequence in a read name as written by Illumina software, 
+   e.g. "M00123:8:000-ABC:1:1101:15589:1331 1:N:0:ACGTACGT+TTGATTGA": the part after the last ':'.
+ * @param[in] name Read name, null-terminated
+ * @param[out] len Receives the length of the barcode
+ * @return Start of the barcode inside name, NULL if name has no ':'
+ */
+char *demux_barcodeFromName (char *name, int *len)
+{
+  char *colon = strrchr (name,':');
+  char *end;
+
+  if (!colon)
+    return NULL;
+  for (end = colon + 1; *end && !isspace (*end); end++)
+    ;
+  *len = end - colon - 1;
+  return colon + 1;
+}
+
+
+
+/**
+ * Find the sample of an entry of an export file, using the index field of its first end.
+ * @return Index of the sample, DEMUX_UNDETERMINED if there is none or more than one
+ */
+int demux_exportPELookup (Demux this1, ExportPE *entry)
+{
+  if (!entry->end1->index)
+    return DEMUX_UNDETERMINED;
+  return demux_lookup (this1,entry->end1->index,strlen (entry->end1->index),NULL);
+}
+
+
+
+static int demux_nameLookup (Demux this1, char *name)
+{
+  char *barcode;
+  int len;
+
+  if (!(barcode = demux_barcodeFromName (name,&len)))
+    return DEMUX_UNDETERMINED;
+  return demux_lookup (this1,barcode,len,NULL);
+}
+
+
+
+static void demux_append (Stringa buf, char *name, char *sequence, char *quality)
+{
+  stringCat (buf,"@");
+  stringCat (buf,name);
+  stringCat (buf,"\n");
+  stringCat (buf,sequence);
+  stringCat (buf,"\n+\n");
+  stringCat (buf,quality);
+  stringCat (buf,"\n");
+}
+
+
+
+static void demux_sampleWrite (DemuxSample *sample, char *name1, char *sequence1, char *quality1,
+                               char *name2, char *sequence2, char *quality2)
+{
+  pthread_mutex_lock (&sample->lock);
+  sample->readCnt++;
+  if (sample->fp1) {
+    demux_append (sample->buf1,name1,sequence1,quality1);
+    if (name2)
+      demux_append (sample->buf2,name2,sequence2,quality2);
+    if (stringLen (sample->buf1) >= DEMUX_BUFFER_SIZE || stringLen (sample->buf2) >= DEMUX_BUFFER_SIZE)
+      demux_sampleFlush (sample);
+  }
+  pthread_mutex_unlock (&sample->lock);
+}
+
+
+
+/**
+ * Write a record to the file of its sample; the barcode is taken from its name, see demux_barcodeFromName().
+ * @param[in] this1 A demultiplexer created for single reads
+ * @param[in] rec A record; its name must not be truncated
+ * @return Index of the sample, DEMUX_UNDETERMINED if the record went to the undetermined reads
+ * @note Can be called from several threads at the same time; the order of the records in
+   a sample file is then the order in which the calls happened.
+ */
+int demux_writeRecord (Demux this1, FastqRecord *rec)
+{
+  int sample;
+
+  if (this1->paired)
+    die ("demux_writeRecord: demultiplexer was created for pairs, use demux_writePair()");
+  sample = demux_nameLookup (this1,rec->name);
+  demux_sampleWrite (demux_sampleGet (this1,sample),rec->name,rec->sequence,rec->quality,NULL,NULL,NULL);
+  return sample;
+}
+
+
+
+/**
+ * Write a pair to the files of its sample; the barcode is taken from the name of the first mate.
+ * @param[in] this1 A demultiplexer created for pairs
+ * @param[in] rec1 First mate
+ * @param[in] rec2 Second mate
+ * @return Index of the sample, DEMUX_UNDETERMINED if the pair went to the undetermined reads
+ * @note Can be called from several threads at the same time, e.g. from the work hook 
+   of fastq_pairProcess().
+ */
+int demux_writePair (Demux this1, FastqRecord *rec1, FastqRecord *rec2)
+{
+  int sample = demux_nameLookup (this1,rec1->name);
+
+  if (!this1->paired)
+    die ("demux_writePair: demultiplexer was not created for pairs");
+  demux_sampleWrite (demux_sampleGet (this1,sample),rec1->name,rec1->sequence,rec1->quality,
+                     rec2->name,rec2->sequence,rec2->quality);
+  return sample;
+}
+
+
+
+/**
+ * Write a Fastq to the file of its sample.
+ * @see demux_writeRecord()
+ */
+int demux_writeFastq (Demux this1, Fastq *fq)
+{
+  int sample;
+
+  if (this1->paired)
+    die ("demux_writeFastq: demultiplexer was created for pairs, use demux_writePair()");
+  sample = demux_nameLookup (this1,fq->seq->name);
+  demux_sampleWrite (demux_sampleGet (this1,sample),fq->seq->name,fq->seq->sequence,fq->quality,
+                     NULL,NULL,NULL);
+  return sample;
+}
+
+
+
+static void demux_fastqHook (Fastq *fq, int rangeIndex, void *arg)
+{
+  (void)rangeIndex;
+  demux_writeFastq ((Demux)arg,fq);
+}
+
+
+
+/**
+ * Demultiplex a FASTQ file on several threads, see fastq_parallel().
+ * @param[in] this1 A demultiplexer created for single reads
+ * @param[in] fileName Name of a plain or BGZF compressed FASTQ file (not stdin)
+ * @param[in] nThreads Number of threads
+ * @return Number of reads, -1 if the file could not be opened (see warnReport())
+ * @note The reads of a sample are not written in file order.
+ */
+long long demux_fastqFile (Demux this1, char *fileName, int nThreads)
+{
+  if (this1->paired)
+    die ("demux_fastqFile: demultiplexer was created for pairs, use fastq_pairProcess() and demux_writePair()");
+  return fastq_parallel (fileName,nThreads,0,0,demux_fastqHook,this1);
+}
+
+
+
+/**
+ * Write all buffered records, close the output files and free the demultiplexer.
+ * @note Do not call this function, but use the macro demux_close
+ */
+void demux_close_func (Demux this1)
+{
+  int i;
+
+  if (!this1)
+    return;
+  for (i = 0; i < arrayMax (this1->samples); i++)
+    demux_sampleDestroy (arru (this1->samples,i,DemuxSample *));
+  demux_sampleDestroy (this1->undetermined);
+  arrayDestroy (this1->samples);
+  hlr_free (this1->table);
+  hlr_free (this1->outPrefix);
+  hlr_free (this1);
+}
@@ -0,0 +1,98 @@
+/**
+ *   \file demux.h
+ */
+
+
+#ifndef DEF_DEMUX_H
+#define DEF_DEMUX_H
+
+
+#include <stdio.h>
+#include <pthread.h>
+#include "format.h"
+#include "fastq.h"
+#include "exportPEParser.h"
+
+
+/**
+ * Returned by demux_lookup() for reads that cannot be assigned to a sample.
+ */
+#define DEMUX_UNDETERMINED -1
+
+/**
+ * Longest barcode (both indices together for dual indexing).
+ */
+#define DEMUX_MAX_BARCODE 32
+
+
+
+/**
+ * DemuxSlot.
+ * An entry of the barcode hash table.
+ */
+typedef struct {
+  unsigned long long key;  /* barcode packed 2 bits per base */
+  int sample;              /* -1: empty slot, -2: ambiguous */
+  int mismatches;          /* 0 or 1 */
+} DemuxSlot;
+
+
+
+/**
+ * DemuxSample.
+ * A sample and its output files.
+ */
+typedef struct {
+  char *name;
+  char *barcode;
+  FILE *fp1;               /* NULL if no files are written */
+  FILE *fp2;               /* second mates; NULL for single reads */
+  Stringa buf1;            /* records waiting to be written to fp1 */
+  Stringa buf2;
+  long long readCnt;
+  pthread_mutex_t lock;    /* protects the members above */
+} DemuxSample;
+
+
+
+/**
+ * Demux.
+ */
+typedef struct _demuxStruct_ {
+  /* the members of this struct are PRIVATE for the
+     demux module -- DO NOT access from outside
+     the demux module */
+  char *outPrefix;         /* NULL if no files are written */
+  int paired;
+  int barcodeLen;          /* 0 until the first sample is added */
+  Array samples;           /* of DemuxSample *, in the order they were added */
+  DemuxSample *undetermined; /* collects the reads without a matching barcode */
+  DemuxSlot *table;
+  int tableSize;           /* a power of 2 */
+  int slotCnt;             /* used slots */
+} *Demux;
+
+
+
+extern Demux demux_create (char *outPrefix, int paired);
+extern int demux_sampleAdd (Demux this1, char *name, char *barcode);
+extern int demux_sampleCountGet (Demux this1);
+extern char *demux_sampleNameGet (Demux this1, int sample);
+extern long long demux_sampleReadCountGet (Demux this1, int sample);
+extern int demux_lookup (Demux this1, char *barcode, int len, int *mismatches);
+extern char *demux_barcodeFromName (char *name, int *len);
+extern int demux_exportPELookup (Demux this1, ExportPE *entry);
+extern int demux_writeRecord (Demux this1, FastqRecord *rec);
+extern int demux_writePair (Demux this1, FastqRecord *rec1, FastqRecord *rec2);
+extern int demux_writeFastq (Demux this1, Fastq *fq);
+extern long long demux_fastqFile (Demux this1, char *fileName, int nThreads);
+extern void demux_close_func (Demux this1); /* do not use this function */
+
+/**
+ * Write all buffered records, close the output files and free the demultiplexer.
+ * @see demux_close_func()
+ */
+#define demux_close(this1) (demux_close_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -24,6 +24,7 @@ static LineStream ls = NULL;
 void elandMultiParser_init (char *fileName)
 {
   ls = ls_createFromFile (fileName);
+  ls_statsLabelSet (ls,"elandMultiParser");
 }
 
 
@@ -25,7 +25,9 @@ static LineStream ls2 = NULL;
 void exportPEParser_initFromFile (char *fileName1, char* fileName2)
 {
   ls1 = ls_createFromFile (fileName1);
+  ls_statsLabelSet (ls1,"exportPEParser");
   ls2 = ls_createFromFile (fileName2);
+  ls_statsLabelSet (ls2,"exportPEParser");
 }
 
 /**
@@ -36,7 +38,9 @@ void exportPEParser_initFromFile (char *fileName1, char* fileName2)
 void exportPEParser_initFromPipe (char *cmd1, char* cmd2)
 {
   ls1 = ls_createFromPipe ( cmd1 );
+  ls_statsLabelSet (ls1,"exportPEParser");
   ls2 = ls_createFromPipe ( cmd2 );
+  ls_statsLabelSet (ls2,"exportPEParser");
 }
 
 
@@ -4,11 +4,16 @@
  */
 
 
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
 #include "log.h"
 #include "format.h"
 #include "linestream.h"
 #include "stringUtil.h"
 #include "common.h"
+#include "threadPool.h"
 #include "fasta.h"
 
 
@@ -16,19 +21,121 @@
 #define NUM_CHARACTRS_PER_LINE 60
 
 
-static LineStream lsFasta = NULL;
+static FastaReader fastaReader = NULL; /* used by fasta_initFromFile() etc. */
+
+
+
+static void fasta_freeSeq (Seq **pSeq)
+{
+  Seq *seq = *pSeq;
+
+  if (seq == NULL) {
+    return;
+  }
+  hlr_free (seq->name);
+  hlr_free (seq->sequence);
+  freeMem (seq);
+  *pSeq = NULL;
+}
+
+
+
+/**
+ * Create a FASTA reader on a line stream.
+ * @param[in] ls A line stream; the reader takes ownership and destroys it in fasta_readerClose()
+ * @return A FASTA reader
+ * @note Readers share no state, so several of them can be used at the same time,
+   each one by one thread.
+ */
+FastaReader fasta_readerCreate (LineStream ls)
+{
+  FastaReader this1;
+
+  if (ls == NULL)
+    die ("fasta_readerCreate: no line stream given");
+  this1 = (FastaReader) hlr_malloc (sizeof (struct _fastaReaderStruct_));
+  this1->ls = ls;
+  this1->header = stringCreate (100);
+  this1->haveHeader = 0;
+  this1->currSeq = NULL;
+  this1->faiHint = NULL;
+  ls_statsLabelSet (ls,"fasta");
+  return this1;
+}
+
+
+
+/**
+ * Open a FASTA file for reading.
+ * If fileName.fai exists, the sequence sizes it lists are used to allocate each sequence at its final size.
+ * @param[in] fileName Name of the file; use "-" to denote stdin
+ * @return A FASTA reader, or NULL if the file could not be opened (see warnReport())
+ */
+FastaReader fasta_readerOpen (char *fileName)
+{
+  FastaReader this1;
+  LineStream ls;
+  Stringa faiName;
+
+  if (!(ls = ls_createFromFile (fileName)))
+    return NULL;
+  this1 = fasta_readerCreate (ls);
+  if (strcmp (fileName,"-") != 0) {
+    faiName = stringCreate (100);
+    stringPrintf (faiName,"%s.fai",fileName);
+    if (access (string (faiName),R_OK) == 0)
+      this1->faiHint = fasta_indexOpen (fileName);
+    stringDestroy (faiName);
+  }
+  return this1;
+}
+
+
+
+/**
+ * Open a FASTA reader on the output of a command.
+ * @return A FASTA reader, or NULL if the command could not be started (see warnReport())
+ */
+FastaReader fasta_readerOpenPipe (char *command)
+{
+  LineStream ls;
+
+  if (!(ls = ls_createFromPipe (command)))
+    return NULL;
+  return fasta_readerCreate (ls);
+}
+
+
+
+/**
+ * Close a FASTA reader; frees the sequence returned last by fasta_readerNext().
+ * @param[in] this1 A FASTA reader
+ * @note Do not call this function, but use the macro fasta_readerClose
+ */
+void fasta_readerClose_func (FastaReader this1)
+{
+  if (!this1)
+    return;
+  ls_destroy (this1->ls);
+  stringDestroy (this1->header);
+  fasta_freeSeq (&this1->currSeq);
+  fasta_indexClose (this1->faiHint);
+  hlr_free (this1);
+}
 
 
 
 /**
  * Initialize the FASTA module using a file name.
+ * If fileName.fai exists, the sequence sizes it lists are used to allocate each sequence at its final size.
  * @note Use "-" to denote stdin.
  * @post fasta_nextSequence(), fasta_readAllSequences() can be called.
+ * @see fasta_readerOpen() to read several files at the same time
  */
 void fasta_initFromFile (char* fileName) 
 {
-  lsFasta = ls_createFromFile (fileName);
-  ls_bufferSet (lsFasta,1);
+  if (!(fastaReader = fasta_readerOpen (fileName)))
+    die ("fasta_initFromFile: %s",warnReport ());
 }
 
 
@@ -38,7 +145,7 @@ void fasta_initFromFile (char* fileName)
  */
 void fasta_deInit (void) 
 {
-  ls_destroy (lsFasta);
+  fasta_readerClose (fastaReader);
 }
 
 
@@ -49,97 +156,143 @@ void fasta_deInit (void)
  */
 void fasta_initFromPipe (char* command)
 {
-  lsFasta = ls_createFromPipe (command);
-  ls_bufferSet (lsFasta,1);
+  if (!(fastaReader = fasta_readerOpenPipe (command)))
+    die ("fasta_initFromPipe: %s",warnReport ());
 }
 
 
 
-static void fasta_freeSeq (Seq* currSeq)
+/**
+ * Copy the name from a header line.
+ */
+static char* fasta_headerName (char *line, int truncateName)
 {
-  if (currSeq == NULL) {
-    return;
+  char *end;
+  char *name;
+
+  if (!truncateName) {
+    return hlr_strdup (line);
   }
-  hlr_free (currSeq->name);
-  hlr_free (currSeq->sequence);
-  freeMem (currSeq);
-  currSeq = NULL;
+  line = skipLeadingSpaces (line);
+  for (end = line; *end != '\0' && !isspace (*end); end++)
+    ;
+  name = hlr_malloc (end - line + 1);
+  memcpy (name,line,end - line);
+  name[end - line] = '\0';
+  return name;
 }
 
 
 
-static Seq* fasta_processNextSequence (int freeMemory, int truncateName)
+/**
+ * Number of bases of sequence 'name' according to the .fai index, or -1.
+ */
+static long long fasta_sizeHint (FastaReader this1, char *name, int truncateName)
 {
-  char *line;
-  static Stringa buffer = NULL;
-  static Seq* currSeq = NULL;
-  int count;
+  FastaIndexEntry *entry;
+  char *word;
+
+  if (this1->faiHint == NULL) {
+    return -1;
+  }
+  word = truncateName ? name : fasta_headerName (name,1);
+  entry = fasta_indexFind (this1->faiHint,word);
+  if (word != name) {
+    hlr_free (word);
+  }
+  return entry ? entry->length : -1;
+}
 
-  if (ls_isEof (lsFasta)) {
-    if (freeMemory) {
-      fasta_freeSeq (currSeq);
+
+
+static Seq* fasta_processNextSequence (FastaReader this1, int freeMemory, int truncateName)
+{
+  LineView view;
+  Seq *seq;
+  long long size = 0;
+  long long capacity;
+
+  if (freeMemory) {
+    fasta_freeSeq (&this1->currSeq);
+  }
+  while (!this1->haveHeader && ls_nextLineView (this1->ls,&view)) {
+    if (view.len == 0) {
+      continue;
     }
+    if (view.line[0] != '>') {
+      die ("fasta: line %d: sequence without header",ls_lineCountGet (this1->ls));
+    }
+    stringNCpy (this1->header,view.line + 1,view.len - 1);
+    this1->haveHeader = 1;
+  }
+  if (!this1->haveHeader) {
     return NULL;
   }
-  count = 0;
-  stringCreateClear (buffer,1000);
-  while (line = ls_nextLine (lsFasta)) {
-    if (line[0] == '\0') {
-      continue;
+  this1->haveHeader = 0;
+  AllocVar (seq);
+  seq->name = fasta_headerName (string (this1->header),truncateName);
+  capacity = fasta_sizeHint (this1,seq->name,truncateName) + 1;
+  if (capacity <= 0) {
+    capacity = 1024;
+  }
+  seq->sequence = hlr_malloc (capacity);
+  while (ls_nextLineView (this1->ls,&view)) {
+    if (view.len > 0 && view.line[0] == '>') {
+      stringNCpy (this1->header,view.line + 1,view.len - 1);
+      this1->haveHeader = 1;
+      break;
     }
-    if (line[0] == '>') {
-      count++;
-      if (count == 1) {
-	if (freeMemory) {
-	  fasta_freeSeq (currSeq);
-	}
-	AllocVar (currSeq);
-	currSeq->name = hlr_strdup (line + 1);
-	if (truncateName) {
-	  currSeq->name = firstWordInLine (skipLeadingSpaces (currSeq->name));
-	}
-	continue;
-      }
-      else if (count == 2) {
-	currSeq->sequence = hlr_strdup (string (buffer));
-	currSeq->size = stringLen (buffer);
-	ls_back (lsFasta,1);
-	return currSeq;
+    if (size + view.len + 1 > capacity) {
+      capacity = MAX (2 * capacity,size + view.len + 1);
+      seq->sequence = hlr_realloc (seq->sequence,capacity);
+      if (seq->sequence == NULL) {
+        die ("fasta: out of memory for sequence '%s'",seq->name);
       }
     }
-    stringCat (buffer,line);
+    memcpy (seq->sequence + size,view.line,view.len);
+    size += view.len;
+  }
+  seq->sequence[size] = '\0';
+  if (capacity > size + 1 + size / 8) {
+    seq->sequence = hlr_realloc (seq->sequence,size + 1);
   }
-  currSeq->sequence = hlr_strdup (string (buffer));
-  currSeq->size = stringLen (buffer);
-  return currSeq;
+  seq->size = size;
+  if (freeMemory) {
+    this1->currSeq = seq;
+  }
+  return seq;
 } 
 
 
 
 /**
- * Returns a pointer to the next FASTA sequence.
- * @param[in] truncateName If truncateName > 0, leading spaces of the name are skipped. Furthermore, the name is truncated after the first white space. If truncateName == 0, the name is stored as is.
- * @note The memory belongs to this routine.
+ * Returns a pointer to the next sequence of a FASTA reader.
+ * @param[in] this1 A FASTA reader
+ * @param[in] truncateName See fasta_nextSequence()
+ * @return The sequence, or NULL at the end of the input
+ * @note The memory belongs to the reader and is valid until the next call. To keep the bases 
+   without copying them, take over seq->sequence (free with hlr_free()) and set it to NULL.
  */
-Seq* fasta_nextSequence (int truncateName) 
+Seq* fasta_readerNext (FastaReader this1, int truncateName)
 {
-  return fasta_processNextSequence (1,truncateName);
+  return fasta_processNextSequence (this1,1,truncateName);
 }
 
 
 
 /**
- * Returns an Array of FASTA sequences.
- * @param[in] truncateName If truncateName > 0, leading spaces of the name are skipped. Furthermore, the name is truncated after the first white space. If truncateName == 0, the name is stored as is.
- * @note The memory belongs to this routine.
+ * Returns an Array of all remaining sequences of a FASTA reader.
+ * @param[in] this1 A FASTA reader
+ * @param[in] truncateName See fasta_nextSequence()
+ * @note The memory belongs to the caller.
  */
-Array fasta_readAllSequences (int truncateName)
+Array fasta_readerReadAll (FastaReader this1, int truncateName)
 {
   Array seqs;
   Seq *currSeq;
 
   seqs = arrayCreate (100000,Seq);
-  while (currSeq = fasta_processNextSequence (0,truncateName)) {
+  while (currSeq = fasta_processNextSequence (this1,0,truncateName)) {
     array (seqs,arrayMax (seqs),Seq) = *currSeq;
     freeMem (currSeq);
   }
@@ -148,15 +301,46 @@ Array fasta_readAllSequences (int truncateName)
 
 
 
+/**
+ * Returns a pointer to the next FASTA sequence.
+ * @param[in] truncateName If truncateName > 0, leading spaces of the name are skipped. Furthermore, the name is truncated after the first white space. If truncateName == 0, the name is stored as is.
+ * @note The memory belongs to this routine. To keep the bases without copying them, 
+   take over seq->sequence (free with hlr_free()) and set it to NULL.
+ */
+Seq* fasta_nextSequence (int truncateName) 
+{
+  return fasta_readerNext (fastaReader,truncateName);
+}
+
+
+
+/**
+ * Returns an Array of FASTA sequences.
+ * @param[in] truncateName If truncateName > 0, leading spaces of the name are skipped. Furthermore, the name is truncated after the first white space. If truncateName == 0, the name is stored as is.
+ * @note The memory belongs to this routine.
+ */
+Array fasta_readAllSequences (int truncateName)
+{
+  return fasta_readerReadAll (fastaReader,truncateName);
+}
+
+
+
 /**
  * Prints currSeq to stdout.
  */
 void fasta_printOneSequence (Seq* currSeq) 
 {
-  char *seq;
-  
-  seq = insertWordEveryNthPosition (currSeq->sequence,"\n",NUM_CHARACTRS_PER_LINE);
-  printf(">%s\n%s\n",currSeq->name,seq);
+  int i;
+
+  printf (">%s\n",currSeq->name);
+  for (i = 0; i < currSeq->size; i += NUM_CHARACTRS_PER_LINE) {
+    fwrite (currSeq->sequence + i,1,MIN (NUM_CHARACTRS_PER_LINE,currSeq->size - i),stdout);
+    putchar ('\n');
+  }
+  if (currSeq->size == 0) {
+    putchar ('\n');
+  }
 }
 
 
@@ -174,3 +358,806 @@ void fasta_printSequences (Array seqs)
     fasta_printOneSequence (currSeq); 
   }
 }
+
+
+
+/**
+ * Decides whether a FASTA record starts at 'text'; for use with ls_splitFile() and ls_parallel().
+ * @param[in] text Start of a line, not null-terminated
+ * @param[in] len Number of bytes available at 'text', at least 1
+ * @param[in] atEof 1 if 'text' reaches up to the end of the file
+ * @return 1 if the line is a header line, else 0
+ */
+int fasta_recordStart (char *text, int len, int atEof)
+{
+  (void)len; /* the first byte is always there */
+  (void)atEof;
+  return text[0] == '>';
+}
+
+
+
+/**
+ * FastaRangeJob.
+ * One range of a file parsed by fasta_parallel(); PRIVATE to the fasta module.
+ */
+typedef struct {
+  char *fileName;
+  LsRange *range;
+  int rangeIndex;
+  int truncateName;
+  FastaIndex faiHint;     /* shared by all ranges, NULL if there is no .fai */
+  void (*record_hook)(Seq *seq, int rangeIndex, void *arg);  /* called on the worker thread, else NULL */
+  void *arg;
+  Array seqs;             /* of Seq: sequences of the range when collecting, else NULL */
+  long long recordCnt;
+  ThreadPoolJob job;
+} FastaRangeJob;
+
+
+
+static void fasta_rangeJobRun (void *arg)
+{
+  FastaRangeJob *rj = (FastaRangeJob *)arg;
+  FastaReader reader;
+  LineStream ls;
+  Seq *seq;
+
+  if (!(ls = ls_createFromFileRange (rj->fileName,rj->range->start,rj->range->end)))
+    die ("fasta_parallel: %s",warnReport ());
+  reader = fasta_readerCreate (ls);
+  reader->faiHint = rj->faiHint;
+  rj->recordCnt = 0;
+  if (rj->record_hook) {
+    while ((seq = fasta_processNextSequence (reader,1,rj->truncateName))) {
+      rj->record_hook (seq,rj->rangeIndex,rj->arg);
+      rj->recordCnt++;
+    }
+  }
+  else {
+    rj->seqs = fasta_readerReadAll (reader,rj->truncateName);
+    rj->recordCnt = arrayMax (rj->seqs);
+  }
+  reader->faiHint = NULL;
+  fasta_readerClose (reader);
+}
+
+
+
+static void fasta_rangeJobSubmit (ThreadPool pool, FastaRangeJob *rj, Array ranges, int i)
+{
+  rj->range = arrp (ranges,i,LsRange);
+  rj->rangeIndex = i;
+  threadPool_submit (pool,&rj->job,fasta_rangeJobRun,rj);
+}
+
+
+
+/*
+ * The .fai index of fileName as a size hint for the ranges, NULL if there is none.
+ */
+static FastaIndex fasta_faiHintOpen (char *fileName)
+{
+  FastaIndex faiHint;
+  Stringa faiName;
+
+  faiName = stringCreate (100);
+  stringPrintf (faiName,"%s.fai",fileName);
+  faiHint = access (string (faiName),R_OK) == 0 ? fasta_indexOpen (fileName) : NULL;
+  stringDestroy (faiName);
+  return faiHint;
+}
+
+
+
+/**
+ * Parse a FASTA file on several threads.
+ * The file is split into ranges of about FASTA_PARALLEL_RANGE_SIZE bytes by ls_splitFile(); 
+   each range starts at a header line and is parsed on its own thread. At most 2 * nThreads 
+   ranges are in flight; the next range is only started once the first one has been consumed.
+   A file with few long sequences gains little.
+ * @param[in] fileName Name of a plain or BGZF compressed file (not stdin)
+ * @param[in] nThreads Number of threads; see threadPool_cpuCount()
+ * @param[in] truncateName See fasta_nextSequence()
+ * @param[in] ordered If 1, record_hook is called in the calling thread, in file order;
+   ranges are parsed ahead in the background. If 0, record_hook is called on the worker
+   threads as soon as a sequence has been parsed; sequences of one range arrive in file order,
+   ranges in any order, so record_hook must synchronise itself or only touch data of 
+   its rangeIndex.
+ * @param[in] record_hook Called once per sequence; the sequence belongs to this routine and 
+   is only valid during the call
+ * @param[in] arg Passed to record_hook
+ * @return Number of sequences, -1 if the file could not be opened (see warnReport())
+ * @note The worker threads run without any synchronisation, so the same rules as for 
+   ls_parallel() apply to an unordered record_hook. A malformed sequence ends the program via die().
+ */
+long long fasta_parallel (char *fileName, int nThreads, int truncateName, int ordered,
+                          void (*record_hook)(Seq *seq, int rangeIndex, void *arg), void *arg)
+{
+  FastaRangeJob *jobs;
+  FastaRangeJob *rj;
+  FastaIndex faiHint;
+  ThreadPool pool;
+  Array ranges;
+  Seq *seq;
+  long long recordCnt = 0;
+  int nJobs;
+  int i,k;
+
+  if (!(ranges = ls_splitFile (fileName,ls_rangeCount (fileName,FASTA_PARALLEL_RANGE_SIZE,4 * nThreads),
+                               fasta_recordStart)))
+    return -1;
+  faiHint = fasta_faiHintOpen (fileName);
+  nJobs = MIN (2 * nThreads,arrayMax (ranges));
+  jobs = (FastaRangeJob *) hlr_calloc (nJobs,sizeof (FastaRangeJob));
+  pool = threadPool_create (nThreads);
+  for (i = 0; i < nJobs; i++) {
+    jobs[i].fileName = fileName;
+    jobs[i].truncateName = truncateName;
+    jobs[i].faiHint = faiHint;
+    jobs[i].record_hook = ordered ? NULL : record_hook;
+    jobs[i].arg = arg;
+    fasta_rangeJobSubmit (pool,&jobs[i],ranges,i);
+  }
+  for (i = 0; i < arrayMax (ranges); i++) {
+    rj = &jobs[i % nJobs];
+    threadPool_waitJob (pool,&rj->job);
+    recordCnt += rj->recordCnt;
+    if (ordered) {
+      for (k = 0; k < arrayMax (rj->seqs); k++) {
+        seq = arrp (rj->seqs,k,Seq);
+        record_hook (seq,i,arg);
+        hlr_free (seq->name);
+        hlr_free (seq->sequence);
+      }
+      arrayDestroy (rj->seqs);
+    }
+    if (i + nJobs < arrayMax (ranges))
+      fasta_rangeJobSubmit (pool,rj,ranges,i + nJobs);
+  }
+  threadPool_destroy (pool);
+  fasta_indexClose (faiHint);
+  hlr_free (jobs);
+  arrayDestroy (ranges);
+  return recordCnt;
+}
+
+
+
+/**
+ * Read all sequences of a FASTA file on several threads; a parallel fasta_readAllSequences().
+ * @param[in] fileName Name of a plain or BGZF compressed file (not stdin)
+ * @param[in] nThreads Number of threads; see threadPool_cpuCount()
+ * @param[in] truncateName See fasta_nextSequence()
+ * @return Array of Seq in file order, NULL if the file could not be opened (see warnReport())
+ * @note The memory belongs to the caller.
+ */
+Array fasta_readAllParallel (char *fileName, int nThreads, int truncateName)
+{
+  FastaRangeJob *jobs;
+  FastaIndex faiHint;
+  ThreadPool pool;
+  Array ranges;
+  Array seqs;
+  long long recordCnt = 0;
+  int i;
+
+  /* all sequences are kept anyway, so all ranges are submitted at once */
+  if (!(ranges = ls_splitFile (fileName,4 * nThreads,fasta_recordStart)))
+    return NULL;
+  faiHint = fasta_faiHintOpen (fileName);
+  jobs = (FastaRangeJob *) hlr_calloc (arrayMax (ranges),sizeof (FastaRangeJob));
+  pool = threadPool_create (nThreads);
+  for (i = 0; i < arrayMax (ranges); i++) {
+    jobs[i].fileName = fileName;
+    jobs[i].truncateName = truncateName;
+    jobs[i].faiHint = faiHint;
+    fasta_rangeJobSubmit (pool,&jobs[i],ranges,i);
+  }
+  threadPool_waitAll (pool);
+  threadPool_destroy (pool);
+  fasta_indexClose (faiHint);
+  for (i = 0; i < arrayMax (ranges); i++)
+    recordCnt += jobs[i].recordCnt;
+  seqs = arrayCreate (recordCnt + 1,Seq);
+  for (i = 0; i < arrayMax (ranges); i++) {
+    if (jobs[i].recordCnt > 0) {
+      arrayp (seqs,arrayMax (seqs) + jobs[i].recordCnt - 1,Seq);
+      memcpy (arrp (seqs,arrayMax (seqs) - jobs[i].recordCnt,Seq),arrp (jobs[i].seqs,0,Seq),
+              jobs[i].recordCnt * sizeof (Seq));
+    }
+    arrayDestroy (jobs[i].seqs);
+  }
+  hlr_free (jobs);
+  arrayDestroy (ranges);
+  return seqs;
+}
+
+
+
+static void fasta_indexEntryWrite (FILE *fp, FastaIndexEntry *entry)
+{
+  fprintf (fp,"%s\t%lld\t%lld\t%d\t%d\n",entry->name,entry->length,
+           entry->offset,entry->lineBases,entry->lineWidth);
+}
+
+
+
+/**
+ * Read one line including its terminator; unlike a LineStream this keeps
+ * carriage returns, which the index needs to compute byte offsets.
+ * @return Number of bytes in the line, 0 at end of file
+ */
+static int fasta_rawLine (FILE *fp, Stringa line)
+{
+  char chunk[4096];
+
+  stringClear (line);
+  while (fgets (chunk,sizeof (chunk),fp)) {
+    stringCat (line,chunk);
+    if (string (line)[stringLen (line) - 1] == '\n')
+      break;
+  }
+  return stringLen (line);
+}
+
+
+
+/**
+ * Create a samtools-compatible index for a FASTA file.
+ * The index is a tab-delimited file with one line per sequence: name (first word of the header),
+   number of bases, file offset of the first base, bases per line and bytes per line.
+ * @param[in] fileName Name of an uncompressed FASTA file (not stdin); the index is written to fileName.fai
+ * @return Number of sequences in the file
+ * @note All sequence lines of a record must have the same length, except the last one.
+   Lines may end in \\n or \\r\\n.
+ */
+int fasta_indexBuild (char *fileName)
+{
+  FILE *in;
+  FILE *fp;
+  Stringa faiName = stringCreate (100);
+  Stringa name = stringCreate (100);
+  Stringa line = stringCreate (1000);
+  FastaIndexEntry entry;
+  long long pos = 0;
+  int shortLine = 0;
+  int seqCnt = 0;
+  int lineCnt = 0;
+  int len;
+  int bases;
+  char *s;
+  int i;
+
+  if (!(in = fopen (fileName,"r")))
+    die ("fasta_indexBuild: '%s': %s",fileName,strerror (errno));
+  stringPrintf (faiName,"%s.fai",fileName);
+  if (!(fp = fopen (string (faiName),"w")))
+    die ("fasta_indexBuild: '%s': %s",string (faiName),strerror (errno));
+  memset (&entry,0,sizeof (entry));
+  while ((len = fasta_rawLine (in,line)) > 0) {
+    s = string (line);
+    lineCnt++;
+    if (s[0] == '>') {
+      if (seqCnt > 0)
+        fasta_indexEntryWrite (fp,&entry);
+      for (i = 1; i < len && !isspace (s[i]); i++)
+        ;
+      stringNCpy (name,s + 1,i - 1);
+      entry.name = string (name);
+      entry.length = 0;
+      entry.offset = pos + len;
+      entry.lineBases = 0;
+      entry.lineWidth = 0;
+      shortLine = 0;
+      seqCnt++;
+    }
+    else {
+      bases = len;
+      if (bases > 0 && s[bases - 1] == '\n')
+        bases--;
+      if (bases > 0 && s[bases - 1] == '\r')
+        bases--;
+      if (bases > 0) {
+        if (seqCnt == 0)
+          die ("fasta_indexBuild: '%s', line %d: sequence without header",fileName,lineCnt);
+        if (entry.lineBases == 0) {
+          entry.lineBases = bases;
+          entry.lineWidth = len;
+        }
+        else if (shortLine || bases > entry.lineBases ||
+                 (bases == entry.lineBases && len != entry.lineWidth && s[len - 1] == '\n'))
+          die ("fasta_indexBuild: '%s', line %d: lines of sequence '%s' differ in length",
+               fileName,lineCnt,entry.name);
+        entry.length += bases;
+      }
+      if (bases < entry.lineBases || bases == 0)
+        shortLine = 1;
+    }
+    pos += len;
+  }
+  if (seqCnt > 0)
+    fasta_indexEntryWrite (fp,&entry);
+  fclose (fp);
+  fclose (in);
+  stringDestroy (line);
+  stringDestroy (name);
+  stringDestroy (faiName);
+  return seqCnt;
+}
+
+
+
+static int fasta_indexEntryCmp (FastaIndexEntry **a, FastaIndexEntry **b)
+{
+  return strcmp ((*a)->name,(*b)->name);
+}
+
+
+
+/**
+ * Open an indexed FASTA file for random access.
+ * @param[in] fileName Name of an uncompressed FASTA file
+ * @return A FASTA index, or NULL if the file or its index fileName.fai could not be opened
+   (see warnReport()); the index is not created here, call fasta_indexBuild() first if needed
+ * @note Unlike the other functions of this module, a FASTA index does not use module
+   global state; several indices can be open at the same time and fasta_fetchRegion()
+   may be called from several threads on the same index.
+ */
+FastaIndex fasta_indexOpen (char *fileName)
+{
+  FastaIndex this1;
+  FastaIndexEntry *entry;
+  LineStream ls;
+  Stringa faiName = stringCreate (100);
+  char *line;
+  char *tab;
+  int fd;
+  int i;
+
+  if ((fd = open (fileName,O_RDONLY)) < 0) {
+    warnAdd ("fasta_indexOpen",
+             stringPrintBuf ("'%s': %s",fileName,strerror (errno)));
+    stringDestroy (faiName);
+    return NULL;
+  }
+  stringPrintf (faiName,"%s.fai",fileName);
+  if (access (string (faiName),F_OK) != 0) {
+    warnAdd ("fasta_indexOpen",
+             stringPrintBuf ("'%s' does not exist, see fasta_indexBuild()",string (faiName)));
+    close (fd);
+    stringDestroy (faiName);
+    return NULL;
+  }
+  if (!(ls = ls_createFromFile (string (faiName)))) {
+    close (fd);
+    stringDestroy (faiName);
+    return NULL;
+  }
+  this1 = (FastaIndex) hlr_malloc (sizeof (struct _fastaIndexStruct_));
+  this1->fd = fd;
+  this1->entries = arrayCreate (100,FastaIndexEntry);
+  while ((line = ls_nextLine (ls)) != NULL) {
+    if (line[0] == '\0')
+      continue;
+    entry = arrayp (this1->entries,arrayMax (this1->entries),FastaIndexEntry);
+    if (!(tab = strchr (line,'\t')) ||
+        sscanf (tab + 1,"%lld\t%lld\t%d\t%d",&entry->length,&entry->offset,
+                &entry->lineBases,&entry->lineWidth) != 4)
+      die ("fasta_indexOpen: '%s', line %d: not a FASTA index line",
+           string (faiName),ls_lineCountGet (ls));
+    *tab = '\0';
+    entry->name = hlr_strdup (line);
+  }
+  ls_destroy (ls);
+  this1->sorted = arrayCreate (arrayMax (this1->entries),FastaIndexEntry *);
+  for (i = 0; i < arrayMax (this1->entries); i++)
+    array (this1->sorted,i,FastaIndexEntry *) = arrp (this1->entries,i,FastaIndexEntry);
+  arraySort (this1->sorted,(ARRAYORDERF)fasta_indexEntryCmp);
+  stringDestroy (faiName);
+  return this1;
+}
+
+
+
+/**
+ * Get the number of sequences in a FASTA index.
+ */
+int fasta_indexSeqCountGet (FastaIndex this1)
+{
+  return arrayMax (this1->entries);
+}
+
+
+
+/**
+ * Get the i-th sequence of a FASTA index, in file order.
+ * @param[in] this1 A FASTA index
+ * @param[in] i 0 <= i < fasta_indexSeqCountGet()
+ * @return The index entry; belongs to the FASTA index, do not modify
+ */
+FastaIndexEntry *fasta_indexEntryGet (FastaIndex this1, int i)
+{
+  return arrp (this1->entries,i,FastaIndexEntry);
+}
+
+
+
+/**
+ * Look up a sequence by name.
+ * @param[in] this1 A FASTA index
+ * @param[in] name Sequence name (first word of the header line)
+ * @return The index entry, or NULL if there is no such sequence; belongs to the FASTA index
+ */
+FastaIndexEntry *fasta_indexFind (FastaIndex this1, char *name)
+{
+  FastaIndexEntry key;
+  FastaIndexEntry *keyp = &key;
+  int i;
+
+  key.name = name;
+  if (!arrayFind (this1->sorted,&keyp,&i,(ARRAYORDERF)fasta_indexEntryCmp))
+    return NULL;
+  return arru (this1->sorted,i,FastaIndexEntry *);
+}
+
+
+
+/**
+ * File offset of base 'pos' of a sequence.
+ */
+static long long fasta_baseOffset (FastaIndexEntry *entry, long long pos)
+{
+  return entry->offset + (pos / entry->lineBases) * entry->lineWidth + pos % entry->lineBases;
+}
+
+
+
+/**
+ * Fetch a region of a sequence from an indexed FASTA file.
+ * Only the bytes covering the region are read from disk; line breaks are skipped
+   using the line geometry from the index.
+ * @param[in] this1 A FASTA index
+ * @param[in] name Sequence name
+ * @param[in] start First base of the region, 0-based
+ * @param[in] end One past the last base of the region; the region is clipped to the sequence
+ * @param[in] reverseComplement If 1, return the reverse complement of the region
+ * @return Null-terminated bases as they appear in the file (case is preserved), 
+   or NULL if there is no sequence 'name'. The caller owns the memory (free with hlr_free()).
+ */
+char *fasta_fetchRegion (FastaIndex this1, char *name, long long start, long long end, int reverseComplement)
+{
+  FastaIndexEntry *entry;
+  long long first;
+  long long span;
+  long long done = 0;
+  long long remaining;
+  ssize_t n;
+  char *buf;
+  char *src;
+  char *dst;
+  int k;
+  int col;
+
+  if (!(entry = fasta_indexFind (this1,name)))
+    return NULL;
+  if (start < 0)
+    start = 0;
+  if (end > entry->length)
+    end = entry->length;
+  if (start >= end) {
+    buf = hlr_malloc (1);
+    buf[0] = '\0';
+    return buf;
+  }
+  first = fasta_baseOffset (entry,start);
+  span = fasta_baseOffset (entry,end - 1) + 1 - first;
+  buf = hlr_malloc (span + 1);
+  while (done < span) {
+    n = pread (this1->fd,buf + done,span - done,first + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      die ("fasta_fetchRegion: cannot read sequence '%s': %s",name,
+           n < 0 ? strerror (errno) : "file shorter than index");
+    done += n;
+  }
+  /* compact in place: full lines are lineBases bases followed by a fixed-size terminator */
+  src = buf;
+  dst = buf;
+  remaining = end - start;
+  col = start % entry->lineBases;
+  while (remaining > 0) {
+    k = MIN (entry->lineBases - col,remaining);
+    if (dst != src)
+      memmove (dst,src,k);
+    dst += k;
+    src += k + entry->lineWidth - entry->lineBases;
+    remaining -= k;
+    col = 0;
+  }
+  *dst = '\0';
+  if (reverseComplement)
+    seq_reverseComplement (buf,end - start);
+  return buf;
+}
+
+
+
+/**
+ * Close a FASTA index.
+ * @param[in] this1 A FASTA index
+ * @note Do not call this function, but use the macro fasta_indexClose
+ */
+void fasta_indexClose_func (FastaIndex this1)
+{
+  int i;
+
+  if (!this1)
+    return;
+  for (i = 0; i < arrayMax (this1->entries); i++)
+    hlr_free (arrp (this1->entries,i,FastaIndexEntry)->name);
+  arrayDestroy (this1->entries);
+  arrayDestroy (this1->sorted);
+  close (this1->fd);
+  hlr_free (this1);
+}
+
+
+
+static void fasta_writerOut (FastaWriter this1, char *data, int n)
+{
+  if (this1->bgzf)
+    bgzf_write (this1->bgzf,data,n);
+  else if (fwrite (data,1,n,this1->fp) != (size_t)n)
+    die ("fasta_writer: write failed: %s",strerror (errno));
+}
+
+
+
+static void fasta_writerFlush (FastaWriter this1)
+{
+  if (this1->bufLen > 0)
+    fasta_writerOut (this1,this1->buf,this1->bufLen);
+  this1->bufLen = 0;
+}
+
+
+
+static void fasta_writerPut (FastaWriter this1, char *data, int n)
+{
+  if (this1->bufLen + n > FASTA_WRITER_BUFFER_SIZE) {
+    fasta_writerFlush (this1);
+    if (n >= FASTA_WRITER_BUFFER_SIZE) {
+      fasta_writerOut (this1,data,n);
+      this1->offset += n;
+      return;
+    }
+  }
+  memcpy (this1->buf + this1->bufLen,data,n);
+  this1->bufLen += n;
+  this1->offset += n;
+}
+
+
+
+static FastaWriter fasta_writerAlloc (int lineWidth)
+{
+  FastaWriter this1;
+
+  this1 = (FastaWriter) hlr_malloc (sizeof (struct _fastaWriterStruct_));
+  this1->fp = NULL;
+  this1->bgzf = NULL;
+  this1->buf = hlr_malloc (FASTA_WRITER_BUFFER_SIZE);
+  this1->bufLen = 0;
+  this1->lineWidth = lineWidth;
+  this1->offset = 0;
+  this1->faiFp = NULL;
+  this1->name = stringCreate (100);
+  this1->inSeq = 0;
+  return this1;
+}
+
+
+
+/**
+ * Create a FASTA writer.
+ * Bases are wrapped into lines while they are copied into a large output buffer,
+   so no wrapped copy of a sequence is ever built.
+ * @param[in] fileName Name of the output file; use "-" to denote stdout
+ * @param[in] lineWidth Number of bases per line; 0 writes each sequence on one line
+ * @param[in] writeIndex If 1, fileName.fai is written along with the sequences (not for stdout)
+ * @return A FASTA writer, or NULL if the file could not be created (see warnReport())
+ */
+FastaWriter fasta_writerCreate (char *fileName, int lineWidth, int writeIndex)
+{
+  FastaWriter this1;
+  Stringa faiName;
+  FILE *fp;
+
+  if (lineWidth < 0)
+    die ("fasta_writerCreate: invalid line width %d",lineWidth);
+  if (writeIndex && strcmp (fileName,"-") == 0)
+    die ("fasta_writerCreate: cannot write an index for stdout");
+  fp = strcmp (fileName,"-") == 0 ? stdout : fopen (fileName,"w");
+  if (!fp) {
+    warnAdd ("fasta_writerCreate",
+             stringPrintBuf ("'%s': %s",fileName,strerror (errno)));
+    return NULL;
+  }
+  this1 = fasta_writerAlloc (lineWidth);
+  this1->fp = fp;
+  if (writeIndex) {
+    faiName = stringCreate (100);
+    stringPrintf (faiName,"%s.fai",fileName);
+    if (!(this1->faiFp = fopen (string (faiName),"w")))
+      die ("fasta_writerCreate: '%s': %s",string (faiName),strerror (errno));
+    stringDestroy (faiName);
+  }
+  return this1;
+}
+
+
+
+/**
+ * Create a FASTA writer whose output is BGZF compressed, see bgzf_writerCreate().
+ * @param[in] fileName Name of the output file; use "-" to denote stdout
+ * @param[in] lineWidth Number of bases per line; 0 writes each sequence on one line
+ * @param[in] nThreads Number of threads compressing the output, 0 compresses in the calling thread
+ * @return A FASTA writer, or NULL if the file could not be created (see warnReport())
+ * @note No .fai is written: its offsets would not address the compressed file.
+ */
+FastaWriter fasta_writerCreateBgzf (char *fileName, int lineWidth, int nThreads)
+{
+  FastaWriter this1;
+  BgzfWriter bgzf;
+
+  if (lineWidth < 0)
+    die ("fasta_writerCreateBgzf: invalid line width %d",lineWidth);
+  if (!(bgzf = bgzf_writerCreate (fileName,nThreads,-1)))
+    return NULL;
+  this1 = fasta_writerAlloc (lineWidth);
+  this1->bgzf = bgzf;
+  return this1;
+}
+
+
+
+/**
+ * Start a sequence; its bases are then passed to fasta_writerAppend().
+ * @param[in] this1 A FASTA writer
+ * @param[in] name Header line without '>'; for the index, the name is its first word
+ */
+void fasta_writerBegin (FastaWriter this1, char *name)
+{
+  char *end;
+
+  if (this1->inSeq)
+    fasta_writerEnd (this1);
+  fasta_writerPut (this1,">",1);
+  fasta_writerPut (this1,name,strlen (name));
+  fasta_writerPut (this1,"\n",1);
+  for (end = name; *end != '\0' && !isspace (*end); end++)
+    ;
+  stringNCpy (this1->name,name,end - name);
+  this1->seqOffset = this1->offset;
+  this1->seqLength = 0;
+  this1->col = 0;
+  this1->inSeq = 1;
+}
+
+
+
+/**
+ * Append bases to the current sequence.
+ * @param[in] this1 A FASTA writer
+ * @param[in] bases The bases, need not be null-terminated
+ * @param[in] n Number of bases
+ * @pre fasta_writerBegin() was called
+ */
+void fasta_writerAppend (FastaWriter this1, char *bases, long long n)
+{
+  int k;
+
+  if (!this1->inSeq)
+    die ("fasta_writerAppend: no sequence started");
+  if (this1->lineWidth == 0) {
+    while (n > 0) {
+      k = MIN (n,FASTA_WRITER_BUFFER_SIZE);
+      fasta_writerPut (this1,bases,k);
+      bases += k;
+      n -= k;
+      this1->seqLength += k;
+    }
+    this1->col = this1->seqLength > 0;
+    return;
+  }
+  while (n > 0) {
+    k = MIN (n,this1->lineWidth - this1->col);
+    fasta_writerPut (this1,bases,k);
+    bases += k;
+    n -= k;
+    this1->seqLength += k;
+    this1->col += k;
+    if (this1->col == this1->lineWidth) {
+      fasta_writerPut (this1,"\n",1);
+      this1->col = 0;
+    }
+  }
+}
+
+
+
+/**
+ * Finish the current sequence (terminate its last line and write its index line).
+ */
+void fasta_writerEnd (FastaWriter this1)
+{
+  int lineBases;
+
+  if (!this1->inSeq)
+    return;
+  if (this1->col > 0)
+    fasta_writerPut (this1,"\n",1);
+  if (this1->faiFp) {
+    if (this1->lineWidth == 0 || this1->seqLength < this1->lineWidth)
+      lineBases = this1->seqLength; /* a single line, as fasta_indexBuild() sees it */
+    else
+      lineBases = this1->lineWidth;
+    fprintf (this1->faiFp,"%s\t%lld\t%lld\t%d\t%d\n",string (this1->name),this1->seqLength,
+             this1->seqOffset,lineBases,lineBases ? lineBases + 1 : 0);
+  }
+  this1->inSeq = 0;
+}
+
+
+
+/**
+ * Write one sequence.
+ * @param[in] this1 A FASTA writer
+ * @param[in] name Header line without '>'
+ * @param[in] bases The bases
+ * @param[in] size Number of bases
+ */
+void fasta_writerWrite (FastaWriter this1, char *name, char *bases, long long size)
+{
+  fasta_writerBegin (this1,name);
+  fasta_writerAppend (this1,bases,size);
+  fasta_writerEnd (this1);
+}
+
+
+
+/**
+ * Write one sequence.
+ */
+void fasta_writerWriteSeq (FastaWriter this1, Seq *seq)
+{
+  fasta_writerWrite (this1,seq->name,seq->sequence,seq->size);
+}
+
+
+
+/**
+ * Close a FASTA writer: finish the current sequence and flush all output.
+ * @param[in] this1 A FASTA writer
+ * @note Do not call this function, but use the macro fasta_writerClose
+ */
+void fasta_writerClose_func (FastaWriter this1)
+{
+  if (!this1)
+    return;
+  fasta_writerEnd (this1);
+  fasta_writerFlush (this1);
+  if (this1->bgzf)
+    bgzf_writerDestroy (this1->bgzf);
+  else if (this1->fp == stdout)
+    fflush (stdout);
+  else if (fclose (this1->fp) != 0)
+    die ("fasta_writerClose: %s",strerror (errno));
+  if (this1->faiFp && fclose (this1->faiFp) != 0)
+    die ("fasta_writerClose: %s",strerror (errno));
+  stringDestroy (this1->name);
+  hlr_free (this1->buf);
+  hlr_free (this1);
+}
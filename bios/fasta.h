@@ -9,6 +9,90 @@
 
 
 #include "seq.h"
+#include "linestream.h"
+#include "bgzf.h"
+
+
+
+/**
+ * Bytes of the file per range in fasta_parallel().
+ */
+#define FASTA_PARALLEL_RANGE_SIZE (8 << 20)
+
+
+
+/**
+ * FastaIndexEntry.
+ * One line of a samtools-compatible .fai file.
+ */
+typedef struct {
+  char *name;             /* first word of the header line */
+  long long length;       /* number of bases */
+  long long offset;       /* file offset of the first base */
+  int lineBases;          /* bases per full line */
+  int lineWidth;          /* bytes per full line, line terminator included */
+} FastaIndexEntry;
+
+
+
+/**
+ * FastaIndex.
+ */
+typedef struct _fastaIndexStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fasta module -- DO NOT access from outside
+     the fasta module */
+  int fd;                 /* FASTA file, read via pread() */
+  Array entries;          /* of FastaIndexEntry, in file order */
+  Array sorted;           /* of FastaIndexEntry *, sorted by name */
+} *FastaIndex;
+
+
+
+/**
+ * FastaReader.
+ */
+typedef struct _fastaReaderStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fasta module -- DO NOT access from outside
+     the fasta module */
+  LineStream ls;
+  Stringa header;         /* header line read ahead, without '>' */
+  int haveHeader;
+  Seq *currSeq;           /* returned last by fasta_readerNext() */
+  FastaIndex faiHint;     /* sequence sizes, if the file has a .fai */
+} *FastaReader;
+
+
+
+/**
+ * Size of the output buffer of a FastaWriter.
+ */
+#define FASTA_WRITER_BUFFER_SIZE (1 << 20)
+
+
+
+/**
+ * FastaWriter.
+ */
+typedef struct _fastaWriterStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fasta module -- DO NOT access from outside
+     the fasta module */
+  FILE *fp;               /* NULL if bgzf is used */
+  BgzfWriter bgzf;        /* NULL: plain output */
+  char *buf;              /* FASTA_WRITER_BUFFER_SIZE bytes */
+  int bufLen;
+  int lineWidth;          /* 0: no wrapping */
+  long long offset;       /* bytes written so far */
+  FILE *faiFp;            /* NULL: no index */
+  Stringa name;           /* name of the current sequence, for the index */
+  long long seqOffset;    /* file offset of its first base */
+  long long seqLength;
+  int col;                /* bases in the current line */
+  int inSeq;
+} *FastaWriter;
+
 
 
 extern void fasta_initFromFile (char *fileName);
@@ -18,6 +102,52 @@ extern Seq* fasta_nextSequence (int truncateName);
 extern Array fasta_readAllSequences (int truncateName);
 extern void fasta_printOneSequence (Seq *currSeq);
 extern void fasta_printSequences (Array seqs);
+extern int fasta_recordStart (char *text, int len, int atEof);
+extern long long fasta_parallel (char *fileName, int nThreads, int truncateName, int ordered,
+                                 void (*record_hook)(Seq *seq, int rangeIndex, void *arg), void *arg);
+extern Array fasta_readAllParallel (char *fileName, int nThreads, int truncateName);
+
+extern FastaReader fasta_readerCreate (LineStream ls);
+extern FastaReader fasta_readerOpen (char *fileName);
+extern FastaReader fasta_readerOpenPipe (char *command);
+extern Seq* fasta_readerNext (FastaReader this1, int truncateName);
+extern Array fasta_readerReadAll (FastaReader this1, int truncateName);
+extern void fasta_readerClose_func (FastaReader this1); /* do not use this function */
+
+/**
+ * Close a FASTA reader.
+ * @see fasta_readerClose_func()
+ */
+#define fasta_readerClose(this1) (fasta_readerClose_func(this1),this1=NULL) /* use this one */
+
+extern FastaWriter fasta_writerCreate (char *fileName, int lineWidth, int writeIndex);
+extern FastaWriter fasta_writerCreateBgzf (char *fileName, int lineWidth, int nThreads);
+extern void fasta_writerBegin (FastaWriter this1, char *name);
+extern void fasta_writerAppend (FastaWriter this1, char *bases, long long n);
+extern void fasta_writerEnd (FastaWriter this1);
+extern void fasta_writerWrite (FastaWriter this1, char *name, char *bases, long long size);
+extern void fasta_writerWriteSeq (FastaWriter this1, Seq *seq);
+extern void fasta_writerClose_func (FastaWriter this1); /* do not use this function */
+
+/**
+ * Close a FASTA writer.
+ * @see fasta_writerClose_func()
+ */
+#define fasta_writerClose(this1) (fasta_writerClose_func(this1),this1=NULL) /* use this one */
+
+extern int fasta_indexBuild (char *fileName);
+extern FastaIndex fasta_indexOpen (char *fileName);
+extern int fasta_indexSeqCountGet (FastaIndex this1);
+extern FastaIndexEntry *fasta_indexEntryGet (FastaIndex this1, int i);
+extern FastaIndexEntry *fasta_indexFind (FastaIndex this1, char *name);
+extern char *fasta_fetchRegion (FastaIndex this1, char *name, long long start, long long end, int reverseComplement);
+extern void fasta_indexClose_func (FastaIndex this1); /* do not use this function */
+
+/**
+ * Close a FASTA index.
+ * @see fasta_indexClose_func()
+ */
+#define fasta_indexClose(this1) (fasta_indexClose_func(this1),this1=NULL) /* use this one */
 
 
 #endif
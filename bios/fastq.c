@@ -4,11 +4,14 @@
  */
 
 
+#include <limits.h>
+
 #include "log.h"
 #include "format.h"
 #include "linestream.h"
 #include "stringUtil.h"
 #include "common.h"
+#include "threadPool.h"
 #include "fastq.h"
 
 
@@ -16,7 +19,93 @@
 #define NUM_CHARACTRS_PER_LINE 60
 
 
-static LineStream lsFastq = NULL;
+static FastqReader fastqReader = NULL; /* used by fastq_initFromFile() etc. */
+
+
+
+static void fastq_freeFastq (Fastq **pFQ)
+{
+  Fastq *currFQ = *pFQ;
+
+  if (currFQ == NULL) {
+    return;
+  }
+  hlr_free (currFQ->seq->name);
+  hlr_free (currFQ->seq->sequence);
+  freeMem (currFQ->seq);
+  hlr_free (currFQ->quality);
+  freeMem (currFQ);
+  *pFQ = NULL;
+}
+
+
+
+/**
+ * Create a FASTQ reader on a line stream.
+ * @param[in] ls A line stream; the reader takes ownership and destroys it in fastq_readerClose()
+ * @return A FASTQ reader
+ * @note Readers share no state, so several of them can be used at the same time,
+   each one by one thread.
+ */
+FastqReader fastq_readerCreate (LineStream ls)
+{
+  FastqReader this1;
+
+  if (ls == NULL)
+    die ("fastq_readerCreate: no line stream given");
+  this1 = (FastqReader) hlr_malloc (sizeof (struct _fastqReaderStruct_));
+  this1->ls = ls;
+  this1->currFQ = NULL;
+  ls_statsLabelSet (ls,"fastq");
+  return this1;
+}
+
+
+
+/**
+ * Open a FASTQ file for reading.
+ * @param[in] fileName Name of the file; use "-" to denote stdin
+ * @return A FASTQ reader, or NULL if the file could not be opened (see warnReport())
+ */
+FastqReader fastq_readerOpen (char *fileName)
+{
+  LineStream ls;
+
+  if (!(ls = ls_createFromFile (fileName)))
+    return NULL;
+  return fastq_readerCreate (ls);
+}
+
+
+
+/**
+ * Open a FASTQ reader on the output of a command.
+ * @return A FASTQ reader, or NULL if the command could not be started (see warnReport())
+ */
+FastqReader fastq_readerOpenPipe (char *command)
+{
+  LineStream ls;
+
+  if (!(ls = ls_createFromPipe (command)))
+    return NULL;
+  return fastq_readerCreate (ls);
+}
+
+
+
+/**
+ * Close a FASTQ reader; frees the record returned last by fastq_readerNext().
+ * @param[in] this1 A FASTQ reader
+ * @note Do not call this function, but use the macro fastq_readerClose
+ */
+void fastq_readerClose_func (FastqReader this1)
+{
+  if (!this1)
+    return;
+  ls_destroy (this1->ls);
+  fastq_freeFastq (&this1->currFQ);
+  hlr_free (this1);
+}
 
 
 
@@ -24,11 +113,12 @@ static LineStream lsFastq = NULL;
  * Initialize the FASTQ module using a file name.
  * @note Use "-" to denote stdin.
  * @post fastq_nextSequence(), fastq_readAllSequences() can be called.
+ * @see fastq_readerOpen() to read several files at the same time
  */
 void fastq_initFromFile (char* fileName) 
 {
-  lsFastq = ls_createFromFile (fileName);
-  ls_bufferSet (lsFastq,1);
+  if (!(fastqReader = fastq_readerOpen (fileName)))
+    die ("fastq_initFromFile: %s",warnReport ());
 }
 
 
@@ -38,7 +128,7 @@ void fastq_initFromFile (char* fileName)
  */
 void fastq_deInit (void) 
 {
-  ls_destroy (lsFastq);
+  fastq_readerClose (fastqReader);
 }
 
 
@@ -49,77 +139,137 @@ void fastq_deInit (void)
  */
 void fastq_initFromPipe (char* command)
 {
-  lsFastq = ls_createFromPipe (command);
-  ls_bufferSet (lsFastq,1);
+  if (!(fastqReader = fastq_readerOpenPipe (command)))
+    die ("fastq_initFromPipe: %s",warnReport ());
 }
 
 
 
-static void fastq_freeFastq (Fastq* currFQ)
+/**
+ * Copy the name from a header line.
+ */
+static char* fastq_headerName (char *line, int truncateName)
 {
-  if (currFQ == NULL) {
-    return;
+  char *end;
+  char *name;
+
+  if (!truncateName) {
+    return hlr_strdup (line);
   }
-  Seq* currSeq = currFQ->seq;
-  hlr_free (currSeq->name);
-  hlr_free (currSeq->sequence);
-  freeMem (currSeq);
-  currSeq = NULL;
-  hlr_free (currFQ->quality);
-  freeMem ( currFQ );
+  line = skipLeadingSpaces (line);
+  for (end = line; *end != '\0' && !isspace (*end); end++)
+    ;
+  name = hlr_malloc (end - line + 1);
+  memcpy (name,line,end - line);
+  name[end - line] = '\0';
+  return name;
 }
 
 
 
-static Fastq* fastq_processNextSequence (int freeMemory, int truncateName)
+static char* fastq_copyLine (LineView *view)
 {
-  char *line;
-  static Fastq* currFQ = NULL;
-  int count;
-  Seq* currSeq = NULL;
+  char *s = hlr_malloc (view->len + 1);
 
-  if (ls_isEof (lsFastq)) {
-    if (freeMemory) {
-      fastq_freeFastq (currFQ);
-    }
+  memcpy (s,view->line,view->len);
+  s[view->len] = '\0';
+  return s;
+}
+
+
+
+/**
+ * Read the header line of the next record, skipping empty lines.
+ * @return 1 if there is a record, 0 at the end of the input
+ */
+static int fastq_headerView (FastqReader this1, LineView *view)
+{
+  int ok;
+
+  while ((ok = ls_nextLineView (this1->ls,view)) && view->len == 0)
+    ;
+  if (!ok) {
+    return 0;
+  }
+  if (view->line[0] != '@') {
+    die ("fastq: line %d: expected '@'",ls_lineCountGet (this1->ls));
+  }
+  return 1;
+}
+
+
+
+static Fastq* fastq_processNextSequence (FastqReader this1, int freeMemory, int truncateName)
+{
+  LineView view;
+  Fastq *currFQ;
+  Seq *currSeq;
+
+  if (freeMemory) {
+    fastq_freeFastq (&this1->currFQ);
+  }
+  if (!fastq_headerView (this1,&view)) {
     return NULL;
   }
-  count = 0;
-  while ( (line=ls_nextLine (lsFastq)) && (count<4) ) {
-    if (line[0] == '\0') {
-      continue;
-    }
-    if (line[0] == '@') {      
-      if (freeMemory) {
-	fastq_freeFastq (currFQ);
-      }
-      count++;
-      AllocVar (currFQ);
-      AllocVar (currFQ->seq);
-      currSeq = currFQ->seq;
-      currSeq->name = hlr_strdup (line + 1);
-      if (truncateName) {
-	currSeq->name = firstWordInLine (skipLeadingSpaces (currSeq->name));
-      }
-      line = ls_nextLine (lsFastq); // reading sequence
-      currSeq->sequence = hlr_strdup ( line );
-      currSeq->size = strlen (currSeq->sequence);
-      count++;
-      line = ls_nextLine (lsFastq); // reading quality ID
-      if( line[0] != '+' )
-	die("Expected quality ID: '+' or '+%s'", currSeq->name );
-      count++;
-      line = ls_nextLine (lsFastq); // reading quality
-      currFQ->quality = hlr_strdup( line );
-      count++;
-    } 
-  }   
-  ls_back (lsFastq,1);
+  AllocVar (currFQ);
+  AllocVar (currFQ->seq);
+  currSeq = currFQ->seq;
+  currSeq->name = fastq_headerName (view.line + 1,truncateName);
+  if (!ls_nextLineView (this1->ls,&view)) { // reading sequence
+    die ("fastq: record '%s' is truncated",currSeq->name);
+  }
+  currSeq->sequence = fastq_copyLine (&view);
+  currSeq->size = view.len;
+  if (!ls_nextLineView (this1->ls,&view) || view.len == 0 || view.line[0] != '+') { // reading quality ID
+    die ("Expected quality ID: '+' or '+%s'",currSeq->name);
+  }
+  if (!ls_nextLineView (this1->ls,&view)) { // reading quality
+    die ("fastq: record '%s' is truncated",currSeq->name);
+  }
+  currFQ->quality = fastq_copyLine (&view);
+  if (freeMemory) {
+    this1->currFQ = currFQ;
+  }
   return currFQ;
 }
 
 
 
+/**
+ * Returns a pointer to the next record of a FASTQ reader.
+ * @param[in] this1 A FASTQ reader
+ * @param[in] truncateName See fastq_nextSequence()
+ * @return The record, or NULL at the end of the input
+ * @note The memory belongs to the reader and is valid until the next call.
+ */
+Fastq* fastq_readerNext (FastqReader this1, int truncateName)
+{
+  return fastq_processNextSequence (this1,1,truncateName);
+}
+
+
+
+/**
+ * Returns an Array of all remaining records of a FASTQ reader.
+ * @param[in] this1 A FASTQ reader
+ * @param[in] truncateName See fastq_nextSequence()
+ * @note The memory belongs to the caller.
+ */
+Array fastq_readerReadAll (FastqReader this1, int truncateName)
+{
+  Array seqs;
+  Fastq *currFQ;
+
+  seqs = arrayCreate (100000,Fastq);
+  while (currFQ = fastq_processNextSequence (this1,0,truncateName)) {
+    array (seqs,arrayMax (seqs),Fastq) = *currFQ;
+    freeMem (currFQ);
+  }
+  return seqs;
+}
+
+
+
 /**
  * Returns a pointer to the next FASTQ sequence.
  * @param[in] truncateName If truncateName > 0, leading spaces of the name are skipped. Furthermore, the name is truncated after the first white space. If truncateName == 0, the name is stored as is.
@@ -127,7 +277,7 @@ static Fastq* fastq_processNextSequence (int freeMemory, int truncateName)
  */
 Fastq* fastq_nextSequence (int truncateName) 
 {
-  return fastq_processNextSequence (1,truncateName);
+  return fastq_readerNext (fastqReader,truncateName);
 }
 
 
@@ -139,17 +289,542 @@ Fastq* fastq_nextSequence (int truncateName)
  */
 Array fastq_readAllSequences (int truncateName)
 {
+  return fastq_readerReadAll (fastqReader,truncateName);
+}
+
+
+
+/**
+ * Returns an Array of all remaining records of a FASTQ reader, with the qualities kept in a QualStore.
+ * This takes much less memory than fastq_readerReadAll() for large files.
+ * @param[in] this1 A FASTQ reader
+ * @param[in] truncateName See fastq_nextSequence()
+ * @param[in] quals Receives the qualities; the quality of element i of the result
+   is record qualStore_countGet() + i of quals at the time of the call
+ * @return Array of Fastq whose quality is NULL; use qualStore_get()
+ * @note The memory belongs to the caller.
+ */
+Array fastq_readerReadAllCompact (FastqReader this1, int truncateName, QualStore quals)
+{
+  FastqRecord rec;
   Array seqs;
   Fastq *currFQ;
+
   seqs = arrayCreate (100000,Fastq);
-  while (currFQ = fastq_processNextSequence (0,truncateName)) {
-    array (seqs,arrayMax (seqs),Fastq) = *currFQ;
+  fastq_recordInit (&rec);
+  while (fastq_readerNextRecord (this1,&rec,truncateName)) {
+    currFQ = arrayp (seqs,arrayMax (seqs),Fastq);
+    AllocVar (currFQ->seq);
+    currFQ->seq->name = hlr_strdup (rec.name);
+    currFQ->seq->sequence = hlr_strdup (rec.sequence);
+    currFQ->seq->size = rec.seqLen;
+    currFQ->quality = NULL;
+    qualStore_add (quals,rec.quality,rec.qualLen);
   }
+  fastq_recordFree (&rec);
   return seqs;
 }
 
 
 
+/**
+ * Returns an Array of FASTQ sequences with the qualities kept in a QualStore.
+ * @param[in] truncateName See fastq_nextSequence()
+ * @param[in] quals See fastq_readerReadAllCompact()
+ * @note The memory belongs to the caller.
+ */
+Array fastq_readAllSequencesCompact (int truncateName, QualStore quals)
+{
+  return fastq_readerReadAllCompact (fastqReader,truncateName,quals);
+}
+
+
+
+/**
+ * Locate the name in a header line view.
+ */
+static void fastq_nameRange (LineView *view, int truncateName, char **name, int *len)
+{
+  char *s = view->line + 1;
+  char *end = view->line + view->len;
+  char *e;
+
+  if (truncateName) {
+    while (s < end && isspace (*s)) {
+      s++;
+    }
+    for (e = s; e < end && !isspace (*e); e++)
+      ;
+    end = e;
+  }
+  *name = s;
+  *len = end - s;
+}
+
+
+
+/**
+ * Read the line following the header; dies if the record is truncated.
+ */
+static void fastq_bodyView (FastqReader this1, LineView *view)
+{
+  if (!ls_nextLineView (this1->ls,view)) {
+    die ("fastq: line %d: record is truncated",ls_lineCountGet (this1->ls));
+  }
+}
+
+
+
+static void fastq_fieldSet (char **buf, int *len, int *size, char *s, int n)
+{
+  if (n + 1 > *size) {
+    hlr_free (*buf);
+    *size = MAX (n + 1,2 * *size);
+    *buf = hlr_malloc (*size);
+  }
+  memcpy (*buf,s,n);
+  (*buf)[n] = '\0';
+  *len = n;
+}
+
+
+
+/**
+ * Initialize a FASTQ record before its first use with fastq_readerNextRecord().
+ * @param[out] rec A caller-owned record, e.g. a local variable
+ */
+void fastq_recordInit (FastqRecord *rec)
+{
+  memset (rec,0,sizeof (FastqRecord));
+}
+
+
+
+/**
+ * Free the buffers of a FASTQ record filled by fastq_readerNextRecord(); 'rec' itself belongs to the caller.
+ */
+void fastq_recordFree (FastqRecord *rec)
+{
+  if (rec->nameSize > 0) {
+    hlr_free (rec->name);
+  }
+  if (rec->seqSize > 0) {
+    hlr_free (rec->sequence);
+  }
+  if (rec->qualSize > 0) {
+    hlr_free (rec->quality);
+  }
+  fastq_recordInit (rec);
+}
+
+
+
+/**
+ * Read the next record into a reusable record.
+ * The buffers of 'rec' are kept from one call to the next and only grow when
+   a field is longer than before, so reading a file does not allocate per record.
+ * @param[in] this1 A FASTQ reader
+ * @param[in,out] rec A record set up by fastq_recordInit()
+ * @param[in] truncateName See fastq_nextSequence()
+ * @return 1 if a record was read, 0 at the end of the input
+ */
+int fastq_readerNextRecord (FastqReader this1, FastqRecord *rec, int truncateName)
+{
+  LineView view;
+  char *name;
+  int len;
+
+  if (!fastq_headerView (this1,&view)) {
+    return 0;
+  }
+  fastq_nameRange (&view,truncateName,&name,&len);
+  fastq_fieldSet (&rec->name,&rec->nameLen,&rec->nameSize,name,len);
+  fastq_bodyView (this1,&view);
+  fastq_fieldSet (&rec->sequence,&rec->seqLen,&rec->seqSize,view.line,view.len);
+  fastq_bodyView (this1,&view);
+  if (view.len == 0 || view.line[0] != '+') {
+    die ("Expected quality ID: '+' or '+%s'",rec->name);
+  }
+  fastq_bodyView (this1,&view);
+  fastq_fieldSet (&rec->quality,&rec->qualLen,&rec->qualSize,view.line,view.len);
+  return 1;
+}
+
+
+
+/**
+ * Create an empty batch for fastq_readerNextBatch().
+ */
+FastqBatch fastq_batchCreate (void)
+{
+  FastqBatch this1;
+
+  this1 = (FastqBatch) hlr_malloc (sizeof (struct _fastqBatchStruct_));
+  this1->blockSize = 65536;
+  this1->block = hlr_malloc (this1->blockSize);
+  this1->blockLen = 0;
+  this1->recordSize = 256;
+  this1->records = (FastqRecord *) hlr_malloc (this1->recordSize * sizeof (FastqRecord));
+  this1->offsets = (long long *) hlr_malloc (3 * this1->recordSize * sizeof (long long));
+  this1->recordCnt = 0;
+  return this1;
+}
+
+
+
+/**
+ * Append a null-terminated copy of s[0..n-1] to the block of a batch.
+ * @return Offset of the copy within the block
+ */
+static long long fastq_batchAppend (FastqBatch this1, char *s, int n)
+{
+  long long offset = this1->blockLen;
+
+  if (this1->blockLen + n + 1 > this1->blockSize) {
+    this1->blockSize = MAX (2 * this1->blockSize,this1->blockLen + n + 1);
+    this1->block = hlr_realloc (this1->block,this1->blockSize);
+    if (this1->block == NULL) {
+      die ("fastq_readerNextBatch: out of memory");
+    }
+  }
+  memcpy (this1->block + offset,s,n);
+  this1->block[offset + n] = '\0';
+  this1->blockLen += n + 1;
+  return offset;
+}
+
+
+
+/**
+ * Read up to maxRecords records into a batch.
+ * The names, sequences and qualities of all records are laid out one after the other in one
+   block owned by the batch; the block and the record array are reused by the next call and
+   only grow when needed.
+ * @param[in] this1 A FASTQ reader
+ * @param[in,out] batch A batch from fastq_batchCreate(); its previous contents are discarded
+ * @param[in] maxRecords Maximum number of records to read
+ * @param[in] truncateName See fastq_nextSequence()
+ * @return Number of records read, 0 at the end of the input
+ * @see fastq_batchRecordGet()
+ */
+int fastq_readerNextBatch (FastqReader this1, FastqBatch batch, int maxRecords, int truncateName)
+{
+  FastqRecord *rec;
+  LineView view;
+  long long *offsets;
+  char *name;
+  int len;
+  int i;
+
+  batch->blockLen = 0;
+  batch->recordCnt = 0;
+  while (batch->recordCnt < maxRecords && fastq_headerView (this1,&view)) {
+    if (batch->recordCnt == batch->recordSize) {
+      batch->recordSize *= 2;
+      batch->records = hlr_realloc (batch->records,batch->recordSize * sizeof (FastqRecord));
+      batch->offsets = hlr_realloc (batch->offsets,3 * batch->recordSize * sizeof (long long));
+      if (batch->records == NULL || batch->offsets == NULL) {
+        die ("fastq_readerNextBatch: out of memory");
+      }
+    }
+    rec = batch->records + batch->recordCnt;
+    offsets = batch->offsets + 3 * batch->recordCnt;
+    batch->recordCnt++;
+    fastq_nameRange (&view,truncateName,&name,&len);
+    offsets[0] = fastq_batchAppend (batch,name,len);
+    rec->nameLen = len;
+    fastq_bodyView (this1,&view);
+    offsets[1] = fastq_batchAppend (batch,view.line,view.len);
+    rec->seqLen = view.len;
+    fastq_bodyView (this1,&view);
+    if (view.len == 0 || view.line[0] != '+') {
+      die ("Expected quality ID: '+' or '+%s'",batch->block + offsets[0]);
+    }
+    fastq_bodyView (this1,&view);
+    offsets[2] = fastq_batchAppend (batch,view.line,view.len);
+    rec->qualLen = view.len;
+  }
+  /* the block may have moved while it grew, so the pointers are set last */
+  for (i = 0; i < batch->recordCnt; i++) {
+    rec = batch->records + i;
+    rec->name = batch->block + batch->offsets[3 * i];
+    rec->sequence = batch->block + batch->offsets[3 * i + 1];
+    rec->quality = batch->block + batch->offsets[3 * i + 2];
+    rec->nameSize = rec->seqSize = rec->qualSize = 0;
+  }
+  return batch->recordCnt;
+}
+
+
+
+/**
+ * Get the number of records in a batch.
+ */
+int fastq_batchCountGet (FastqBatch this1)
+{
+  return this1->recordCnt;
+}
+
+
+
+/**
+ * Get the i-th record of a batch.
+ * @param[in] this1 A batch
+ * @param[in] i 0 <= i < fastq_batchCountGet()
+ * @return The record; it points into the batch and is valid until the batch is refilled or destroyed
+ */
+FastqRecord *fastq_batchRecordGet (FastqBatch this1, int i)
+{
+  return this1->records + i;
+}
+
+
+
+/**
+ * Destroy a batch.
+ * @param[in] this1 A batch
+ * @note Do not call this function, but use the macro fastq_batchDestroy
+ */
+void fastq_batchDestroy_func (FastqBatch this1)
+{
+  if (!this1)
+    return;
+  hlr_free (this1->block);
+  hlr_free (this1->records);
+  hlr_free (this1->offsets);
+  hlr_free (this1);
+}
+
+
+
+/**
+ * Check whether two read names belong to mates.
+ * The names are compared up to the first white space; a trailing /1 and /2 are ignored.
+ * Nothing is allocated, so this is cheap enough to call for every pair.
+ * @param[in] name1 Name of the first mate, need not be null-terminated
+ * @param[in] len1 Length of name1
+ * @param[in] name2 Name of the second mate
+ * @param[in] len2 Length of name2
+ * @return 1 if the names match, else 0
+ */
+int fastq_mateNamesMatch (char *name1, int len1, char *name2, int len2)
+{
+  int i;
+
+  for (i = 0; i < len1 && !isspace (name1[i]); i++)
+    ;
+  len1 = i;
+  for (i = 0; i < len2 && !isspace (name2[i]); i++)
+    ;
+  len2 = i;
+  if (len1 >= 2 && len2 >= 2 && name1[len1 - 2] == '/' && name2[len2 - 2] == '/' &&
+      name1[len1 - 1] == '1' && name2[len2 - 1] == '2') {
+    len1 -= 2;
+    len2 -= 2;
+  }
+  return len1 == len2 && memcmp (name1,name2,len1) == 0;
+}
+
+
+
+/**
+ * Open the two files of a paired-end run.
+ * @param[in] fileName1 File with the first mates (R1)
+ * @param[in] fileName2 File with the second mates (R2)
+ * @param[in] checkNames If 1, the names of mates must match, see fastq_mateNamesMatch()
+ * @return A paired reader, or NULL if a file could not be opened (see warnReport())
+ */
+FastqPairReader fastq_pairReaderOpen (char *fileName1, char *fileName2, int checkNames)
+{
+  FastqPairReader this1;
+  FastqReader r1;
+  FastqReader r2;
+
+  if (!(r1 = fastq_readerOpen (fileName1)))
+    return NULL;
+  if (!(r2 = fastq_readerOpen (fileName2))) {
+    fastq_readerClose (r1);
+    return NULL;
+  }
+  this1 = (FastqPairReader) hlr_malloc (sizeof (struct _fastqPairReaderStruct_));
+  this1->r1 = r1;
+  this1->r2 = r2;
+  this1->checkNames = checkNames;
+  this1->pairCnt = 0;
+  return this1;
+}
+
+
+
+static void fastq_pairCheck (FastqPairReader this1, FastqRecord *rec1, FastqRecord *rec2)
+{
+  this1->pairCnt++;
+  if (this1->checkNames && !fastq_mateNamesMatch (rec1->name,rec1->nameLen,rec2->name,rec2->nameLen))
+    die ("fastq: pair %lld: names of mates differ: '%s' and '%s'",this1->pairCnt,rec1->name,rec2->name);
+}
+
+
+
+/**
+ * Read the next pair into two reusable records.
+ * @param[in] this1 A paired reader
+ * @param[in,out] rec1 Receives the first mate, see fastq_readerNextRecord()
+ * @param[in,out] rec2 Receives the second mate
+ * @param[in] truncateName See fastq_nextSequence()
+ * @return 1 if a pair was read, 0 at the end of the input. Dies if one file ends before the other.
+ */
+int fastq_pairReaderNext (FastqPairReader this1, FastqRecord *rec1, FastqRecord *rec2, int truncateName)
+{
+  int ok1 = fastq_readerNextRecord (this1->r1,rec1,truncateName);
+  int ok2 = fastq_readerNextRecord (this1->r2,rec2,truncateName);
+
+  if (ok1 != ok2)
+    die ("fastq: file of %s mates ends after %lld pairs",ok1 ? "second" : "first",this1->pairCnt);
+  if (!ok1)
+    return 0;
+  fastq_pairCheck (this1,rec1,rec2);
+  return 1;
+}
+
+
+
+/**
+ * Read the next batch of pairs; record i of batch1 is the mate of record i of batch2.
+ * @param[in] this1 A paired reader
+ * @param[in,out] batch1 Receives the first mates, see fastq_readerNextBatch()
+ * @param[in,out] batch2 Receives the second mates
+ * @param[in] maxPairs Maximum number of pairs to read
+ * @param[in] truncateName See fastq_nextSequence()
+ * @return Number of pairs read, 0 at the end of the input. Dies if one file ends before the other.
+ */
+int fastq_pairReaderNextBatch (FastqPairReader this1, FastqBatch batch1, FastqBatch batch2, 
+                               int maxPairs, int truncateName)
+{
+  int n1 = fastq_readerNextBatch (this1->r1,batch1,maxPairs,truncateName);
+  int n2 = fastq_readerNextBatch (this1->r2,batch2,maxPairs,truncateName);
+  int i;
+
+  if (n1 != n2)
+    die ("fastq: file of %s mates ends after %lld pairs",n1 > n2 ? "second" : "first",
+         this1->pairCnt + MIN (n1,n2));
+  for (i = 0; i < n1; i++)
+    fastq_pairCheck (this1,batch1->records + i,batch2->records + i);
+  return n1;
+}
+
+
+
+/**
+ * Close a paired reader.
+ * @param[in] this1 A paired reader
+ * @note Do not call this function, but use the macro fastq_pairReaderClose
+ */
+void fastq_pairReaderClose_func (FastqPairReader this1)
+{
+  if (!this1)
+    return;
+  fastq_readerClose (this1->r1);
+  fastq_readerClose (this1->r2);
+  hlr_free (this1);
+}
+
+
+
+/**
+ * FastqPairSlot.
+ * One batch of pairs travelling through fastq_pairProcess(); PRIVATE to the fastq module.
+ */
+typedef struct {
+  FastqBatch batch1;
+  FastqBatch batch2;
+  Stringa out;
+  void (*work_hook)(FastqBatch batch1, FastqBatch batch2, Stringa out, void *arg);
+  void *arg;
+  ThreadPoolJob job;
+} FastqPairSlot;
+
+
+
+static void fastq_pairSlotRun (void *arg)
+{
+  FastqPairSlot *slot = (FastqPairSlot *)arg;
+
+  slot->work_hook (slot->batch1,slot->batch2,slot->out,slot->arg);
+}
+
+
+
+/**
+ * Process all pairs of a paired reader in parallel.
+ * The calling thread reads batches of pairs and hands them to a pool of worker threads;
+   while the workers run, it reads ahead. Results are passed on in input order.
+ * @param[in] this1 A paired reader
+ * @param[in] nThreads Number of worker threads; see threadPool_cpuCount()
+ * @param[in] batchPairs Number of pairs per batch, e.g. 10000
+ * @param[in] truncateName See fastq_nextSequence()
+ * @param[in] work_hook Called on a worker thread for each batch; writes its results (e.g. trimmed 
+   records) to 'out', which is empty on entry. Must only touch its own batch and 'out' 
+   or synchronise itself.
+ * @param[in] output_hook If not NULL, called in the calling thread with the 'out' of each batch,
+   strictly in input order, e.g. to write the results to a file
+ * @param[in] arg Passed to both hooks
+ * @return Number of pairs processed
+ */
+long long fastq_pairProcess (FastqPairReader this1, int nThreads, int batchPairs, int truncateName,
+                             void (*work_hook)(FastqBatch batch1, FastqBatch batch2, Stringa out, void *arg),
+                             void (*output_hook)(Stringa out, void *arg), void *arg)
+{
+  ThreadPool pool = threadPool_create (nThreads);
+  int nSlots = 2 * nThreads;
+  FastqPairSlot *slots = (FastqPairSlot *) hlr_malloc (nSlots * sizeof (FastqPairSlot));
+  FastqPairSlot *slot;
+  long long pairCnt = 0;
+  int submitted = 0;
+  int done = 0;
+  int n;
+  int i;
+
+  for (i = 0; i < nSlots; i++) {
+    slots[i].batch1 = fastq_batchCreate ();
+    slots[i].batch2 = fastq_batchCreate ();
+    slots[i].out = stringCreate (1000);
+    slots[i].work_hook = work_hook;
+    slots[i].arg = arg;
+  }
+  for (;;) {
+    if (submitted - done == nSlots) {
+      slot = slots + done % nSlots;
+      threadPool_waitJob (pool,&slot->job);
+      if (output_hook)
+        output_hook (slot->out,arg);
+      done++;
+    }
+    slot = slots + submitted % nSlots;
+    if ((n = fastq_pairReaderNextBatch (this1,slot->batch1,slot->batch2,batchPairs,truncateName)) == 0)
+      break;
+    pairCnt += n;
+    stringClear (slot->out);
+    threadPool_submit (pool,&slot->job,fastq_pairSlotRun,slot);
+    submitted++;
+  }
+  for (; done < submitted; done++) {
+    slot = slots + done % nSlots;
+    threadPool_waitJob (pool,&slot->job);
+    if (output_hook)
+      output_hook (slot->out,arg);
+  }
+  threadPool_destroy (pool);
+  for (i = 0; i < nSlots; i++) {
+    fastq_batchDestroy (slots[i].batch1);
+    fastq_batchDestroy (slots[i].batch2);
+    stringDestroy (slots[i].out);
+  }
+  hlr_free (slots);
+  return pairCnt;
+}
+
+
+
 /**
  * Prints currSeq to char*.
  */
@@ -176,3 +851,228 @@ void fastq_printSequences (Array seqs)
     fastq_printOneSequence (currFQ); 
   }
 }
+
+
+
+/**
+ * Decides whether a FASTQ record starts at 'text'; for use with ls_splitFile() and ls_parallel().
+ * Quality lines may start with '@' as well, so a line starting with '@' only counts 
+   if the line after the next one starts with '+'.
+ * @param[in] text Start of a line, not null-terminated
+ * @param[in] len Number of bytes available at 'text', at least 1
+ * @param[in] atEof 1 if 'text' reaches up to the end of the file
+ * @return 1 if a record starts at 'text', 0 if not, -1 if more bytes are needed to decide
+ */
+int fastq_recordStart (char *text, int len, int atEof)
+{
+  char *s = text;
+  char *end = text + len;
+  char *nl;
+  int i;
+
+  if (text[0] != '@')
+    return 0;
+  for (i = 0; i < 2; i++) {
+    if ((nl = memchr (s,'\n',end - s)) == NULL)
+      return atEof ? 0 : -1;
+    s = nl + 1;
+  }
+  if (s == end)
+    return atEof ? 0 : -1;
+  return *s == '+';
+}
+
+
+
+/**
+ * FastqRangeJob.
+ * One range of a file parsed by fastq_parallel(); PRIVATE to the fastq module.
+ */
+typedef struct {
+  char *fileName;
+  LsRange *range;
+  int rangeIndex;
+  int truncateName;
+  void (*record_hook)(Fastq *fq, int rangeIndex, void *arg);  /* called on the worker thread, else NULL */
+  void *arg;
+  FastqBatch batch;       /* records of the range for ordered delivery, else NULL */
+  Array seqs;             /* of Fastq: records of the range when collecting, else NULL */
+  long long recordCnt;
+  ThreadPoolJob job;
+} FastqRangeJob;
+
+
+
+/**
+ * Present a FastqRecord as a Fastq without copying; fq and seq belong to the caller.
+ */
+static void fastq_recordToFastq (FastqRecord *rec, Fastq *fq, Seq *seq)
+{
+  seq->name = rec->name;
+  seq->sequence = rec->sequence;
+  seq->size = rec->seqLen;
+  seq->mask = NULL;
+  fq->seq = seq;
+  fq->quality = rec->quality;
+}
+
+
+
+static void fastq_rangeJobRun (void *arg)
+{
+  FastqRangeJob *rj = (FastqRangeJob *)arg;
+  FastqReader reader;
+  FastqRecord rec;
+  LineStream ls;
+  Fastq fq;
+  Seq seq;
+
+  if (!(ls = ls_createFromFileRange (rj->fileName,rj->range->start,rj->range->end)))
+    die ("fastq_parallel: %s",warnReport ());
+  reader = fastq_readerCreate (ls);
+  rj->recordCnt = 0;
+  if (rj->record_hook) {
+    fastq_recordInit (&rec);
+    while (fastq_readerNextRecord (reader,&rec,rj->truncateName)) {
+      fastq_recordToFastq (&rec,&fq,&seq);
+      rj->record_hook (&fq,rj->rangeIndex,rj->arg);
+      rj->recordCnt++;
+    }
+    fastq_recordFree (&rec);
+  }
+  else if (rj->batch) {
+    rj->recordCnt = fastq_readerNextBatch (reader,rj->batch,INT_MAX,rj->truncateName);
+  }
+  else {
+    rj->seqs = fastq_readerReadAll (reader,rj->truncateName);
+    rj->recordCnt = arrayMax (rj->seqs);
+  }
+  fastq_readerClose (reader);
+}
+
+
+
+static void fastq_rangeJobSubmit (ThreadPool pool, FastqRangeJob *rj, Array ranges, int i)
+{
+  rj->range = arrp (ranges,i,LsRange);
+  rj->rangeIndex = i;
+  threadPool_submit (pool,&rj->job,fastq_rangeJobRun,rj);
+}
+
+
+
+/**
+ * Parse a FASTQ file on several threads.
+ * The file is split into ranges of about FASTQ_PARALLEL_RANGE_SIZE bytes by ls_splitFile(); 
+   each range starts at a real record, see fastq_recordStart(), and is parsed on its own thread.
+   At most 2 * nThreads ranges are in flight; the next range is only started once the first
+   one has been consumed, so the memory used does not depend on the size of the file.
+ * @param[in] fileName Name of a plain or BGZF compressed file (not stdin)
+ * @param[in] nThreads Number of threads; see threadPool_cpuCount()
+ * @param[in] truncateName See fastq_nextSequence()
+ * @param[in] ordered If 1, record_hook is called in the calling thread, in file order;
+   ranges are parsed ahead into batches in the background. If 0, record_hook is called on 
+   the worker threads as soon as a record has been parsed; records of one range arrive in 
+   file order, ranges in any order, so record_hook must synchronise itself or only touch 
+   data of its rangeIndex.
+ * @param[in] record_hook Called once per record; the record belongs to this routine and 
+   is only valid during the call
+ * @param[in] arg Passed to record_hook
+ * @return Number of records, -1 if the file could not be opened (see warnReport())
+ * @note The worker threads run without any synchronisation, so the same rules as for 
+   ls_parallel() apply to an unordered record_hook. A malformed record ends the program via die().
+ */
+long long fastq_parallel (char *fileName, int nThreads, int truncateName, int ordered,
+                          void (*record_hook)(Fastq *fq, int rangeIndex, void *arg), void *arg)
+{
+  FastqRangeJob *jobs;
+  FastqRangeJob *rj;
+  ThreadPool pool;
+  Array ranges;
+  Fastq fq;
+  Seq seq;
+  long long recordCnt = 0;
+  int nJobs;
+  int i,k;
+
+  if (!(ranges = ls_splitFile (fileName,ls_rangeCount (fileName,FASTQ_PARALLEL_RANGE_SIZE,4 * nThreads),
+                               fastq_recordStart)))
+    return -1;
+  nJobs = MIN (2 * nThreads,arrayMax (ranges));
+  jobs = (FastqRangeJob *) hlr_calloc (nJobs,sizeof (FastqRangeJob));
+  pool = threadPool_create (nThreads);
+  for (i = 0; i < nJobs; i++) {
+    jobs[i].fileName = fileName;
+    jobs[i].truncateName = truncateName;
+    jobs[i].record_hook = ordered ? NULL : record_hook;
+    jobs[i].arg = arg;
+    jobs[i].batch = ordered ? fastq_batchCreate () : NULL;
+    fastq_rangeJobSubmit (pool,&jobs[i],ranges,i);
+  }
+  for (i = 0; i < arrayMax (ranges); i++) {
+    rj = &jobs[i % nJobs];
+    threadPool_waitJob (pool,&rj->job);
+    recordCnt += rj->recordCnt;
+    if (ordered) {
+      for (k = 0; k < fastq_batchCountGet (rj->batch); k++) {
+        fastq_recordToFastq (fastq_batchRecordGet (rj->batch,k),&fq,&seq);
+        record_hook (&fq,i,arg);
+      }
+    }
+    if (i + nJobs < arrayMax (ranges))
+      fastq_rangeJobSubmit (pool,rj,ranges,i + nJobs);
+  }
+  threadPool_destroy (pool);
+  for (i = 0; i < nJobs; i++)
+    fastq_batchDestroy (jobs[i].batch);
+  hlr_free (jobs);
+  arrayDestroy (ranges);
+  return recordCnt;
+}
+
+
+
+/**
+ * Read all records of a FASTQ file on several threads; a parallel fastq_readAllSequences().
+ * @param[in] fileName Name of a plain or BGZF compressed file (not stdin)
+ * @param[in] nThreads Number of threads; see threadPool_cpuCount()
+ * @param[in] truncateName See fastq_nextSequence()
+ * @return Array of Fastq in file order, NULL if the file could not be opened (see warnReport())
+ * @note The memory belongs to the caller.
+ */
+Array fastq_readAllParallel (char *fileName, int nThreads, int truncateName)
+{
+  FastqRangeJob *jobs;
+  ThreadPool pool;
+  Array ranges;
+  Array seqs;
+  long long recordCnt = 0;
+  int i;
+
+  /* all records are kept anyway, so all ranges are submitted at once */
+  if (!(ranges = ls_splitFile (fileName,4 * nThreads,fastq_recordStart)))
+    return NULL;
+  jobs = (FastqRangeJob *) hlr_calloc (arrayMax (ranges),sizeof (FastqRangeJob));
+  pool = threadPool_create (nThreads);
+  for (i = 0; i < arrayMax (ranges); i++) {
+    jobs[i].fileName = fileName;
+    jobs[i].truncateName = truncateName;
+    fastq_rangeJobSubmit (pool,&jobs[i],ranges,i);
+  }
+  threadPool_waitAll (pool);
+  threadPool_destroy (pool);
+  for (i = 0; i < arrayMax (ranges); i++)
+    recordCnt += jobs[i].recordCnt;
+  seqs = arrayCreate (recordCnt + 1,Fastq);
+  for (i = 0; i < arrayMax (ranges); i++) {
+    if (jobs[i].recordCnt > 0) {
+      arrayp (seqs,arrayMax (seqs) + jobs[i].recordCnt - 1,Fastq);
+      memcpy (arrp (seqs,arrayMax (seqs) - jobs[i].recordCnt,Fastq),arrp (jobs[i].seqs,0,Fastq),
+              jobs[i].recordCnt * sizeof (Fastq));
+    }
+    arrayDestroy (jobs[i].seqs);
+  }
+  hlr_free (jobs);
+  arrayDestroy (ranges);
+  return seqs;
+}
@@ -9,6 +9,15 @@
 
 
 #include "seq.h"
+#include "linestream.h"
+#include "qualStore.h"
+
+/**
+ * Bytes of the file per range in fastq_parallel().
+ */
+#define FASTQ_PARALLEL_RANGE_SIZE (8 << 20)
+
+
 
 /**
  * FASTQ structure.
@@ -19,13 +28,128 @@ typedef struct {
 } Fastq;
 
 
+
+/**
+ * FastqRecord.
+ * A FASTQ record in reusable buffers, see fastq_readerNextRecord() and fastq_readerNextBatch().
+ * All three fields are null-terminated.
+ */
+typedef struct {
+  char *name;
+  char *sequence;
+  char *quality;
+  int nameLen;
+  int seqLen;
+  int qualLen;
+  int nameSize;           /* allocated sizes; 0 if the record points into a FastqBatch */
+  int seqSize;
+  int qualSize;
+} FastqRecord;
+
+
+
+/**
+ * FastqBatch.
+ */
+typedef struct _fastqBatchStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fastq module -- DO NOT access from outside
+     the fastq module */
+  char *block;            /* names, sequences and qualities of all records */
+  long long blockSize;
+  long long blockLen;
+  FastqRecord *records;
+  long long *offsets;     /* 3 per record, into block, while the batch is filled */
+  int recordCnt;
+  int recordSize;
+} *FastqBatch;
+
+
+
+/**
+ * FastqReader.
+ */
+typedef struct _fastqReaderStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fastq module -- DO NOT access from outside
+     the fastq module */
+  LineStream ls;
+  Fastq *currFQ;          /* returned last by fastq_readerNext() */
+} *FastqReader;
+
+
+
+/**
+ * FastqPairReader.
+ */
+typedef struct _fastqPairReaderStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fastq module -- DO NOT access from outside
+     the fastq module */
+  FastqReader r1;         /* first mates */
+  FastqReader r2;         /* second mates */
+  int checkNames;
+  long long pairCnt;      /* pairs read so far */
+} *FastqPairReader;
+
+
 extern void fastq_initFromFile (char *fileName);
 extern void fastq_initFromPipe (char *command);
 extern void fastq_deInit (void);
 extern Fastq* fastq_nextSequence (int truncateName);
 extern Array fastq_readAllSequences (int truncateName);
+extern Array fastq_readAllSequencesCompact (int truncateName, QualStore quals);
 extern char* fastq_printOneSequence (Fastq *currFQ);
 extern void fastq_printSequences (Array seqs);
+extern int fastq_recordStart (char *text, int len, int atEof);
+extern long long fastq_parallel (char *fileName, int nThreads, int truncateName, int ordered,
+                                 void (*record_hook)(Fastq *fq, int rangeIndex, void *arg), void *arg);
+extern Array fastq_readAllParallel (char *fileName, int nThreads, int truncateName);
+
+extern FastqReader fastq_readerCreate (LineStream ls);
+extern FastqReader fastq_readerOpen (char *fileName);
+extern FastqReader fastq_readerOpenPipe (char *command);
+extern Fastq* fastq_readerNext (FastqReader this1, int truncateName);
+extern Array fastq_readerReadAll (FastqReader this1, int truncateName);
+extern Array fastq_readerReadAllCompact (FastqReader this1, int truncateName, QualStore quals);
+extern void fastq_readerClose_func (FastqReader this1); /* do not use this function */
+
+/**
+ * Close a FASTQ reader.
+ * @see fastq_readerClose_func()
+ */
+#define fastq_readerClose(this1) (fastq_readerClose_func(this1),this1=NULL) /* use this one */
+
+extern void fastq_recordInit (FastqRecord *rec);
+extern void fastq_recordFree (FastqRecord *rec);
+extern int fastq_readerNextRecord (FastqReader this1, FastqRecord *rec, int truncateName);
+extern FastqBatch fastq_batchCreate (void);
+extern int fastq_readerNextBatch (FastqReader this1, FastqBatch batch, int maxRecords, int truncateName);
+extern int fastq_batchCountGet (FastqBatch this1);
+extern FastqRecord *fastq_batchRecordGet (FastqBatch this1, int i);
+extern void fastq_batchDestroy_func (FastqBatch this1); /* do not use this function */
+
+/**
+ * Destroy a FASTQ batch.
+ * @see fastq_batchDestroy_func()
+ */
+#define fastq_batchDestroy(this1) (fastq_batchDestroy_func(this1),this1=NULL) /* use this one */
+
+extern int fastq_mateNamesMatch (char *name1, int len1, char *name2, int len2);
+extern FastqPairReader fastq_pairReaderOpen (char *fileName1, char *fileName2, int checkNames);
+extern int fastq_pairReaderNext (FastqPairReader this1, FastqRecord *rec1, FastqRecord *rec2, int truncateName);
+extern int fastq_pairReaderNextBatch (FastqPairReader this1, FastqBatch batch1, FastqBatch batch2,
+                                      int maxPairs, int truncateName);
+extern long long fastq_pairProcess (FastqPairReader this1, int nThreads, int batchPairs, int truncateName,
+                                    void (*work_hook)(FastqBatch batch1, FastqBatch batch2, Stringa out, void *arg),
+                                    void (*output_hook)(Stringa out, void *arg), void *arg);
+extern void fastq_pairReaderClose_func (FastqPairReader this1); /* do not use this function */
+
+/**
+ * Close a paired reader.
+ * @see fastq_pairReaderClose_func()
+ */
+#define fastq_pairReaderClose(this1) (fastq_pairReaderClose_func(this1),this1=NULL) /* use this one */
 
 
 #endif
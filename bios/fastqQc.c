@@ -0,0 +1,417 @@
+/**
+ *   \file fastqQc.c Module for quality control statistics of FASTQ reads
+ */
+
+
+/*
+   Module fastqQc
+   Collects per-cycle base composition, mean quality and quality
+   distribution, and per-read mean quality, GC content and N counts.
+   The per-cycle counters of each read are first added to narrow
+   counters (8 bits for bases, 16 bits for qualities) with SSE2 or AVX2,
+   16 or 32 cycles at a time; every 255 reads they are added to the
+   64-bit totals. Without SSE2 the same is done one cycle at a time.
+   A FastqQc is not thread-safe: use one per thread and combine them
+   with fastqQc_merge(). Qualities are expected in Phred+33 encoding.
+*/
+
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "fastqQc.h"
+
+
+
+#define FASTQ_QC_PENDING_MAX 255  /* reads before the 8-bit counters could overflow */
+#define FASTQ_QC_QUAL_BINS (FASTQ_QC_MAX_QUAL + 1)
+
+
+
+/**
+ * Create empty QC statistics.
+ */
+FastqQc fastqQc_create (void)
+{
+  FastqQc this1 = (FastqQc) hlr_calloc (1,sizeof (struct _fastqQcStruct_));
+
+  return this1;
+}
+
+
+
+static void fastqQc_flush (FastqQc this1)
+{
+  int i;
+
+  if (this1->pendingCnt == 0)
+    return;
+  for (i = 0; i < 4 * this1->cycleCnt; i++)
+    this1->baseCounts[(i % this1->cycleCnt) * 4 + i / this1->cycleCnt] += this1->pendingBases[i];
+  for (i = 0; i < this1->cycleCnt; i++)
+    this1->qualSums[i] += this1->pendingQuals[i];
+  memset (this1->pendingBases,0,4 * this1->cycleCnt);
+  memset (this1->pendingQuals,0,this1->cycleCnt * sizeof (unsigned short));
+  this1->pendingCnt = 0;
+}
+
+
+
+static long long *fastqQc_grow (long long *counts, int oldCnt, int newCnt)
+{ /* the first allocation is counted by hlr_calloc(), hlr_realloc() keeps the count */
+  if (!counts)
+    return (long long *) hlr_calloc (newCnt,sizeof (long long));
+  counts = (long long *) hlr_realloc (counts,newCnt * sizeof (long long));
+  if (!counts)
+    die ("fastqQc: out of memory for %d cycles",newCnt);
+  memset (counts + oldCnt,0,(newCnt - oldCnt) * sizeof (long long));
+  return counts;
+}
+
+
+
+static void fastqQc_cyclesEnsure (FastqQc this1, int len)
+{
+  int newCnt;
+
+  if (len <= this1->cycleCnt)
+    return;
+  fastqQc_flush (this1);
+  newCnt = (len + 31) / 32 * 32;
+  this1->lengthCounts = fastqQc_grow (this1->lengthCounts,this1->cycleCnt,newCnt);
+  this1->baseCounts = fastqQc_grow (this1->baseCounts,4 * this1->cycleCnt,4 * newCnt);
+  this1->qualSums = fastqQc_grow (this1->qualSums,this1->cycleCnt,newCnt);
+  this1->qualHist = fastqQc_grow (this1->qualHist,FASTQ_QC_QUAL_BINS * this1->cycleCnt,
+                                  FASTQ_QC_QUAL_BINS * newCnt);
+  hlr_free (this1->pendingBases);
+  hlr_free (this1->pendingQuals);
+  this1->pendingBases = (unsigned char *) hlr_calloc (4 * newCnt,1);
+  this1->pendingQuals = (unsigned short *) hlr_calloc (newCnt,sizeof (unsigned short));
+  this1->cycleCnt = newCnt;
+}
+
+
+
+/*
+ * Vector part of fastqQc_addRead(): handles whole vectors of cycles from the start
+ * of the read and returns how many cycles it did; adds to the counts at pGc, pAcgt and pQualSum.
+ */
+#if defined (__AVX2__)
+static int fastqQc_addVectors (FastqQc this1, char *sequence, char *quality, int len, 
+                               int *pGc, int *pAcgt, long long *pQualSum)
+{
+  unsigned char *a = this1->pendingBases;
+  unsigned char *c = a + this1->cycleCnt;
+  unsigned char *g = c + this1->cycleCnt;
+  unsigned char *t = g + this1->cycleCnt;
+  unsigned short *qs = this1->pendingQuals;
+  __m256i upper = _mm256_set1_epi8 ((char)0xDF);
+  __m256i offset = _mm256_set1_epi8 ('!');
+  __m256i zero = _mm256_setzero_si256 ();
+  __m256i s,q,mA,mC,mG,mT,sad,lo,hi;
+  int j;
+
+  for (j = 0; j + 32 <= len; j += 32) {
+    s = _mm256_and_si256 (_mm256_loadu_si256 ((__m256i *)(sequence + j)),upper);
+    q = _mm256_subs_epu8 (_mm256_loadu_si256 ((__m256i *)(quality + j)),offset);
+    mA = _mm256_cmpeq_epi8 (s,_mm256_set1_epi8 ('A'));
+    mC = _mm256_cmpeq_epi8 (s,_mm256_set1_epi8 ('C'));
+    mG = _mm256_cmpeq_epi8 (s,_mm256_set1_epi8 ('G'));
+    mT = _mm256_cmpeq_epi8 (s,_mm256_set1_epi8 ('T'));
+    _mm256_storeu_si256 ((__m256i *)(a + j),_mm256_sub_epi8 (_mm256_loadu_si256 ((__m256i *)(a + j)),mA));
+    _mm256_storeu_si256 ((__m256i *)(c + j),_mm256_sub_epi8 (_mm256_loadu_si256 ((__m256i *)(c + j)),mC));
+    _mm256_storeu_si256 ((__m256i *)(g + j),_mm256_sub_epi8 (_mm256_loadu_si256 ((__m256i *)(g + j)),mG));
+    _mm256_storeu_si256 ((__m256i *)(t + j),_mm256_sub_epi8 (_mm256_loadu_si256 ((__m256i *)(t + j)),mT));
+    *pGc += __builtin_popcount (_mm256_movemask_epi8 (_mm256_or_si256 (mC,mG)));
+    *pAcgt += __builtin_popcount (_mm256_movemask_epi8 (_mm256_or_si256 (_mm256_or_si256 (mA,mC),
+                                                                         _mm256_or_si256 (mG,mT))));
+    sad = _mm256_sad_epu8 (q,zero);
+    *pQualSum += _mm256_extract_epi64 (sad,0) + _mm256_extract_epi64 (sad,1) + 
+      _mm256_extract_epi64 (sad,2) + _mm256_extract_epi64 (sad,3);
+    /* unpack works within 128-bit lanes, so reorder to get cycles j..j+15 and j+16..j+31 */
+    q = _mm256_permute4x64_epi64 (q,0xD8);
+    lo = _mm256_unpacklo_epi8 (q,zero);
+    hi = _mm256_unpackhi_epi8 (q,zero);
+    _mm256_storeu_si256 ((__m256i *)(qs + j),_mm256_add_epi16 (_mm256_loadu_si256 ((__m256i *)(qs + j)),lo));
+    _mm256_storeu_si256 ((__m256i *)(qs + j + 16),_mm256_add_epi16 (_mm256_loadu_si256 ((__m256i *)(qs + j + 16)),hi));
+  }
+  return j;
+}
+#elif defined (__SSE2__)
+static int fastqQc_addVectors (FastqQc this1, char *sequence, char *quality, int len, 
+                               int *pGc, int *pAcgt, long long *pQualSum)
+{
+  unsigned char *a = this1->pendingBases;
+  unsigned char *c = a + this1->cycleCnt;
+  unsigned char *g = c + this1->cycleCnt;
+  unsigned char *t = g + this1->cycleCnt;
+  unsigned short *qs = this1->pendingQuals;
+  __m128i upper = _mm_set1_epi8 ((char)0xDF);
+  __m128i offset = _mm_set1_epi8 ('!');
+  __m128i zero = _mm_setzero_si128 ();
+  __m128i s,q,mA,mC,mG,mT,sad;
+  int j;
+
+  for (j = 0; j + 16 <= len; j += 16) {
+    s = _mm_and_si128 (_mm_loadu_si128 ((__m128i *)(sequence + j)),upper);
+    q = _mm_subs_epu8 (_mm_loadu_si128 ((__m128i *)(quality + j)),offset);
+    mA = _mm_cmpeq_epi8 (s,_mm_set1_epi8 ('A'));
+    mC = _mm_cmpeq_epi8 (s,_mm_set1_epi8 ('C'));
+    mG = _mm_cmpeq_epi8 (s,_mm_set1_epi8 ('G'));
+    mT = _mm_cmpeq_epi8 (s,_mm_set1_epi8 ('T'));
+    _mm_storeu_si128 ((__m128i *)(a + j),_mm_sub_epi8 (_mm_loadu_si128 ((__m128i *)(a + j)),mA));
+    _mm_storeu_si128 ((__m128i *)(c + j),_mm_sub_epi8 (_mm_loadu_si128 ((__m128i *)(c + j)),mC));
+    _mm_storeu_si128 ((__m128i *)(g + j),_mm_sub_epi8 (_mm_loadu_si128 ((__m128i *)(g + j)),mG));
+    _mm_storeu_si128 ((__m128i *)(t + j),_mm_sub_epi8 (_mm_loadu_si128 ((__m128i *)(t + j)),mT));
+    *pGc += __builtin_popcount (_mm_movemask_epi8 (_mm_or_si128 (mC,mG)));
+    *pAcgt += __builtin_popcount (_mm_movemask_epi8 (_mm_or_si128 (_mm_or_si128 (mA,mC),
+                                                                   _mm_or_si128 (mG,mT))));
+    sad = _mm_sad_epu8 (q,zero);
+    *pQualSum += _mm_cvtsi128_si32 (sad) + _mm_extract_epi16 (sad,4);
+    _mm_storeu_si128 ((__m128i *)(qs + j),
+                      _mm_add_epi16 (_mm_loadu_si128 ((__m128i *)(qs + j)),_mm_unpacklo_epi8 (q,zero)));
+    _mm_storeu_si128 ((__m128i *)(qs + j + 8),
+                      _mm_add_epi16 (_mm_loadu_si128 ((__m128i *)(qs + j + 8)),_mm_unpackhi_epi8 (q,zero)));
+  }
+  return j;
+}
+#else
+static int fastqQc_addVectors (FastqQc this1, char *sequence, char *quality, int len, 
+                               int *pGc, int *pAcgt, long long *pQualSum)
+{
+  return 0;
+}
+#endif
+
+
+
+/**
+ * Add one read.
+ * @param[in] this1 QC statistics
+ * @param[in] sequence Bases of the read
+ * @param[in] quality Qualities of the read, Phred+33
+ * @param[in] len Number of bases
+ */
+void fastqQc_addRead (FastqQc this1, char *sequence, char *quality, int len)
+{
+  long long *qualHist;
+  long long qualSum = 0;
+  int gc = 0;
+  int acgt = 0;
+  int q;
+  int j;
+
+  fastqQc_cyclesEnsure (this1,len);
+  if (this1->pendingCnt == FASTQ_QC_PENDING_MAX)
+    fastqQc_flush (this1);
+  j = fastqQc_addVectors (this1,sequence,quality,len,&gc,&acgt,&qualSum);
+  for (; j < len; j++) {
+    q = quality[j] > '!' ? quality[j] - '!' : 0;
+    this1->pendingQuals[j] += q;
+    qualSum += q;
+    switch (sequence[j]) {
+      case 'A': case 'a':
+        this1->pendingBases[j]++;
+        acgt++;
+        break;
+      case 'C': case 'c':
+        this1->pendingBases[this1->cycleCnt + j]++;
+        acgt++;
+        gc++;
+        break;
+      case 'G': case 'g':
+        this1->pendingBases[2 * this1->cycleCnt + j]++;
+        acgt++;
+        gc++;
+        break;
+      case 'T': case 't':
+        this1->pendingBases[3 * this1->cycleCnt + j]++;
+        acgt++;
+        break;
+    }
+  }
+  this1->pendingCnt++;
+  qualHist = this1->qualHist;
+  for (j = 0; j < len; j++) {
+    q = quality[j] > '!' ? quality[j] - '!' : 0;
+    qualHist[MIN (q,FASTQ_QC_MAX_QUAL)]++;
+    qualHist += FASTQ_QC_QUAL_BINS;
+  }
+  if (len > 0) {
+    this1->lengthCounts[len - 1]++;
+    this1->meanQualHist[MIN (qualSum / len,FASTQ_QC_MAX_QUAL)]++;
+    this1->gcHist[(200 * gc + len) / (2 * len)]++;
+  }
+  this1->nHist[MIN (len - acgt,10)]++;
+  this1->readCnt++;
+}
+
+
+
+/**
+ * Add one FASTQ record.
+ */
+void fastqQc_add (FastqQc this1, Fastq *fq)
+{
+  fastqQc_addRead (this1,fq->seq->sequence,fq->quality,fq->seq->size);
+}
+
+
+
+/**
+ * Add all records of a batch, see fastq_readerNextBatch().
+ */
+void fastqQc_addBatch (FastqQc this1, FastqBatch batch)
+{
+  FastqRecord *rec;
+  int i;
+
+  for (i = 0; i < fastq_batchCountGet (batch); i++) {
+    rec = fastq_batchRecordGet (batch,i);
+    fastqQc_addRead (this1,rec->sequence,rec->quality,MIN (rec->seqLen,rec->qualLen));
+  }
+}
+
+
+
+/**
+ * Add the statistics of another FastqQc, e.g. one filled on another thread.
+ * For paired data keep one FastqQc per mate; in fastq_pairProcess() fill one
+   per batch in the work hook and merge it in the output hook.
+ * @param[in] this1 QC statistics
+ * @param[in] other Statistics to add; stays unchanged, except for internal buffers
+ */
+void fastqQc_merge (FastqQc this1, FastqQc other)
+{
+  int i;
+
+  fastqQc_flush (other);
+  fastqQc_cyclesEnsure (this1,other->cycleCnt);
+  for (i = 0; i < other->cycleCnt; i++) {
+    this1->lengthCounts[i] += other->lengthCounts[i];
+    this1->qualSums[i] += other->qualSums[i];
+  }
+  for (i = 0; i < 4 * other->cycleCnt; i++)
+    this1->baseCounts[i] += other->baseCounts[i];
+  for (i = 0; i < FASTQ_QC_QUAL_BINS * other->cycleCnt; i++)
+    this1->qualHist[i] += other->qualHist[i];
+  for (i = 0; i < FASTQ_QC_QUAL_BINS; i++)
+    this1->meanQualHist[i] += other->meanQualHist[i];
+  for (i = 0; i < (int)NUMELE (this1->gcHist); i++)
+    this1->gcHist[i] += other->gcHist[i];
+  for (i = 0; i < (int)NUMELE (this1->nHist); i++)
+    this1->nHist[i] += other->nHist[i];
+  this1->readCnt += other->readCnt;
+}
+
+
+
+/**
+ * Number of reads added.
+ */
+long long fastqQc_readCountGet (FastqQc this1)
+{
+  return this1->readCnt;
+}
+
+
+
+static int fastqQc_quantile (long long *hist, long long total, double fraction)
+{
+  long long sum = 0;
+  int q;
+
+  for (q = 0; q < FASTQ_QC_MAX_QUAL; q++) {
+    sum += hist[q];
+    if (sum >= fraction * total)
+      break;
+  }
+  return q;
+}
+
+
+
+/**
+ * Write the statistics as tab-delimited tables, each introduced by a line starting with '#'.
+ * Tables: summary; per cycle (reads, mean quality, quartiles, fraction of A, C, G, T and other bases);
+   reads by mean quality; reads by GC percent; reads by number of N; reads by length.
+ * @param[in] this1 QC statistics
+ * @param[in] fp Where to write to
+ */
+void fastqQc_write (FastqQc this1, FILE *fp)
+{
+  long long *coverage;
+  long long *counts;
+  long long baseCnt = 0;
+  long long gcCnt = 0;
+  long long reads = 0;
+  int i,k;
+
+  fastqQc_flush (this1);
+  coverage = (long long *) hlr_calloc (this1->cycleCnt + 1,sizeof (long long));
+  for (i = this1->cycleCnt - 1; i >= 0; i--) {
+    reads += this1->lengthCounts[i];
+    coverage[i] = reads;
+    baseCnt += reads;
+    gcCnt += this1->baseCounts[4 * i + 1] + this1->baseCounts[4 * i + 2];
+  }
+  fprintf (fp,"#Summary\n");
+  fprintf (fp,"reads\t%lld\n",this1->readCnt);
+  fprintf (fp,"bases\t%lld\n",baseCnt);
+  fprintf (fp,"gcPercent\t%.2f\n",baseCnt ? 100.0 * gcCnt / baseCnt : 0.0);
+  fprintf (fp,"#Per cycle\n");
+  fprintf (fp,"cycle\treads\tmeanQual\tq25\tmedian\tq75\tA\tC\tG\tT\tN\n");
+  for (i = 0; i < this1->cycleCnt && coverage[i] > 0; i++) {
+    counts = this1->baseCounts + 4 * i;
+    fprintf (fp,"%d\t%lld\t%.2f\t%d\t%d\t%d",i + 1,coverage[i],(double)this1->qualSums[i] / coverage[i],
+             fastqQc_quantile (this1->qualHist + FASTQ_QC_QUAL_BINS * i,coverage[i],0.25),
+             fastqQc_quantile (this1->qualHist + FASTQ_QC_QUAL_BINS * i,coverage[i],0.5),
+             fastqQc_quantile (this1->qualHist + FASTQ_QC_QUAL_BINS * i,coverage[i],0.75));
+    for (k = 0; k < 4; k++)
+      fprintf (fp,"\t%.4f",(double)counts[k] / coverage[i]);
+    fprintf (fp,"\t%.4f\n",(double)(coverage[i] - counts[0] - counts[1] - counts[2] - counts[3]) / coverage[i]);
+  }
+  fprintf (fp,"#Mean quality per read\n");
+  fprintf (fp,"meanQual\treads\n");
+  for (i = 0; i < FASTQ_QC_QUAL_BINS; i++)
+    if (this1->meanQualHist[i] > 0)
+      fprintf (fp,"%d\t%lld\n",i,this1->meanQualHist[i]);
+  fprintf (fp,"#GC content per read\n");
+  fprintf (fp,"gcPercent\treads\n");
+  for (i = 0; i < (int)NUMELE (this1->gcHist); i++)
+    fprintf (fp,"%d\t%lld\n",i,this1->gcHist[i]);
+  fprintf (fp,"#N per read\n");
+  fprintf (fp,"n\treads\n");
+  for (i = 0; i < (int)NUMELE (this1->nHist); i++)
+    fprintf (fp,"%d%s\t%lld\n",i,i == NUMELE (this1->nHist) - 1 ? "+" : "",this1->nHist[i]);
+  fprintf (fp,"#Length\n");
+  fprintf (fp,"length\treads\n");
+  for (i = 0; i < this1->cycleCnt; i++)
+    if (this1->lengthCounts[i] > 0)
+      fprintf (fp,"%d\t%lld\n",i + 1,this1->lengthCounts[i]);
+  hlr_free (coverage);
+}
+
+
+
+/**
+ * Destroy QC statistics.
+ * @note Do not call this function, but use the macro fastqQc_destroy
+ */
+void fastqQc_destroy_func (FastqQc this1)
+{
+  if (!this1)
+    return;
+  hlr_free (this1->lengthCounts);
+  hlr_free (this1->baseCounts);
+  hlr_free (this1->qualSums);
+  hlr_free (this1->qualHist);
+  hlr_free (this1->pendingBases);
+  hlr_free (this1->pendingQuals);
+  hlr_free (this1);
+}
@@ -0,0 +1,61 @@
+/**
+ *   \file fastqQc.h
+ */
+
+
+#ifndef DEF_FASTQ_QC_H
+#define DEF_FASTQ_QC_H
+
+
+#include <stdio.h>
+#include "fastq.h"
+
+
+/**
+ * Highest quality (Phred) that is kept apart; higher qualities are counted as this one.
+ */
+#define FASTQ_QC_MAX_QUAL 93
+
+
+
+/**
+ * FastqQc.
+ * Quality control statistics of a set of reads.
+ */
+typedef struct _fastqQcStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fastqQc module -- DO NOT access from outside
+     the fastqQc module */
+  int cycleCnt;                /* cycles allocated, a multiple of 32 */
+  long long readCnt;
+  long long *lengthCounts;     /* per cycle: reads that end there */
+  long long *baseCounts;       /* 4 per cycle: A, C, G, T */
+  long long *qualSums;         /* per cycle */
+  long long *qualHist;         /* FASTQ_QC_MAX_QUAL + 1 per cycle */
+  long long meanQualHist[FASTQ_QC_MAX_QUAL + 1];
+  long long gcHist[101];       /* by GC percent of the read */
+  long long nHist[11];         /* by number of N in the read, 10 means 10 or more */
+  unsigned char *pendingBases; /* 4 rows of cycleCnt 8-bit counters, see fastqQc_addRead() */
+  unsigned short *pendingQuals;
+  int pendingCnt;              /* reads in the pending counters */
+} *FastqQc;
+
+
+
+extern FastqQc fastqQc_create (void);
+extern void fastqQc_addRead (FastqQc this1, char *sequence, char *quality, int len);
+extern void fastqQc_add (FastqQc this1, Fastq *fq);
+extern void fastqQc_addBatch (FastqQc this1, FastqBatch batch);
+extern void fastqQc_merge (FastqQc this1, FastqQc other);
+extern long long fastqQc_readCountGet (FastqQc this1);
+extern void fastqQc_write (FastqQc this1, FILE *fp);
+extern void fastqQc_destroy_func (FastqQc this1); /* do not use this function */
+
+/**
+ * Destroy QC statistics.
+ * @see fastqQc_destroy_func()
+ */
+#define fastqQc_destroy(this1) (fastqQc_destroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -0,0 +1,297 @@
+/**
+ *   \file fastqTrim.c Module for adapter and quality trimming of FASTQ reads
+ */
+
+
+/*
+   Module fastqTrim
+   Trims reads in place: first low quality bases are removed from the
+   3' end (sliding window and/or Mott's algorithm as in BWA), then a 3'
+   adapter, which may be partial and contain mismatches, together with
+   everything behind it. Trimming only shortens the length and writes a
+   new terminating '\0', so it works directly on the buffers of a
+   FastqRecord or FastqBatch. The mismatch counting behind the adapter
+   search compares 16 bases at a time with SSE2.
+   A FastqTrimmer is not changed by trimming, so one trimmer can be used
+   by several threads at the same time.
+   Qualities are expected in Phred+33 encoding.
+*/
+
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "fastqTrim.h"
+
+
+
+/**
+ * Create a trimmer that does nothing; switch on the steps wanted with
+   fastqTrim_adapterSet(), fastqTrim_windowSet(), fastqTrim_mottSet() and fastqTrim_minLengthSet().
+ */
+FastqTrimmer fastqTrim_create (void)
+{
+  FastqTrimmer this1 = (FastqTrimmer) hlr_malloc (sizeof (struct _fastqTrimmerStruct_));
+
+  this1->adapter = NULL;
+  this1->adapterLen = 0;
+  this1->maxErrorRate = 0.0;
+  this1->minOverlap = 1;
+  this1->windowSize = 0;
+  this1->windowQual = 0;
+  this1->mottQual = -1;
+  this1->minLength = 0;
+  return this1;
+}
+
+
+
+/**
+ * Trim a 3' adapter.
+ * @param[in] this1 A trimmer
+ * @param[in] adapter Adapter sequence, e.g. AGATCGGAAGAGC for Illumina TruSeq
+ * @param[in] maxErrorRate Mismatches allowed per base of the overlap between read and adapter, e.g. 0.1
+ * @param[in] minOverlap Minimum number of adapter bases at the 3' end of a read to trim them, e.g. 3
+ */
+void fastqTrim_adapterSet (FastqTrimmer this1, char *adapter, double maxErrorRate, int minOverlap)
+{
+  int i;
+
+  hlr_free (this1->adapter);
+  this1->adapter = hlr_strdup (adapter);
+  this1->adapterLen = strlen (adapter);
+  for (i = 0; i < this1->adapterLen; i++)
+    this1->adapter[i] = toupper (this1->adapter[i]);
+  this1->maxErrorRate = maxErrorRate;
+  this1->minOverlap = MAX (minOverlap,1);
+}
+
+
+
+/**
+ * Cut a read at the first window of windowSize bases whose mean quality is below minMeanQual 
+   (like SLIDINGWINDOW of Trimmomatic).
+ */
+void fastqTrim_windowSet (FastqTrimmer this1, int windowSize, int minMeanQual)
+{
+  this1->windowSize = windowSize;
+  this1->windowQual = minMeanQual;
+}
+
+
+
+/**
+ * Trim the 3' end with Mott's algorithm (like bwa aln -q and cutadapt -q).
+ * @param[in] this1 A trimmer
+ * @param[in] threshold Quality threshold; -1 switches Mott trimming off
+ */
+void fastqTrim_mottSet (FastqTrimmer this1, int threshold)
+{
+  this1->mottQual = threshold;
+}
+
+
+
+/**
+ * Reject reads that are shorter than minLength after trimming.
+ */
+void fastqTrim_minLengthSet (FastqTrimmer this1, int minLength)
+{
+  this1->minLength = minLength;
+}
+
+
+
+/*
+ * Number of positions where read and adapter (upper case) differ; N in the read matches 
+ * any base. Counting stops as soon as more than maxMismatches are found.
+ */
+static int fastqTrim_mismatches (char *read, char *adapter, int n, int maxMismatches)
+{
+  int mismatches = 0;
+  int i = 0;
+  char c;
+#if defined (__SSE2__)
+  __m128i upper = _mm_set1_epi8 ((char)0xDF);
+  __m128i nBase = _mm_set1_epi8 ('N');
+  __m128i r,match;
+
+  for (; i + 16 <= n; i += 16) {
+    r = _mm_and_si128 (_mm_loadu_si128 ((__m128i *)(read + i)),upper);
+    match = _mm_or_si128 (_mm_cmpeq_epi8 (r,_mm_loadu_si128 ((__m128i *)(adapter + i))),
+                          _mm_cmpeq_epi8 (r,nBase));
+    mismatches += 16 - __builtin_popcount (_mm_movemask_epi8 (match));
+    if (mismatches > maxMismatches)
+      return mismatches;
+  }
+#endif
+  for (; i < n; i++) {
+    c = read[i] & 0xDF;
+    if (c != adapter[i] && c != 'N' && ++mismatches > maxMismatches)
+      break;
+  }
+  return mismatches;
+}
+
+
+
+/**
+ * Find a 3' adapter in a read.
+ * The adapter is searched from the 5' end of the read on; it may run over the 3' end of 
+   the read, i.e. only a prefix of it may be present. Only mismatches are allowed, no indels.
+ * @param[in] sequence Bases of the read
+ * @param[in] len Number of bases
+ * @param[in] adapter Adapter, upper case
+ * @param[in] adapterLen Length of adapter
+ * @param[in] maxErrorRate Mismatches allowed per base of overlap
+ * @param[in] minOverlap Minimum overlap between read and adapter
+ * @return Position where the adapter starts, len if it was not found
+ */
+int fastqTrim_adapterFind (char *sequence, int len, char *adapter, int adapterLen, 
+                           double maxErrorRate, int minOverlap)
+{
+  int overlap;
+  int maxMismatches;
+  int pos;
+
+  for (pos = 0; pos + minOverlap <= len; pos++) {
+    overlap = MIN (adapterLen,len - pos);
+    maxMismatches = (int)(maxErrorRate * overlap);
+    if (fastqTrim_mismatches (sequence + pos,adapter,overlap,maxMismatches) <= maxMismatches)
+      return pos;
+  }
+  return len;
+}
+
+
+
+/**
+ * Find where a sliding window of windowSize bases first has a mean quality below minMeanQual.
+ * @return Length of the read to keep: the start of that window, len if there is none
+ */
+int fastqTrim_windowFind (char *quality, int len, int windowSize, int minMeanQual)
+{
+  int minSum;
+  int sum = 0;
+  int i;
+
+  if (windowSize > len)
+    windowSize = len;
+  minSum = minMeanQual * windowSize;
+  for (i = 0; i < windowSize; i++)
+    sum += quality[i] - '!';
+  for (i = 0; ; i++) {
+    if (sum < minSum)
+      return i;
+    if (i + windowSize >= len)
+      return len;
+    sum += quality[i + windowSize] - quality[i];
+  }
+}
+
+
+
+/**
+ * Find where to cut the 3' end with Mott's algorithm: the position from which on 
+   the sum of (threshold - quality) is maximal.
+ * @return Length of the read to keep
+ */
+int fastqTrim_mottFind (char *quality, int len, int threshold)
+{
+  int sum = 0;
+  int maxSum = 0;
+  int keep = len;
+  int i;
+
+  for (i = len - 1; i >= 0; i--) {
+    sum += threshold - (quality[i] - '!');
+    if (sum < 0)
+      break;
+    if (sum > maxSum) {
+      maxSum = sum;
+      keep = i;
+    }
+  }
+  return keep;
+}
+
+
+
+/**
+ * Compute the length of a read after trimming, without changing it.
+ * @param[in] this1 A trimmer
+ * @param[in] sequence Bases of the read
+ * @param[in] quality Qualities of the read, Phred+33; may be NULL to trim only adapters
+ * @param[in] len Number of bases
+ * @return New length, -1 if the read is shorter than the minimum length
+ */
+int fastqTrim_length (FastqTrimmer this1, char *sequence, char *quality, int len)
+{
+  if (quality && this1->windowSize > 0 && len > 0)
+    len = fastqTrim_windowFind (quality,len,this1->windowSize,this1->windowQual);
+  if (quality && this1->mottQual >= 0)
+    len = fastqTrim_mottFind (quality,len,this1->mottQual);
+  if (this1->adapter)
+    len = fastqTrim_adapterFind (sequence,len,this1->adapter,this1->adapterLen,
+                                 this1->maxErrorRate,this1->minOverlap);
+  return len < this1->minLength ? -1 : len;
+}
+
+
+
+/**
+ * Trim a record in place.
+ * @param[in] this1 A trimmer
+ * @param[in,out] rec A record, e.g. from fastq_readerNextRecord() or fastq_batchRecordGet()
+ * @return 1 if the record should be kept, 0 if it is shorter than the minimum length 
+   (it is trimmed nevertheless)
+ */
+int fastqTrim_record (FastqTrimmer this1, FastqRecord *rec)
+{
+  int len = fastqTrim_length (this1,rec->sequence,rec->quality,MIN (rec->seqLen,rec->qualLen));
+  int keep = len >= 0;
+
+  if (len < 0)
+    len = 0;
+  rec->seqLen = rec->qualLen = len;
+  rec->sequence[len] = '\0';
+  rec->quality[len] = '\0';
+  return keep;
+}
+
+
+
+/**
+ * Trim a Fastq in place.
+ * @see fastqTrim_record()
+ */
+int fastqTrim_fastq (FastqTrimmer this1, Fastq *fq)
+{
+  int len = fastqTrim_length (this1,fq->seq->sequence,fq->quality,fq->seq->size);
+  int keep = len >= 0;
+
+  if (len < 0)
+    len = 0;
+  fq->seq->size = len;
+  fq->seq->sequence[len] = '\0';
+  if (fq->quality)
+    fq->quality[len] = '\0';
+  return keep;
+}
+
+
+
+/**
+ * Destroy a trimmer.
+ * @note Do not call this function, but use the macro fastqTrim_destroy
+ */
+void fastqTrim_destroy_func (FastqTrimmer this1)
+{
+  if (!this1)
+    return;
+  hlr_free (this1->adapter);
+  hlr_free (this1);
+}
@@ -0,0 +1,54 @@
+/**
+ *   \file fastqTrim.h
+ */
+
+
+#ifndef DEF_FASTQ_TRIM_H
+#define DEF_FASTQ_TRIM_H
+
+
+#include "fastq.h"
+
+
+/**
+ * FastqTrimmer.
+ * Settings for trimming reads; see fastqTrim_create().
+ */
+typedef struct _fastqTrimmerStruct_ {
+  /* the members of this struct are PRIVATE for the
+     fastqTrim module -- DO NOT access from outside
+     the fastqTrim module */
+  char *adapter;          /* upper case; NULL if adapters are not trimmed */
+  int adapterLen;
+  double maxErrorRate;    /* mismatches allowed per base of overlap */
+  int minOverlap;
+  int windowSize;         /* 0 if sliding window trimming is off */
+  int windowQual;
+  int mottQual;           /* -1 if Mott trimming is off */
+  int minLength;
+} *FastqTrimmer;
+
+
+
+extern FastqTrimmer fastqTrim_create (void);
+extern void fastqTrim_adapterSet (FastqTrimmer this1, char *adapter, double maxErrorRate, int minOverlap);
+extern void fastqTrim_windowSet (FastqTrimmer this1, int windowSize, int minMeanQual);
+extern void fastqTrim_mottSet (FastqTrimmer this1, int threshold);
+extern void fastqTrim_minLengthSet (FastqTrimmer this1, int minLength);
+extern int fastqTrim_adapterFind (char *sequence, int len, char *adapter, int adapterLen, 
+                                  double maxErrorRate, int minOverlap);
+extern int fastqTrim_windowFind (char *quality, int len, int windowSize, int minMeanQual);
+extern int fastqTrim_mottFind (char *quality, int len, int threshold);
+extern int fastqTrim_length (FastqTrimmer this1, char *sequence, char *quality, int len);
+extern int fastqTrim_record (FastqTrimmer this1, FastqRecord *rec);
+extern int fastqTrim_fastq (FastqTrimmer this1, Fastq *fq);
+extern void fastqTrim_destroy_func (FastqTrimmer this1); /* do not use this function */
+
+/**
+ * Destroy a trimmer.
+ * @see fastqTrim_destroy_func()
+ */
+#define fastqTrim_destroy(this1) (fastqTrim_destroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -73,12 +73,18 @@
 #define hlr_mallocExtern() 
 
 #else
-  /* count allocations and check for allocation success */ 
-#define hlr_free(x)  ((x) ? free(x), --hlr_allocCnt, x=0, 1 : 0)
-#define hlr_strdup(s) (++hlr_allocCnt, hlr_strdups(s)) 
-#define hlr_malloc(n) (++hlr_allocCnt, hlr_mallocs(n)) 
-#define hlr_mallocExtern() (++hlr_allocCnt)
-#define hlr_calloc(nelem,elsize)  (++hlr_allocCnt, hlr_callocs(nelem,elsize))
+  /* count allocations and check for allocation success;
+     the count is updated atomically, so threads may allocate, too */ 
+#ifdef __GNUC__
+#define hlr_allocCntAdd(d) __sync_add_and_fetch(&hlr_allocCnt, (d))
+#else
+#define hlr_allocCntAdd(d) (hlr_allocCnt += (d))
+#endif
+#define hlr_free(x)  ((x) ? free(x), hlr_allocCntAdd(-1), x=0, 1 : 0)
+#define hlr_strdup(s) (hlr_allocCntAdd(1), hlr_strdups(s)) 
+#define hlr_malloc(n) (hlr_allocCntAdd(1), hlr_mallocs(n)) 
+#define hlr_mallocExtern() hlr_allocCntAdd(1)
+#define hlr_calloc(nelem,elsize)  (hlr_allocCntAdd(1), hlr_callocs(nelem,elsize))
 #endif
 
 #define hlr_realloc realloc
@@ -1203,7 +1203,7 @@ char *html_tab2table(char *tab, int firstLineIsHeader, int borderWidth, int with
 /** 
  * Like html_tab2table(), but allows for several tables separted by lines not containing a tab character.
  * Inputs: same as for html_text2tables()
- * Output: contents of 'tab' destroyed
+ * Output: contents of 'tab' unchanged
  * @return A buffer containing an HTML formatted table; read/write access OK; memory managed by this routine.
  * @note Input format: one or more table sections can be embedded in normal text; the beginning and end of 
    these sections is determined automatically (lines in tables contain at least one tab);
@@ -1238,7 +1238,7 @@ char *html_text2tables (char *tab,int firstLineIsHeader,int borderWidth, int wit
 
   stringCreateClear (html,1000);
   stringCreateClear (tabbuf, 1000);
-  ls = ls_createFromBuffer (tab);
+  ls = ls_createFromConstBuffer (tab,strlen (tab));
   while (line = ls_nextLine (ls)) {
     if (line[0] == '\0')
       continue;
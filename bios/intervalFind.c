@@ -141,13 +141,11 @@ void intervalFind_parseLine (Interval *thisInterval, char* line, int source)
 
 
 
-static void parseFileContent (Array theseIntervals, char* fileName, int source)
+static void parseLineStream (Array theseIntervals, LineStream ls, int source)
 {
-  LineStream ls;
   char *line;
   Interval *currInterval;
 
-  ls = ls_createFromFile (fileName);
   while (line = ls_nextLine (ls)) {
     if (line[0] == '\0') {
       continue;
@@ -155,11 +153,40 @@ static void parseFileContent (Array theseIntervals, char* fileName, int source)
     currInterval = arrayp (theseIntervals,arrayMax (theseIntervals),Interval);
     intervalFind_parseLine (currInterval,line,source);
   }
+}
+
+
+
+static void parseFileContent (Array theseIntervals, char* fileName, int source)
+{
+  LineStream ls;
+
+  ls = ls_createFromFile (fileName);
+  parseLineStream (theseIntervals,ls,source);
   ls_destroy (ls);
 }
 
 
 
+typedef struct {
+  int source;
+  Array parts;  // of Array of Interval, one per range
+} ParallelParse;
+
+
+
+static void parseRange (LineStream ls, int rangeIndex, void *arg)
+{
+  ParallelParse *pp = (ParallelParse *)arg;
+  Array part;
+
+  part = arrayCreate (10000,Interval);
+  parseLineStream (part,ls,pp->source);
+  arru (pp->parts,rangeIndex,Array) = part;
+}
+
+
+
 /**
  * Add intervals to the search space. 
  * @param[in] fileName File name of the file that contains the interval and subintervals to search against. 
@@ -216,6 +243,46 @@ Array intervalFind_parseFile (char* fileName, int source)
 
 
 
+/**
+ * Parse a file in the Interval format on several threads. 
+ * @param[in] fileName Name of a plain or BGZF compressed file that contains the interval and subintervals (not stdin).\n
+ * @param[in] source An integer that specifies the source. This is useful when multiple files are used.
+ * @param[in] nThreads Number of threads, see threadPool_cpuCount()
+ * @return Array of intervals, in the same order as intervalFind_parseFile() returns them. 
+   The user is responsible to free up the memory. The user can modify the returned Array. 
+ * @pre None.
+*/
+Array intervalFind_parseFileParallel (char* fileName, int source, int nThreads)
+{
+  Array theseIntervals;
+  Array part;
+  ParallelParse pp;
+  int nRanges;
+  int i,j;
+
+  pp.source = source;
+  pp.parts = arrayCreate (nThreads,Array);
+  for (i = 0; i < nThreads; i++) {
+    array (pp.parts,i,Array) = NULL;  // parseRange() must not grow the Array
+  }
+  nRanges = ls_parallel (fileName,nThreads,NULL,parseRange,&pp);
+  if (nRanges < 0) {
+    die ("intervalFind_parseFileParallel: %s",warnReport ());
+  }
+  theseIntervals = arrayCreate (100000,Interval);
+  for (i = 0; i < nRanges; i++) {
+    part = arru (pp.parts,i,Array);
+    for (j = 0; j < arrayMax (part); j++) {
+      array (theseIntervals,arrayMax (theseIntervals),Interval) = arru (part,j,Interval);
+    }
+    arrayDestroy (part);
+  }
+  arrayDestroy (pp.parts);
+  return theseIntervals;
+}
+
+
+
 static int sortIntervalsByChromosomeAndStartAndEnd (Interval *a, Interval *b)
 {
   int diff;
@@ -42,6 +42,7 @@ extern int intervalFind_getNumberOfIntervals (void);
 extern Array intervalFind_getAllIntervals (void);
 extern Array intervalFind_getIntervalPointers (void);
 extern Array intervalFind_parseFile (char* fileName, int source);
+extern Array intervalFind_parseFileParallel (char* fileName, int source, int nThreads);
 extern void intervalFind_parseLine (Interval *thisInterval, char* line, int source);
 extern char* intervalFind_writeInterval (Interval *currInterval);
 extern int intervalFind_getSize (Interval *currInterval);
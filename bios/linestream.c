@@ -38,6 +38,12 @@
    Module lineStream
    Transparent way to read lines from a file, pipe or buffer
    The lines always come without \n at the end
+   A file can also be split into ranges (ls_splitFile()) which are
+   read by separate line streams, e.g. on several threads (ls_parallel())
+   A sidecar index of line offsets (ls_indexCreate()) allows to jump 
+   to a line number (ls_seekLine()) in plain and BGZF files
+   Optionally, line streams count bytes, lines and the time spent
+   waiting for input (ls_statsEnable(), ls_statsEnableAll())
 */
 
 
@@ -47,6 +53,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
 #include PLABLA_INCLUDE_IO_UNISTD
 
 #include "log.h"
@@ -55,16 +64,101 @@
 #include "linestream.h"
 
 
+
+#define LS_BLOCK_SIZE 65536
+#define LS_INDEX_MAGIC "LSI\1"
+
+
 static char *nextLineFile (LineStream this1);
 static char *nextLinePipe (LineStream this1);
 static char *nextLineBuffer (LineStream this1);
+static char *nextLineBgzf (LineStream this1);
+static char *nextLineConst (LineStream this1);
 static void register_nextLine (LineStream this1,char *(*f)(LineStream this1));
+static void blockInit (LineStream this1);
+static char *nextLineBlock (LineStream this1);
+static void readAheadStart (LineStream this1, int nBuffers, int bufSize);
+static void readAheadStop (LineStream this1);
+static void streamSeek (LineStream this1, long long pos);
+static void statsLine (LsStats *stats, int len);
+static void statsTotalAdd (LineStream this1);
+static char *statsFormat (char *label, LsStats *stats);
+
+
+static int statsAll = 0 ;        /* ls_statsEnableAll() */
+static int statsAllLog = 0 ;
+static Array statsTotals = NULL ; /* of LsStatsTotal, guarded by statsLock */
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER ;
+
+typedef struct {
+  char *label ;
+  LsStats stats ;
+} LsStatsTotal ;
+
+
+static LineStream lineStreamAlloc (void)
+{ /* allocates a line stream with all members in their neutral state */
+  LineStream this1;
+
+  this1 = (LineStream) hlr_malloc (sizeof (struct _lineStreamStruct_));
+  this1->fp = NULL;
+  this1->line = NULL;
+  this1->lineLen = 0;
+  this1->lineSize = 0;
+  this1->cbuf = NULL;
+  this1->cbufLen = 0;
+  this1->cbufPos = 0;
+  this1->wi = NULL;
+  this1->count = 0;
+  this1->status = 0;
+  this1->eof = 0;
+  this1->nextLine_hook = NULL;
+  this1->history = NULL;
+  this1->historySize = 0;
+  this1->historyCnt = 0;
+  this1->historyNext = 0;
+  this1->backCnt = 0;
+  this1->bgzf = NULL;
+  this1->blk = NULL;
+  this1->fill_hook = NULL;
+  this1->readAhead = NULL;
+  this1->filePos = 0;
+  this1->fillPos = 0;
+  this1->rangeEnd = -1;
+  this1->index = NULL;
+  this1->stats = NULL;
+  this1->statsLabel = NULL;
+  this1->statsLog = 0;
+  if (statsAll)
+    ls_statsEnable (this1,statsAllLog);
+  return this1;
+}
+
+
+
+static int fillFd (LineStream this1, char *buf, int n)
+{ /* reads from the file descriptor underlying 'fp'; unlike fread() this
+     returns as soon as some input is available, which matters for
+     terminals and pipes */
+  int got ;
+
+  while ((got = read (fileno (this1->fp),buf,n)) < 0 && errno == EINTR) 
+    ;
+  if (got < 0)
+    die ("linestream: read error: %s",strerror (errno)) ;
+  this1->fillPos = this1->filePos ;
+  this1->filePos += got ;
+  return got ;
+}
+
 
 
 /**
  * Creates a line stream from a file.
  * @param[in] fn File name ("-" means stdin)
  * @return  A line stream object, NULL if file could not been opened; to learn details call warnReport() from module log.c
+ * @note The file is read in blocks directly from its file descriptor; when reading stdin, 
+   do not read from stdin via stdio functions before creating the line stream.
  */
 LineStream ls_createFromFile (const char *fn)
 { 
@@ -72,10 +166,7 @@ LineStream ls_createFromFile (const char *fn)
 
   if (!fn)
     die ("ls_createFromFile: no file name given");
-  this1 = (LineStream) hlr_malloc (sizeof (struct _lineStreamStruct_));
-  this1->line = NULL;
-  this1->count = 0;
-  this1->status = 0;
+  this1 = lineStreamAlloc ();
   if (strcmp (fn,"-") == 0)
     this1->fp = stdin;
   else
@@ -83,11 +174,13 @@ LineStream ls_createFromFile (const char *fn)
   if (!this1->fp) {
     warnAdd("ls_createFromFile", 
             stringPrintBuf("'%s': %s", fn, strerror(errno))) ;
+    hlr_free (this1->stats);
     hlr_free (this1);
     return NULL;
   }
   register_nextLine (this1,nextLineFile);
-  this1->buffer = NULL ;
+  this1->fill_hook = fillFd ;
+  blockInit (this1) ;
   return this1;
 }
 
@@ -102,22 +195,21 @@ LineStream ls_createFromFile (const char *fn)
  */
 static char *nextLineFile (LineStream this1)
 { 
-  int ll;
+  char *line;
 
   if (!this1)
     die ("nextLineFile: NULL LineStream");
-  if (!(ll = getLine (this1->fp,&this1->line,&this1->lineLen))) {
-    fclose (this1->fp);
-    this1->fp = NULL;
-    hlr_free (this1->line);
+  if (!this1->fp || this1->eof)
     return NULL;
+  if (!(line = nextLineBlock (this1))) {
+    readAheadStop (this1);
+    this1->eof = 1;
+    if (!this1->index) { /* else keep the file open for ls_seekLine() */
+      fclose (this1->fp);
+      this1->fp = NULL;
+    }
   }
-  if (ll > 1 && this1->line[ll-2] == '\r')
-    this1->line[ll-2] = '\0';
-  else if (ll > 0 && this1->line[ll-1] == '\n')
-    this1->line[ll-1] = '\0';
-  this1->count++;
-  return this1->line;
+  return line;
 }
 
 
@@ -135,18 +227,19 @@ LineStream ls_createFromPipe (char *command)
 
   if (!command)
     die ("ls_createFromPipe: no command given");
-  this1 = (LineStream) hlr_malloc (sizeof (struct _lineStreamStruct_));
-  this1->line = NULL;
-  this1->count = 0;
+  this1 = lineStreamAlloc ();
   this1->status = -2;  /* undetermined */
   this1->fp = PLABLA_POPEN (command,"r");
   if (!this1->fp) {
     warnAdd("ls_createFromPipe", 
             stringPrintBuf("'%s': %s", command, strerror(errno))) ;
+    hlr_free (this1->stats);
+    hlr_free (this1);
     return NULL;
   }
   register_nextLine (this1,nextLinePipe);
-  this1->buffer = NULL ;
+  this1->fill_hook = fillFd ;
+  blockInit (this1) ;
   return this1;
 }
 
@@ -160,22 +253,19 @@ static char *nextLinePipe (LineStream this1)
      output: the line
              NULL if no further line was found
   */
-  int ll;
+  char *line;
 
   if (!this1)
     die ("nextLinePipe: NULL LineStream");
-  if (!(ll = getLine (this1->fp,&this1->line,&this1->lineLen))) {
+  if (!this1->fp)
+    return NULL;
+  if (!(line = nextLineBlock (this1))) {
+    readAheadStop (this1);
     this1->status = PLABLA_PCLOSE (this1->fp);
     this1->fp = NULL;
-    hlr_free (this1->line);
-    return NULL;
+    this1->eof = 1;
   }
-  if (ll > 1 && this1->line[ll-2] == '\r')
-    this1->line[ll-2] = '\0';
-  else if (ll > 0 && this1->line[ll-1] == '\n')
-    this1->line[ll-1] = '\0';
-  this1->count++;
-  return this1->line;
+  return line;
 }
 
 
@@ -203,12 +293,9 @@ LineStream ls_createFromBuffer (char *buffer)
   else
     manySepsAreOne = 1 ; /* immediately return NULL */
       
-  this1 = (LineStream) hlr_malloc (sizeof (struct _lineStreamStruct_));
-  this1->count = 0;
-  this1->status = 0;
+  this1 = lineStreamAlloc ();
   this1->wi = wordIterCreate(buffer,"\n", manySepsAreOne);
   register_nextLine (this1,nextLineBuffer);
-  this1->buffer = NULL ;
   return this1;
 }
 
@@ -227,19 +314,1140 @@ static char *nextLineBuffer (LineStream this1)
 
   if (!this1)
     die ("nextLineFile: NULL LineStream");
+  if (this1->eof)
+    return NULL;
   s = wordNextG(this1->wi, &len) ;
   if (!s) {
     wordIterDestroy (this1->wi);
+    this1->eof = 1;
     return NULL;
   }
   this1->count++;
   if (len && s[len-1] == '\r')
-    s[len-1] = '\0' ;
+    s[--len] = '\0' ;
+  this1->lineLen = len;
+  if (this1->stats)
+    statsLine (this1->stats,len) ;
   return s;
 }
 
 
 
+/**
+ * Creates a line stream from a read-only buffer.
+ * Unlike ls_createFromBuffer(), the buffer is neither modified nor scanned up front, and it need not be null-terminated.
+ * @param[in] buffer A buffer pointer, e.g. a memory-mapped file or a HTTP request body; must stay valid as long as the line stream 
+ * @param[in] len Number of bytes in the buffer
+ * @return A line stream object
+ * @note ls_nextLineView() returns the lines without copying them. ls_nextLine() copies each line into 
+   memory of the line stream, to be able to null-terminate it; then the line is valid until the next call.
+   ls_bufferSet() and ls_nextBatch() cannot be used.
+ */
+LineStream ls_createFromConstBuffer (const char *buffer, size_t len)
+{ 
+  LineStream this1;
+
+  if (!buffer && len) 
+    die ("ls_createFromConstBuffer: NULL buffer");
+  this1 = lineStreamAlloc ();
+  this1->cbuf = buffer;
+  this1->cbufLen = len;
+  this1->cbufPos = 0;
+  register_nextLine (this1,nextLineConst);
+  return this1;
+}
+
+
+
+static int nextViewConst (LineStream this1, LineView *view)
+{ /* finds the next line of a read-only buffer; memchr() scans 
+     for the newline a machine word or vector at a time.
+     output: 1 and the line (not null-terminated) in 'view', 
+             0 if there is no further line
+  */
+  const char *s ;
+  const char *nl ;
+  size_t rest ;
+  int len ;
+
+  if (this1->eof || this1->cbufPos >= this1->cbufLen) {
+    this1->eof = 1 ;
+    return 0 ;
+  }
+  s = this1->cbuf + this1->cbufPos ;
+  rest = this1->cbufLen - this1->cbufPos ;
+  if ((nl = memchr (s,'\n',rest)) != NULL) {
+    len = nl - s ;
+    this1->cbufPos += len + 1 ;
+  }
+  else {
+    len = rest ;
+    this1->cbufPos = this1->cbufLen ;
+  }
+  if (len > 0 && s[len-1] == '\r')
+    len-- ;
+  view->line = (char *)s ;
+  view->len = len ;
+  this1->lineLen = len ;
+  this1->count++ ;
+  if (this1->stats) {
+    statsLine (this1->stats,len) ;
+    this1->stats->bytes += this1->cbufPos - (s - this1->cbuf) ;
+  }
+  return 1 ;
+}
+
+
+
+static char *nextLineConst (LineStream this1)
+{ /* returns a null-terminated copy of the next line */
+  LineView view ;
+
+  if (!nextViewConst (this1,&view))
+    return NULL ;
+  if (view.len + 1 > this1->lineSize) {
+    hlr_free (this1->line) ;
+    this1->lineSize = MAX (view.len + 1,2 * this1->lineSize) ;
+    this1->line = hlr_malloc (this1->lineSize) ;
+  }
+  memcpy (this1->line,view.line,view.len) ;
+  this1->line[view.len] = '\0' ;
+  return this1->line ;
+}
+
+
+
+/**
+ * Get the next line as pointer and length.
+ * For line streams from ls_createFromConstBuffer() this avoids any copying; the line then 
+   points into the caller's buffer, is not null-terminated and must not be modified. For all
+   other line streams this is ls_nextLine() plus the length of the line.
+ * @param[in] this1 A line stream 
+ * @param[out] view The line
+ * @return 1 if there was a line, 0 at the end of the line stream
+ */
+int ls_nextLineView (LineStream this1, LineView *view)
+{ 
+  if (this1->nextLine_hook == nextLineConst)
+    return nextViewConst (this1,view) ;
+  if (!(view->line = ls_nextLine (this1)))
+    return 0 ;
+  view->len = this1->historySize ? (int)strlen (view->line) : this1->lineLen ;
+  return 1 ;
+}
+
+
+
+static void statsLine (LsStats *stats, int len)
+{
+  stats->lines++ ;
+  stats->lineBytes += len ;
+  if (len > stats->maxLineLen)
+    stats->maxLineLen = len ;
+}
+
+
+
+static double statsClock (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC,&ts) ;
+  return ts.tv_sec + ts.tv_nsec * 1e-9 ;
+}
+
+
+
+static int statsFill (LineStream this1, char *buf, int n)
+{ /* fill_hook, timed */
+  double start = statsClock () ;
+
+  n = this1->fill_hook (this1,buf,n) ;
+  this1->stats->readSeconds += statsClock () - start ;
+  this1->stats->refills++ ;
+  if (n > 0)
+    this1->stats->bytes += n ;
+  return n ;
+}
+
+
+
+static void blockInit (LineStream this1)
+{ /* (re)starts splitting lines from an empty block */
+  if (!this1->blk) {
+    this1->blkSize = LS_BLOCK_SIZE ;
+    this1->blk = hlr_malloc (this1->blkSize) ;
+  }
+  this1->blkPos = 0 ;
+  this1->blkLen = 0 ;
+  this1->blkEof = 0 ;
+  if (this1->index && this1->index->chunks)
+    arrayClear (this1->index->chunks) ;
+}
+
+
+
+/* While an index is built, the block remembers where its pieces came
+   from (one chunk per fill_hook call), so that the offset of each line
+   can be computed -- also for BGZF files, where consecutive blocks do
+   not have consecutive virtual offsets */
+
+typedef struct {
+  int at ;         /* index in 'blk' */
+  long long pos ;  /* file offset or virtual offset of blk[at] */
+} LsChunk ;
+
+
+
+static void chunkAdd (LineStream this1, int at)
+{
+  LsChunk *chunk = arrayp (this1->index->chunks,arrayMax (this1->index->chunks),LsChunk) ;
+
+  chunk->at = at ;
+  chunk->pos = this1->fillPos ;
+}
+
+
+
+static void chunkShift (LineStream this1, int removed)
+{ /* the first 'removed' bytes of the block were discarded */
+  Array chunks = this1->index->chunks ;
+  int i,k ;
+
+  for (k = 0; k + 1 < arrayMax (chunks) && arrp (chunks,k + 1,LsChunk)->at <= removed; k++)
+    ;
+  for (i = k; i < arrayMax (chunks); i++) {
+    *arrp (chunks,i - k,LsChunk) = *arrp (chunks,i,LsChunk) ;
+    arrp (chunks,i - k,LsChunk)->at -= removed ;
+  }
+  arraySetMax (chunks,arrayMax (chunks) - k) ;
+}
+
+
+
+static long long chunkPos (LineStream this1, int at)
+{ /* offset of blk[at] */
+  Array chunks = this1->index->chunks ;
+  LsChunk *chunk ;
+  int k ;
+
+  for (k = arrayMax (chunks) - 1; k > 0; k--)
+    if (arrp (chunks,k,LsChunk)->at <= at)
+      break ;
+  chunk = arrp (chunks,k,LsChunk) ;
+  return chunk->pos + (at - chunk->at) ;
+}
+
+
+
+static char *historyOldest (LineStream this1)
+{ /* returns the oldest line ls_back() may still return, NULL if none */
+  int n = this1->historySize ;
+  int k ;
+  char *line ;
+
+  for (k = this1->historyCnt; k > 0; k--)
+    if ((line = this1->history[(this1->historyNext - k + n) % n]) != NULL)
+      return line ;
+  return NULL ;
+}
+
+
+
+static void historyRebase (LineStream this1, char *oldBase, char *newBase)
+{ /* the lines remembered for ls_back() were moved from oldBase to newBase */
+  int i ;
+
+  for (i = 0; i < this1->historySize; i++)
+    if (this1->history[i])
+      this1->history[i] = newBase + (this1->history[i] - oldBase) ;
+}
+
+
+
+static void blockResize (LineStream this1, int size)
+{ /* enlarges the block, keeping its contents */
+  char *blk = hlr_malloc (size) ;
+
+  memcpy (blk,this1->blk,this1->blkLen) ;
+  historyRebase (this1,this1->blk,blk) ;
+  hlr_free (this1->blk) ;
+  this1->blk = blk ;
+  this1->blkSize = size ;
+}
+
+
+
+static int blockFill (LineStream this1)
+{ /* makes sure that a complete line starts at 'blkPos', calling 
+     'fill_hook' to get more input whenever the block holds no 
+     complete line. At the end of the input, the last line need not 
+     end with \n.
+     input: line stream object
+     output: length of the line without \n,
+             -1 if there is no further line
+  */
+  char *s ;
+  char *nl ;
+  int len ;
+  int n ;
+  int keep ;
+  char *oldest ;
+
+  for (;;) {
+    s = this1->blk + this1->blkPos ;
+    len = this1->blkLen - this1->blkPos ;
+    if ((nl = memchr (s,'\n',len)) != NULL)
+      return nl - s ;
+    if (this1->blkEof)
+      return len ? len : -1 ;
+    /* move the incomplete line, and the lines ls_back() may still 
+       return, to the front and get more input; always keep one byte 
+       for terminating a last line without \n */
+    oldest = historyOldest (this1) ;
+    keep = oldest ? MIN (oldest - this1->blk,this1->blkPos) : this1->blkPos ;
+    if (keep > 0) {
+      memmove (this1->blk,this1->blk + keep,this1->blkLen - keep) ;
+      historyRebase (this1,this1->blk + keep,this1->blk) ;
+      if (this1->index && this1->index->chunks)
+        chunkShift (this1,keep) ;
+      this1->blkPos -= keep ;
+      this1->blkLen -= keep ;
+    }
+    if (this1->blkLen + 1 >= this1->blkSize)
+      blockResize (this1,this1->blkSize * 2) ;
+    if (this1->stats)
+      n = statsFill (this1,this1->blk + this1->blkLen,this1->blkSize - this1->blkLen - 1) ;
+    else
+      n = this1->fill_hook (this1,this1->blk + this1->blkLen,this1->blkSize - this1->blkLen - 1) ;
+    if (n <= 0)
+      this1->blkEof = 1 ;
+    else {
+      if (this1->index && this1->index->chunks)
+        chunkAdd (this1,this1->blkLen) ;
+      this1->blkLen += n ;
+    }
+  }
+}
+
+
+
+static char *blockTake (LineStream this1, int *lenP)
+{ /* takes the line of length *lenP starting at 'blkPos' and 
+     terminates it in place; a trailing \r is removed.
+     output: the line, pointing into the block; *lenP adjusted
+  */
+  char *s = this1->blk + this1->blkPos ;
+  int len = *lenP ;
+
+  if (this1->index && this1->index->chunks && this1->count % this1->index->every == 0)
+    array (this1->index->offsets,arrayMax (this1->index->offsets),long long) = 
+      chunkPos (this1,this1->blkPos) ;
+  this1->blkPos = MIN (this1->blkPos + len + 1,this1->blkLen) ;
+  s[len] = '\0' ;
+  if (len > 0 && s[len-1] == '\r')
+    s[--len] = '\0' ;
+  this1->count++ ;
+  this1->lineLen = len ;
+  if (this1->stats)
+    statsLine (this1->stats,len) ;
+  *lenP = len ;
+  return s ;
+}
+
+
+
+static char *nextLineBlock (LineStream this1)
+{ /* returns the next line from the block, NULL if no further line 
+     was found. The line can be of any length; a trailing \n or \r\n
+     is removed. */
+  int len ;
+
+  if ((len = blockFill (this1)) < 0)
+    return NULL ;
+  return blockTake (this1,&len) ;
+}
+
+
+
+static int fillBgzf (LineStream this1, char *buf, int n)
+{ /* the data comes from one block and ends where the reader is now */
+  long long pos ;
+
+  n = bgzf_read (this1->bgzf,buf,n) ;
+  pos = bgzf_tell (this1->bgzf) ;
+  this1->fillPos = bgzf_virtualOffset (bgzf_blockAddress (pos),bgzf_withinBlock (pos) - n) ;
+  return n ;
+}
+
+
+
+/**
+ * Creates a line stream from a BGZF compressed file (as written by bgzip).
+ * @param[in] fn File name ("-" means stdin)
+ * @param[in] nThreads Number of threads decompressing blocks, 0 means decompress in the calling thread; see threadPool_cpuCount()
+ * @return A line stream object, NULL if file could not been opened; to learn details call warnReport() from module log.c
+ * @note Blocks are decompressed ahead of the line being read and handed out in file order.
+ * @see ls_bgzfSeek()
+ */
+LineStream ls_createFromBgzf (const char *fn, int nThreads)
+{ 
+  LineStream this1;
+
+  if (!fn)
+    die ("ls_createFromBgzf: no file name given");
+  this1 = lineStreamAlloc ();
+  this1->bgzf = bgzf_readerCreate (fn,nThreads);
+  if (!this1->bgzf) {
+    hlr_free (this1->stats);
+    hlr_free (this1);
+    return NULL;
+  }
+  blockInit (this1) ;
+  register_nextLine (this1,nextLineBgzf);
+  this1->fill_hook = fillBgzf ;
+  return this1;
+}
+
+
+
+static char *nextLineBgzf (LineStream this1)
+{ /* returns the next line from the BGZF file. The reader stays
+     open at the end of the file, so that ls_bgzfSeek() still works.
+  */
+  char *line ;
+
+  if (!this1)
+    die ("nextLineBgzf: NULL LineStream");
+  if (this1->eof)
+    return NULL ;
+  if (!(line = nextLineBlock (this1))) {
+    readAheadStop (this1) ;
+    this1->eof = 1 ;
+  }
+  return line ;
+}
+
+
+
+/**
+ * Position a line stream created by ls_createFromBgzf() at a BGZF virtual offset.
+ * @param[in] this1 A line stream 
+ * @param[in] virtualOffset Virtual offset of the beginning of a line, e.g. from a tabix or similar index
+ * @post The next call to ls_nextLine() returns the line starting at virtualOffset; a previous ls_back() is void.
+ * @note ls_lineCountGet() is not meaningful after seeking.
+ */
+void ls_bgzfSeek(LineStream this1, long long virtualOffset) 
+{
+  if (this1->nextLine_hook != nextLineBgzf)
+    die ("ls_bgzfSeek: line stream not created by ls_createFromBgzf()") ;
+  streamSeek (this1,virtualOffset) ;
+}
+
+
+
+static void streamSeek (LineStream this1, long long pos)
+{ /* continues reading at 'pos', a file offset or a BGZF virtual offset */
+  int nBuffers = 0 ;
+  int bufSize = 0 ;
+
+  if (this1->readAhead) {
+    nBuffers = this1->readAhead->nBuffers ;
+    bufSize = this1->readAhead->bufSize ;
+    readAheadStop (this1) ;
+  }
+  if (this1->bgzf)
+    bgzf_seek (this1->bgzf,pos) ;
+  else if (this1->nextLine_hook == nextLineFile && this1->fp) {
+    /* range streams use pread() and only need 'filePos' */
+    if (this1->rangeEnd < 0 && lseek (fileno (this1->fp),(off_t)pos,SEEK_SET) < 0)
+      die ("linestream: cannot seek: %s",strerror (errno)) ;
+    this1->filePos = pos ;
+  }
+  else
+    die ("linestream: can only seek in files") ;
+  blockInit (this1) ;
+  this1->eof = 0 ;
+  this1->historyCnt = 0 ;
+  this1->backCnt = 0 ;
+  if (nBuffers)
+    readAheadStart (this1,nBuffers,bufSize) ;
+}
+
+
+
+/**
+ * Collect the offsets of every 'every'-th line while the line stream is read, for ls_indexWrite().
+ * @param[in] this1 A line stream created from a file, pipe or BGZF file
+ * @param[in] every Sampling interval in lines, e.g. 1000; ls_seekLine() reads at most every-1 lines to reach a line
+ * @pre ls_create*, no line read yet, ls_setReadAhead() and ls_nextBatch() are not used
+ * @see ls_indexCreate()
+ */
+void ls_indexBuild (LineStream this1, int every)
+{
+  if (this1->index || this1->count)
+    die ("ls_indexBuild() more than once or too late") ;
+  if (every < 1)
+    die ("ls_indexBuild(): every must be at least 1") ;
+  if (!this1->blk || this1->readAhead)
+    die ("ls_indexBuild(): not for buffer streams and not together with ls_setReadAhead()") ;
+  this1->index = (LsIndex *) hlr_malloc (sizeof (LsIndex)) ;
+  this1->index->every = every ;
+  this1->index->lineCnt = 0 ;
+  this1->index->offsets = arrayCreate (1024,long long) ;
+  this1->index->chunks = arrayCreate (8,LsChunk) ;
+}
+
+
+
+static void varintWrite (FILE *fp, unsigned long long v)
+{ /* 7 bits per byte, least significant first; the high bit means 'more' */
+  while (v >= 0x80) {
+    putc ((int)(v & 0x7f) | 0x80,fp) ;
+    v >>= 7 ;
+  }
+  putc ((int)v,fp) ;
+}
+
+
+
+static unsigned long long varintRead (FILE *fp, char *fileName)
+{
+  unsigned long long v = 0 ;
+  int shift = 0 ;
+  int c ;
+
+  do {
+    if ((c = getc (fp)) == EOF || shift > 63)
+      die ("ls_indexRead: '%s' is truncated or corrupt",fileName) ;
+    v |= (unsigned long long)(c & 0x7f) << shift ;
+    shift += 7 ;
+  } while (c & 0x80) ;
+  return v ;
+}
+
+
+
+/**
+ * Write the line index collected so far to a file.
+ * The index holds the sampling interval, the number of lines seen and the line offsets, 
+   stored as varint-encoded differences; it typically takes 2-3 bytes per sampled line.
+ * @param[in] this1 A line stream for which ls_indexBuild() was called, usually read to its end
+ * @param[in] indexFileName Name of the index file; by convention the name of the indexed file plus ".lsi"
+ */
+void ls_indexWrite (LineStream this1, char *indexFileName)
+{
+  LsIndex *index = this1->index ;
+  FILE *fp ;
+  long long prev = 0 ;
+  long long pos ;
+  int i ;
+
+  if (!index || !index->chunks)
+    die ("ls_indexWrite() without preceeding ls_indexBuild()") ;
+  if (!(fp = fopen (indexFileName,"w")))
+    die ("%s: in ls_indexWrite(%s)",strerror (errno),indexFileName) ;
+  fwrite (LS_INDEX_MAGIC,1,4,fp) ;
+  varintWrite (fp,index->every) ;
+  varintWrite (fp,this1->count) ;
+  varintWrite (fp,arrayMax (index->offsets)) ;
+  for (i = 0; i < arrayMax (index->offsets); i++) {
+    pos = arru (index->offsets,i,long long) ;
+    varintWrite (fp,pos - prev) ;
+    prev = pos ;
+  }
+  if (fclose (fp) != 0)
+    die ("%s: in ls_indexWrite(%s)",strerror (errno),indexFileName) ;
+}
+
+
+
+/**
+ * Load a line index for ls_seekLine().
+ * @param[in] this1 A line stream created by ls_createFromFile() (not stdin) or ls_createFromBgzf(), over the indexed file
+ * @param[in] indexFileName Name of the index file, as written by ls_indexWrite() or ls_indexCreate()
+ * @return 1 if the index was loaded, 0 if the file could not been opened; to learn details call warnReport() from module log.c
+ * @pre The end of the line stream has not been reached yet, ls_indexBuild() was not called
+ * @note A file that is not an index makes the program die.
+ */
+int ls_indexRead (LineStream this1, char *indexFileName)
+{
+  LsIndex *index ;
+  FILE *fp ;
+  char magic[4] ;
+  long long pos = 0 ;
+  int n ;
+  int i ;
+
+  if (this1->index)
+    die ("ls_indexRead(): line stream has an index already") ;
+  if (!(fp = fopen (indexFileName,"r"))) {
+    warnAdd ("ls_indexRead",
+             stringPrintBuf ("'%s': %s",indexFileName,strerror (errno))) ;
+    return 0 ;
+  }
+  if (fread (magic,1,4,fp) != 4 || memcmp (magic,LS_INDEX_MAGIC,4) != 0)
+    die ("ls_indexRead: '%s' is not a line index",indexFileName) ;
+  index = (LsIndex *) hlr_malloc (sizeof (LsIndex)) ;
+  index->every = varintRead (fp,indexFileName) ;
+  index->lineCnt = varintRead (fp,indexFileName) ;
+  n = varintRead (fp,indexFileName) ;
+  if (index->every < 1)
+    die ("ls_indexRead: '%s' is corrupt",indexFileName) ;
+  index->offsets = arrayCreate (n,long long) ;
+  for (i = 0; i < n; i++) {
+    pos += varintRead (fp,indexFileName) ;
+    array (index->offsets,i,long long) = pos ;
+  }
+  index->chunks = NULL ;
+  fclose (fp) ;
+  this1->index = index ;
+  return 1 ;
+}
+
+
+
+/**
+ * Index a plain or BGZF compressed file.
+ * @param[in] fileName Name of the file to index (not stdin); the index is written to fileName.lsi
+ * @param[in] every Sampling interval in lines, see ls_indexBuild()
+ * @return Number of lines in the file
+ */
+long long ls_indexCreate (char *fileName, int every)
+{
+  LineStream ls ;
+  Stringa indexFileName = stringCreate (100) ;
+  long long lineCnt ;
+
+  if (bgzf_isBgzf (fileName))
+    ls = ls_createFromBgzf (fileName,threadPool_cpuCount () > 1 ? threadPool_cpuCount () : 0) ;
+  else
+    ls = ls_createFromFile (fileName) ;
+  if (!ls)
+    die ("ls_indexCreate: %s",warnReport ()) ;
+  ls_indexBuild (ls,every) ;
+  while (ls_nextLine (ls))
+    ;
+  stringPrintf (indexFileName,"%s.lsi",fileName) ;
+  ls_indexWrite (ls,string (indexFileName)) ;
+  lineCnt = ls->count ;
+  ls_destroy (ls) ;
+  stringDestroy (indexFileName) ;
+  return lineCnt ;
+}
+
+
+
+/**
+ * Position a line stream at a line, using the index loaded by ls_indexRead().
+ * @param[in] this1 A line stream 
+ * @param[in] lineNumber Number of the line, the first line is 1
+ * @post The next call to ls_nextLine() returns line 'lineNumber' (NULL if the file has fewer lines) 
+   and ls_lineCountGet() is lineNumber-1; a previous ls_back() is void.
+ */
+void ls_seekLine (LineStream this1, long long lineNumber)
+{
+  LsIndex *index = this1->index ;
+  long long k ;
+
+  if (!index || index->chunks)
+    die ("ls_seekLine() without preceeding ls_indexRead()") ;
+  if (lineNumber < 1)
+    die ("ls_seekLine(): invalid line number %lld",lineNumber) ;
+  k = MIN ((lineNumber - 1) / index->every,arrayMax (index->offsets) - 1) ;
+  streamSeek (this1,k < 0 ? 0 : arru (index->offsets,k,long long)) ;
+  this1->count = k < 0 ? 0 : k * index->every ;
+  while (this1->count < lineNumber - 1 && this1->nextLine_hook (this1))
+    ;
+}
+
+
+
+static int fillFdRange (LineStream this1, char *buf, int n)
+{ /* reads the file from this1->filePos up to this1->rangeEnd; pread() 
+     leaves the file offset alone, so other streams may share the file */
+  int got ;
+
+  if (this1->filePos >= this1->rangeEnd)
+    return 0 ;
+  if (n > this1->rangeEnd - this1->filePos)
+    n = (int)(this1->rangeEnd - this1->filePos) ;
+  while ((got = pread (fileno (this1->fp),buf,n,(off_t)this1->filePos)) < 0 && errno == EINTR) 
+    ;
+  if (got < 0)
+    die ("linestream: read error: %s",strerror (errno)) ;
+  this1->filePos += got ;
+  return got ;
+}
+
+
+
+static int fillBgzfRange (LineStream this1, char *buf, int n)
+{ /* reads the BGZF file up to the virtual offset this1->rangeEnd */
+  if (bgzf_tell (this1->bgzf) >= this1->rangeEnd)
+    return 0 ;
+  n = fillBgzf (this1,buf,n) ;
+  if (this1->fillPos + n <= this1->rangeEnd)
+    return n ;
+  if (bgzf_blockAddress (this1->fillPos) != bgzf_blockAddress (this1->rangeEnd))
+    return 0 ;
+  return MAX (0,bgzf_withinBlock (this1->rangeEnd) - bgzf_withinBlock (this1->fillPos)) ;
+}
+
+
+
+/**
+ * Creates a line stream over a part of a file, typically one of the ranges found by ls_splitFile().
+ * @param[in] fn Name of a plain or BGZF compressed file (not stdin)
+ * @param[in] start Where the first line starts: file offset, or virtual offset for BGZF files
+ * @param[in] end Where the part ends (exclusive), in the same unit; LLONG_MAX means up to the end of the file
+ * @return A line stream object, NULL if file could not been opened; to learn details call warnReport() from module log.c
+ * @note Each range stream has its own file handle and does not share state with other streams, 
+   so the parts of a file can be read by different threads at the same time.
+ */
+LineStream ls_createFromFileRange (const char *fn, long long start, long long end)
+{ 
+  LineStream this1;
+
+  if (!fn || strcmp (fn,"-") == 0)
+    die ("ls_createFromFileRange: need the name of a file");
+  if (bgzf_isBgzf ((char *)fn)) {
+    if (!(this1 = ls_createFromBgzf (fn,0)))
+      return NULL;
+    bgzf_seek (this1->bgzf,start);
+    this1->fill_hook = fillBgzfRange ;
+  }
+  else {
+    if (!(this1 = ls_createFromFile (fn)))
+      return NULL;
+    this1->fill_hook = fillFdRange ;
+  }
+  this1->filePos = start ;
+  this1->rangeEnd = end ;
+  return this1;
+}
+
+
+
+/* ls_splitFile() looks at the bytes behind each nominal split point
+   through a window that grows until it can decide where the next
+   line (or record) starts */
+
+typedef struct { 
+  int at ;         /* index in the window */
+  long long pos ;  /* where window[at] comes from */
+} LsWindowChunk ;
+
+typedef struct {
+  FILE *fp ;           /* plain file, unless bgzf != NULL */
+  BgzfReader bgzf ;
+  long long filePos ;  /* plain file: offset of the next byte to read */
+  char *buf ;
+  int len ;
+  int size ;
+  int eof ;
+  Array chunks ;       /* of LsWindowChunk, one per read */
+} LsWindow ;
+
+
+
+static int windowMore (LsWindow *w)
+{ /* appends the next piece of the file; returns 0 at end of file */
+  LsWindowChunk *chunk ;
+  long long pos ;
+  int n ;
+
+  if (w->eof)
+    return 0 ;
+  if (w->len + LS_BLOCK_SIZE > w->size) {
+    w->size = 2 * w->size + LS_BLOCK_SIZE ;
+    w->buf = hlr_realloc (w->buf,w->size) ;
+    if (!w->buf)
+      die ("ls_splitFile: realloc") ;
+  }
+  if (w->bgzf) {
+    n = bgzf_read (w->bgzf,w->buf + w->len,LS_BLOCK_SIZE) ;
+    pos = bgzf_tell (w->bgzf) ;
+    pos = bgzf_virtualOffset (bgzf_blockAddress (pos),bgzf_withinBlock (pos) - n) ;
+  }
+  else {
+    while ((n = pread (fileno (w->fp),w->buf + w->len,LS_BLOCK_SIZE,(off_t)w->filePos)) < 0 && errno == EINTR)
+      ;
+    if (n < 0)
+      die ("ls_splitFile: read error: %s",strerror (errno)) ;
+    pos = w->filePos ;
+    w->filePos += n ;
+  }
+  if (n == 0) {
+    w->eof = 1 ;
+    return 0 ;
+  }
+  chunk = arrayp (w->chunks,arrayMax (w->chunks),LsWindowChunk) ;
+  chunk->at = w->len ;
+  chunk->pos = pos ;
+  w->len += n ;
+  return 1 ;
+}
+
+
+
+static int windowNewline (LsWindow *w, int from)
+{ /* returns the index of the first \n at or after 'from', -1 if none */
+  char *nl ;
+
+  for (;;) {
+    if (from < w->len && (nl = memchr (w->buf + from,'\n',w->len - from)))
+      return nl - w->buf ;
+    from = MAX (from,w->len) ;
+    if (!windowMore (w))
+      return -1 ;
+  }
+}
+
+
+
+static long long windowAlign (LsWindow *w, int (*recordStart_hook)(char *text, int len, int atEof))
+{ /* returns the position of the first line start behind the first \n 
+     in the window which is accepted by recordStart_hook, LLONG_MAX if 
+     there is none before the end of the file */
+  LsWindowChunk *chunk ;
+  int i,k ;
+  int r ;
+
+  if ((i = windowNewline (w,0)) < 0)
+    return LLONG_MAX ;
+  i++ ;
+  for (;;) {
+    if (i >= w->len && !windowMore (w))
+      return LLONG_MAX ;
+    if (!recordStart_hook)
+      break ;
+    r = recordStart_hook (w->buf + i,w->len - i,w->eof) ;
+    if (r < 0 && windowMore (w))
+      continue ;
+    if (r > 0)
+      break ;
+    if ((i = windowNewline (w,i)) < 0)
+      return LLONG_MAX ;
+    i++ ;
+  }
+  for (k = arrayMax (w->chunks) - 1; k > 0; k--)
+    if (arrp (w->chunks,k,LsWindowChunk)->at <= i)
+      break ;
+  chunk = arrp (w->chunks,k,LsWindowChunk) ;
+  return chunk->pos + (i - chunk->at) ;
+}
+
+
+
+/**
+ * Split a file into ranges that can be read in parallel by line streams from ls_createFromFileRange().
+ * The file is cut at nominal offsets fileSize*i/nRanges; the cut is then moved to the first line
+   start behind the next \n (for BGZF files: behind the first \n of the next block), and further 
+   on to the first line accepted by recordStart_hook. Concatenating the ranges yields the whole 
+   file, so merging the results of the ranges in order gives the same as reading the file sequentially.
+ * @param[in] fn Name of a plain or BGZF compressed file (not stdin)
+ * @param[in] nRanges Number of ranges wanted
+ * @param[in] recordStart_hook NULL if every line is a record; else a function that decides whether 
+   a record starts at 'text', which holds the next 'len' bytes of the file (not null-terminated); 
+   it returns 1 for yes, 0 for no and -1 if it needs to see more bytes. 'atEof' is 1 if 'text' 
+   reaches up to the end of the file.
+ * @return Array of LsRange, at most nRanges (fewer if the file is small); NULL if the file could not 
+   been opened; to learn details call warnReport() from module log.c
+ * @see ls_parallel()
+ */
+Array ls_splitFile (const char *fn, int nRanges, int (*recordStart_hook)(char *text, int len, int atEof))
+{
+  Array ranges ;
+  LsRange *range ;
+  LsWindow w ;
+  long long fileSize ;
+  long long cut ;
+  int i ;
+
+  if (!fn || strcmp (fn,"-") == 0)
+    die ("ls_splitFile: need the name of a file");
+  if (nRanges < 1)
+    die ("ls_splitFile: nRanges must be at least 1");
+  w.bgzf = NULL ;
+  if (bgzf_isBgzf ((char *)fn) && !(w.bgzf = bgzf_readerCreate (fn,0)))
+    return NULL ;
+  if (!(w.fp = fopen (fn,"r"))) {
+    warnAdd("ls_splitFile", 
+            stringPrintBuf("'%s': %s", fn, strerror(errno))) ;
+    bgzf_readerDestroy (w.bgzf) ;
+    return NULL ;
+  }
+  if (fseeko (w.fp,0,SEEK_END) != 0)
+    die ("ls_splitFile: %s",strerror (errno)) ;
+  fileSize = ftello (w.fp) ;
+  w.size = 4 * LS_BLOCK_SIZE ;
+  w.buf = hlr_malloc (w.size) ;
+  w.chunks = arrayCreate (16,LsWindowChunk) ;
+  ranges = arrayCreate (nRanges,LsRange) ;
+  range = arrayp (ranges,0,LsRange) ;
+  range->start = 0 ;
+  for (i = 1; i < nRanges; i++) {
+    cut = fileSize * i / nRanges ;
+    w.len = 0 ;
+    w.eof = 0 ;
+    arrayClear (w.chunks) ;
+    if (w.bgzf) 
+      cut = bgzf_blockAlign (w.bgzf,cut) < 0 ? LLONG_MAX : windowAlign (&w,recordStart_hook) ;
+    else {
+      w.filePos = cut ;
+      cut = windowAlign (&w,recordStart_hook) ;
+    }
+    if (cut <= range->start)
+      continue ;
+    range->end = cut ;
+    if (cut == LLONG_MAX)
+      break ;
+    range = arrayp (ranges,arrayMax (ranges),LsRange) ;
+    range->start = cut ;
+  }
+  if (i == nRanges)
+    range->end = LLONG_MAX ;
+  hlr_free (w.buf) ;
+  arrayDestroy (w.chunks) ;
+  bgzf_readerDestroy (w.bgzf) ;
+  fclose (w.fp) ;
+  return ranges ;
+}
+
+
+
+/**
+ * Number of ranges to ask ls_splitFile() for, so that the ranges are not much larger than rangeSize.
+ * @param[in] fn Name of a file
+ * @param[in] rangeSize Wanted size of a range in bytes of the file (compressed bytes for BGZF files)
+ * @param[in] minRanges Lower bound for the result, e.g. a multiple of the number of threads
+ * @return At least minRanges; minRanges if the size of the file cannot be determined
+ */
+int ls_rangeCount (const char *fn, long long rangeSize, int minRanges)
+{
+  struct stat st ;
+  long long n ;
+
+  if (!fn || stat (fn,&st) != 0 || rangeSize < 1)
+    return minRanges ;
+  n = (st.st_size + rangeSize - 1) / rangeSize ;
+  return n > minRanges ? (n < INT_MAX ? (int)n : INT_MAX) : minRanges ;
+}
+
+
+
+typedef struct { 
+  LineStream ls ;
+  int rangeIndex ;
+  void (*func)(LineStream ls, int rangeIndex, void *arg) ;
+  void *arg ;
+  ThreadPoolJob job ;
+} LsRangeJob ;
+
+
+
+static void rangeJobRun (void *arg)
+{
+  LsRangeJob *rj = (LsRangeJob *)arg ;
+
+  rj->func (rj->ls,rj->rangeIndex,rj->arg) ;
+}
+
+
+
+/**
+ * Read a file on several threads.
+ * The file is split by ls_splitFile() and each range is handed to func() on its own thread,
+   as a line stream that reads just this range.
+ * @param[in] fn Name of a plain or BGZF compressed file (not stdin)
+ * @param[in] nThreads Number of threads (and ranges); see threadPool_cpuCount()
+ * @param[in] recordStart_hook See ls_splitFile()
+ * @param[in] func Called once per range with rangeIndex 0,1,... in file order; it must only touch 
+   data of its own range (e.g. element rangeIndex of an array in 'arg'), so that the caller can
+   merge the results in file order afterwards. The line stream is destroyed after func() returned.
+ * @param[in] arg Passed to func
+ * @return Number of ranges processed (at most nThreads), -1 if the file could not been opened; 
+   to learn details call warnReport() from module log.c
+ * @note func() runs on the worker threads without any synchronisation. It may allocate via 
+   hlr_malloc() and create arrays, whose counters are updated atomically, but it must not use 
+   warnAdd() or warnReport(), which keep their messages in static buffers; die() ends the program.
+ */
+int ls_parallel (const char *fn, int nThreads, int (*recordStart_hook)(char *text, int len, int atEof),
+                 void (*func)(LineStream ls, int rangeIndex, void *arg), void *arg)
+{
+  Array ranges ;
+  LsRange *range ;
+  LsRangeJob *jobs ;
+  ThreadPool pool ;
+  int i,n ;
+
+  if (!(ranges = ls_splitFile (fn,nThreads,recordStart_hook)))
+    return -1 ;
+  n = arrayMax (ranges) ;
+  jobs = (LsRangeJob *) hlr_calloc (n,sizeof (LsRangeJob)) ;
+  for (i = 0; i < n; i++) {
+    range = arrp (ranges,i,LsRange) ;
+    if (!(jobs[i].ls = ls_createFromFileRange (fn,range->start,range->end)))
+      die ("ls_parallel: %s",warnReport ()) ;
+    jobs[i].rangeIndex = i ;
+    jobs[i].func = func ;
+    jobs[i].arg = arg ;
+  }
+  pool = threadPool_create (n) ;
+  for (i = 0; i < n; i++)
+    threadPool_submit (pool,&jobs[i].job,rangeJobRun,&jobs[i]) ;
+  threadPool_waitAll (pool) ;
+  threadPool_destroy (pool) ;
+  for (i = 0; i < n; i++)
+    ls_destroy (jobs[i].ls) ;
+  hlr_free (jobs) ;
+  arrayDestroy (ranges) ;
+  return n ;
+}
+
+
+
+/**
+ * Collect statistics about the input of a line stream: bytes and lines read, how often 
+   and how long ls_nextLine() had to wait for input (reading and decompressing), and line lengths.
+ * When the line stream is destroyed, its statistics are added to the totals of its label, see ls_statsTotalGet().
+ * @param[in] this1 A line stream 
+ * @param[in] logAtDestroy 1 to print the statistics via romsg() when the line stream is destroyed
+ * @note Without this call a line stream does not spend any time on statistics.
+ */
+void ls_statsEnable (LineStream this1, int logAtDestroy)
+{
+  if (!this1->stats)
+    this1->stats = (LsStats *) hlr_calloc (1,sizeof (LsStats)) ;
+  this1->stats->streams = 1 ;
+  this1->statsLog = logAtDestroy ;
+}
+
+
+
+/**
+ * Collect statistics for all line streams created from now on, see ls_statsEnable(). 
+ * This also covers line streams that parsers create internally, e.g. in fasta_initFromFile();
+   their totals are found under the name of the parser, e.g. "fasta" or "bowtieParser".
+ * @param[in] on 1 to switch on, 0 to switch off
+ * @param[in] logAtDestroy 1 to print the statistics of each line stream when it is destroyed
+ */
+void ls_statsEnableAll (int on, int logAtDestroy)
+{
+  statsAll = on ;
+  statsAllLog = logAtDestroy ;
+}
+
+
+
+/**
+ * Set the name under which the statistics of a line stream are summed up.
+ * @param[in] this1 A line stream, NULL is ignored
+ * @param[in] label E.g. the name of a parser module; must stay valid as long as the line stream; 
+   line streams without label count as "linestream"
+ */
+void ls_statsLabelSet (LineStream this1, char *label)
+{
+  if (this1)
+    this1->statsLabel = label ;
+}
+
+
+
+/**
+ * Get the statistics collected so far.
+ * @param[in] this1 A line stream 
+ * @return The statistics, NULL if ls_statsEnable() was not called; memory belongs to the line stream
+ */
+LsStats *ls_statsGet (LineStream this1)
+{
+  return this1->stats ;
+}
+
+
+
+static void statsTotalAdd (LineStream this1)
+{
+  char *label = this1->statsLabel ? this1->statsLabel : "linestream" ;
+  LsStatsTotal *total = NULL ;
+  LsStats *a,*b ;
+  int i ;
+
+  pthread_mutex_lock (&statsLock) ;
+  if (!statsTotals)
+    statsTotals = arrayCreate (8,LsStatsTotal) ;
+  for (i = 0; i < arrayMax (statsTotals); i++) 
+    if (strEqual (arrp (statsTotals,i,LsStatsTotal)->label,label))
+      total = arrp (statsTotals,i,LsStatsTotal) ;
+  if (!total) {
+    total = arrayp (statsTotals,arrayMax (statsTotals),LsStatsTotal) ;
+    total->label = hlr_strdup (label) ;
+    memset (&total->stats,0,sizeof (LsStats)) ;
+  }
+  a = &total->stats ;
+  b = this1->stats ;
+  a->bytes += b->bytes ;
+  a->lines += b->lines ;
+  a->refills += b->refills ;
+  a->readSeconds += b->readSeconds ;
+  a->lineBytes += b->lineBytes ;
+  a->maxLineLen = MAX (a->maxLineLen,b->maxLineLen) ;
+  a->streams += b->streams ;
+  pthread_mutex_unlock (&statsLock) ;
+}
+
+
+
+/**
+ * Get the statistics summed up over all destroyed line streams with the same label.
+ * @param[in] label See ls_statsLabelSet()
+ * @param[out] stats The totals, all 0 if there were no such line streams
+ */
+void ls_statsTotalGet (char *label, LsStats *stats)
+{
+  int i ;
+
+  memset (stats,0,sizeof (LsStats)) ;
+  pthread_mutex_lock (&statsLock) ;
+  for (i = 0; statsTotals && i < arrayMax (statsTotals); i++) 
+    if (strEqual (arrp (statsTotals,i,LsStatsTotal)->label,label))
+      *stats = arrp (statsTotals,i,LsStatsTotal)->stats ;
+  pthread_mutex_unlock (&statsLock) ;
+}
+
+
+
+static char *statsFormat (char *label, LsStats *stats)
+{ /* returns a one-line summary; memory managed here */
+  static Stringa buffer = NULL ;
+
+  stringCreateClear (buffer,200) ;
+  stringPrintf (buffer,"%s: %d stream(s), %lld lines, %lld bytes, %lld refills, %.3f s waiting for input, line length avg %.1f max %d",
+                label,stats->streams,stats->lines,stats->bytes,stats->refills,stats->readSeconds,
+                stats->lines ? (double)stats->lineBytes / stats->lines : 0.0,stats->maxLineLen) ;
+  return string (buffer) ;
+}
+
+
+
+/**
+ * Print the totals of all labels, one line per label.
+ * @param[in] fp Where to print, e.g. stderr
+ */
+void ls_statsReport (FILE *fp)
+{
+  int i ;
+
+  pthread_mutex_lock (&statsLock) ;
+  for (i = 0; statsTotals && i < arrayMax (statsTotals); i++) 
+    fprintf (fp,"%s\n",statsFormat (arrp (statsTotals,i,LsStatsTotal)->label,
+                                    &arrp (statsTotals,i,LsStatsTotal)->stats)) ;
+  pthread_mutex_unlock (&statsLock) ;
+}
+
+
+
 /**
  * Destroys a line stream object after closing the file or pipe if they are still open (stream not read to the end) 
    or after destroying the word iterator if the stream was over a buffer.
@@ -253,22 +1461,40 @@ void ls_destroy_func (LineStream this1)
   if (!this1) 
     return ;
 
+  readAheadStop (this1);
   if (this1->nextLine_hook == nextLinePipe && this1->fp) {
     while (fgets (line,sizeof (line),this1->fp)) {}
     this1->status = PLABLA_PCLOSE (this1->fp);
-    hlr_free (this1->line);
   }
   else if (this1->nextLine_hook == nextLineFile && this1->fp) {
     /* if (this1->fp == stdin) */
-    if (!PLABLA_ISATTY(fileno(this1->fp)))
+    if (this1->rangeEnd < 0 && !this1->index && !PLABLA_ISATTY(fileno(this1->fp)))
       while (fgets (line,sizeof (line),this1->fp)) {}
     fclose (this1->fp);
-    hlr_free (this1->line);
   }
   else if (this1->nextLine_hook == nextLineBuffer && this1->wi) {
     wordIterDestroy (this1->wi);
   }
-  stringDestroy(this1->buffer) ;
+  else if (this1->nextLine_hook == nextLineBgzf) {
+    bgzf_readerDestroy (this1->bgzf);
+  }
+  hlr_free (this1->blk);
+  hlr_free (this1->line);
+  hlr_free (this1->history);
+  if (this1->index) {
+    arrayDestroy (this1->index->offsets);
+    arrayDestroy (this1->index->chunks);
+    hlr_free (this1->index);
+  }
+  if (this1->stats) {
+    statsTotalAdd (this1);
+    if (this1->statsLog) {
+      pthread_mutex_lock (&statsLock);
+      romsg ("%s",statsFormat (this1->statsLabel ? this1->statsLabel : "linestream",this1->stats));
+      pthread_mutex_unlock (&statsLock);
+    }
+    hlr_free (this1->stats);
+  }
   hlr_free (this1);
 }
 
@@ -295,28 +1521,117 @@ static void register_nextLine (LineStream this1,char *(*f)(LineStream this1))
 char *ls_nextLine (LineStream this1)
 { 
   char *line ;
+  int n ;
   if (!this1) 
     die("%s", warnCount(NULL,NULL) ? warnReport() : "ls_nextLine: invalid LineStream") ;
-  if (this1->buffer) {
-    if (this1->bufferBack) {
-      this1->bufferBack = 0 ;
-      line = this1->bufferLine ;
-    }
-    else {
-      /* only get the next line if there we did not yet see the
-         end of file */
-      line = this1->bufferLine ? this1->nextLine_hook (this1) : NULL ;
-      if (line) {
-        stringCpy(this1->buffer, line) ;
-        this1->bufferLine = string(this1->buffer) ;
-      }
-      else
-        this1->bufferLine = NULL ;
+  if (!(n = this1->historySize))
+    return this1->eof ? NULL : this1->nextLine_hook (this1) ;
+  if (this1->backCnt > 0)
+    return this1->history[(this1->historyNext - this1->backCnt-- + n) % n] ;
+  /* only get the next line if we did not yet see the end of file;
+     the end itself is remembered once, so that ls_back() can return it */
+  if (this1->eof)
+    return NULL ;
+  line = this1->nextLine_hook (this1) ;
+  this1->history[this1->historyNext] = line ;
+  this1->historyNext = (this1->historyNext + 1) % n ;
+  if (this1->historyCnt < n)
+    this1->historyCnt++ ;
+  return line ;
+}
+
+
+
+/**
+ * Get a batch of lines at once.
+ * The lines of a batch are split in place in one block of memory which is handed over to the batch,
+   so no line is copied and the batch stays valid independent of the line stream, e.g. while 
+   it is parsed by worker threads.
+ * @param[in] this1 A line stream 
+ * @param[in] maxLines Maximum number of lines in the batch
+ * @param[in] maxBytes Approximate maximum number of bytes in the batch; a single line longer than this is returned on its own
+ * @return A batch containing at least one line, NULL if there are no more lines; use ls_batchDestroy() to free it
+ * @note A batch may contain fewer lines than requested before the end of the stream (e.g. when a pipe delivers data slowly).
+ * @pre ls_bufferSet() was not called.
+ */
+LineBatch ls_nextBatch (LineStream this1, int maxLines, int maxBytes)
+{ 
+  LineBatch batch ;
+  LineView *view ;
+  char *line ;
+  char *s ;
+  char *nl ;
+  int len ;
+  int bytes ;
+
+  if (!this1) 
+    die("%s", warnCount(NULL,NULL) ? warnReport() : "ls_nextBatch: invalid LineStream") ;
+  if (this1->historySize)
+    die("ls_nextBatch() cannot be combined with ls_bufferSet()") ;
+  if (this1->nextLine_hook == nextLineConst)
+    die("ls_nextBatch() not possible on a line stream from ls_createFromConstBuffer()") ;
+  if (this1->index && this1->index->chunks)
+    die("ls_nextBatch() cannot be combined with ls_indexBuild()") ;
+  if (maxLines < 1)
+    die("ls_nextBatch(): maxLines must be at least 1") ;
+  if (this1->blk && this1->blkSize <= maxBytes)
+    blockResize (this1,maxBytes + 1) ;
+  if (ls_isEof (this1) || !(line = this1->nextLine_hook (this1)))
+    return NULL ;
+  batch = (LineBatch) hlr_malloc (sizeof (struct _lineBatchStruct_)) ;
+  batch->lines = arrayCreate (MIN (maxLines,4096),LineView) ;
+  view = arrayp (batch->lines,0,LineView) ;
+  view->line = line ;
+  view->len = bytes = strlen (line) ;
+  if (!this1->blk) {
+    /* buffer stream: the lines already live in the caller's buffer */
+    batch->block = NULL ;
+    while (arrayMax (batch->lines) < maxLines && bytes < maxBytes &&
+           (line = this1->nextLine_hook (this1))) {
+      view = arrayp (batch->lines,arrayMax (batch->lines),LineView) ;
+      view->line = line ;
+      view->len = strlen (line) ;
+      bytes += view->len + 1 ;
     }
+    return batch ;
   }
-  else 
-    line = this1->nextLine_hook (this1) ;
-  return line ;
+  /* take the complete lines remaining in the block without refilling it */
+  while (arrayMax (batch->lines) < maxLines && bytes < maxBytes) {
+    s = this1->blk + this1->blkPos ;
+    len = this1->blkLen - this1->blkPos ;
+    if ((nl = memchr (s,'\n',len)) != NULL)
+      len = nl - s ;
+    else if (!this1->blkEof || len == 0)
+      break ;
+    view = arrayp (batch->lines,arrayMax (batch->lines),LineView) ;
+    view->line = blockTake (this1,&len) ;
+    view->len = len ;
+    bytes += len + 1 ;
+  }
+  /* hand the block over to the batch, keep the unread rest */
+  batch->block = this1->blk ;
+  this1->blk = hlr_malloc (this1->blkSize) ;
+  len = this1->blkLen - this1->blkPos ;
+  memcpy (this1->blk,batch->block + this1->blkPos,len) ;
+  this1->blkPos = 0 ;
+  this1->blkLen = len ;
+  return batch ;
+}
+
+
+
+/**
+ * Destroy a batch returned by ls_nextBatch().
+ * @param[in] this1 A line batch
+ * @note Do not call this function, but use the macro ls_batchDestroy
+ */
+void ls_batchDestroy_func (LineBatch this1)
+{ 
+  if (!this1)
+    return ;
+  arrayDestroy (this1->lines) ;
+  hlr_free (this1->block) ;
+  hlr_free (this1) ;
 }
 
 
@@ -324,19 +1639,23 @@ char *ls_nextLine (LineStream this1)
 /**
  * Push back 'lineCnt' lines.
  * @param[in] this1 A line stream 
- * @param[in] lineCnt  How many lines should ls_nextLine() repeat (currently, only lineCnt==1 is supported)
+ * @param[in] lineCnt  How many lines should ls_nextLine() repeat; together with lines 
+   pushed back before and not yet read again, at most the number given to ls_bufferSet()
  * @pre ls_bufferSet() was called.
- * @post Next call to ls_nextLine() will return the same line again
+ * @post The next 'lineCnt' calls to ls_nextLine() return the same lines again. 
+   If the end of the stream was among them, NULL is returned for it again.
+ * @note The lines are not copied, and the input block they live in may move when the 
+   stream reads more input. So only the string returned by the last call to ls_nextLine() 
+   is valid; pointers to earlier lines may dangle, get the pushed back lines again from 
+   ls_nextLine() instead of keeping them.
 */
 void ls_back(LineStream this1, int lineCnt) 
 { 
-  if (! this1->buffer)
+  if (! this1->historySize)
     die("ls_back() without preceeding ls_bufferSet()") ;
-  if (this1->bufferBack)
-    die("ls_back() twice in a row") ;
-  if (lineCnt != 1)
-    die("ls_back: sorry, not yet implemented") ;
-  this1->bufferBack = 1 ;
+  if (lineCnt < 1 || this1->backCnt + lineCnt > this1->historyCnt)
+    die("ls_back(): cannot go back %d line(s)",lineCnt) ;
+  this1->backCnt += lineCnt ;
 }
 
 
@@ -344,19 +1663,178 @@ void ls_back(LineStream this1, int lineCnt)
 /**
  * Set how many lines the linestream should buffer.
  * @param[in] this1 A line stream 
- * @param[in] lineCnt How many lines should ls_nextLine() repeat (currently, only lineCnt==1 is supported)
+ * @param[in] lineCnt How many lines ls_back() can push back at most, at least 1
  * @pre ls_create*
  * @post ls_back() will work
+ * @note The lines are not copied; the stream just keeps the last 'lineCnt' lines
+   in its input block (or the caller's buffer) alive. The block may move, see ls_back().
  */
 void ls_bufferSet(LineStream this1, int lineCnt)
 { 
-  if (this1->buffer || this1->count)
+  if (this1->historySize || this1->count)
     die("ls_bufferSet() more than once or too late") ;
-  if (lineCnt != 1)
-    die("ls_bufferSet() sorry, not yet implemented") ;
-  this1->buffer = stringCreate(80) ;
-  this1->bufferBack = 0 ;
-  this1->bufferLine = "" ;  /* dummy init, to kick off reading */
+  if (this1->nextLine_hook == nextLineConst)
+    die("ls_bufferSet() not possible on a line stream from ls_createFromConstBuffer()") ;
+  if (lineCnt < 1)
+    die("ls_bufferSet(): lineCnt must be at least 1") ;
+  this1->history = (char **) hlr_calloc (lineCnt,sizeof (char *)) ;
+  this1->historySize = lineCnt ;
+  this1->historyCnt = 0 ;
+  this1->historyNext = 0 ;
+  this1->backCnt = 0 ;
+}
+
+
+
+static void *readAheadProducer (void *arg)
+{ /* runs on its own thread: fills free buffers from the source
+     until the source is exhausted or the consumer asks to stop;
+     each read is published at once, so that lines from a pipe
+     do not wait until a whole buffer is full */
+  LineStream this1 = (LineStream)arg ;
+  LsReadAhead *ra = this1->readAhead ;
+  int i ;
+  int len ;
+
+  for (;;) {
+    pthread_mutex_lock (&ra->lock) ;
+    while (ra->nFull == ra->nBuffers && !ra->stop)
+      pthread_cond_wait (&ra->emptied,&ra->lock) ;
+    if (ra->stop) {
+      pthread_mutex_unlock (&ra->lock) ;
+      break ;
+    }
+    i = (ra->head + ra->nFull) % ra->nBuffers ;
+    pthread_mutex_unlock (&ra->lock) ;
+    len = ra->sourceFill_hook (this1,ra->bufs[i],ra->bufSize) ;
+    pthread_mutex_lock (&ra->lock) ;
+    if (ra->stop) {
+      pthread_mutex_unlock (&ra->lock) ;
+      break ;
+    }
+    ra->lens[i] = len ;
+    if (len > 0)
+      ra->nFull++ ;
+    else
+      ra->eof = 1 ;
+    pthread_cond_signal (&ra->filled) ;
+    pthread_mutex_unlock (&ra->lock) ;
+    if (len == 0)
+      break ;
+  }
+  return NULL ;
+}
+
+
+
+static int fillReadAhead (LineStream this1, char *buf, int n)
+{ /* consumer side: copies from the oldest filled buffer and hands
+     it back to the producer once it is used up */
+  LsReadAhead *ra = this1->readAhead ;
+
+  pthread_mutex_lock (&ra->lock) ;
+  while (ra->nFull == 0 && !ra->eof)
+    pthread_cond_wait (&ra->filled,&ra->lock) ;
+  if (ra->nFull == 0) {
+    pthread_mutex_unlock (&ra->lock) ;
+    return 0 ;
+  }
+  pthread_mutex_unlock (&ra->lock) ;
+  n = MIN (n,ra->lens[ra->head] - ra->pos) ;
+  memcpy (buf,ra->bufs[ra->head] + ra->pos,n) ;
+  ra->pos += n ;
+  if (ra->pos == ra->lens[ra->head]) {
+    pthread_mutex_lock (&ra->lock) ;
+    ra->head = (ra->head + 1) % ra->nBuffers ;
+    ra->nFull-- ;
+    ra->pos = 0 ;
+    pthread_cond_signal (&ra->emptied) ;
+    pthread_mutex_unlock (&ra->lock) ;
+  }
+  return n ;
+}
+
+
+
+static void readAheadStart (LineStream this1, int nBuffers, int bufSize)
+{ 
+  LsReadAhead *ra ;
+  int i ;
+
+  ra = (LsReadAhead *) hlr_malloc (sizeof (LsReadAhead)) ;
+  ra->nBuffers = nBuffers ;
+  ra->bufSize = bufSize ;
+  ra->bufs = (char **) hlr_malloc (nBuffers * sizeof (char *)) ;
+  for (i = 0; i < nBuffers; i++)
+    ra->bufs[i] = (char *) hlr_malloc (bufSize) ;
+  ra->lens = (int *) hlr_calloc (nBuffers,sizeof (int)) ;
+  ra->head = 0 ;
+  ra->nFull = 0 ;
+  ra->pos = 0 ;
+  ra->eof = 0 ;
+  ra->stop = 0 ;
+  ra->sourceFill_hook = this1->fill_hook ;
+  pthread_mutex_init (&ra->lock,NULL) ;
+  pthread_cond_init (&ra->filled,NULL) ;
+  pthread_cond_init (&ra->emptied,NULL) ;
+  this1->readAhead = ra ;
+  this1->fill_hook = fillReadAhead ;
+  if (pthread_create (&ra->thread,NULL,readAheadProducer,this1) != 0)
+    die ("ls_setReadAhead: cannot start thread") ;
+}
+
+
+
+static void readAheadStop (LineStream this1)
+{ /* terminates the producer; afterwards the source is read directly 
+     again (positioned after the data read ahead) */
+  LsReadAhead *ra = this1->readAhead ;
+  int i ;
+
+  if (!ra)
+    return ;
+  pthread_mutex_lock (&ra->lock) ;
+  ra->stop = 1 ;
+  pthread_cond_signal (&ra->emptied) ;
+  pthread_mutex_unlock (&ra->lock) ;
+  pthread_join (ra->thread,NULL) ;
+  pthread_mutex_destroy (&ra->lock) ;
+  pthread_cond_destroy (&ra->filled) ;
+  pthread_cond_destroy (&ra->emptied) ;
+  this1->fill_hook = ra->sourceFill_hook ;
+  for (i = 0; i < ra->nBuffers; i++)
+    hlr_free (ra->bufs[i]) ;
+  hlr_free (ra->bufs) ;
+  hlr_free (ra->lens) ;
+  hlr_free (this1->readAhead) ;
+}
+
+
+
+/**
+ * Read the source of a line stream ahead on a separate thread.
+ * While the caller processes lines, a producer thread fills the next buffers from the file, pipe or 
+   BGZF file (decompressing it), so that I/O overlaps with parsing.
+ * @param[in] this1 A line stream 
+ * @param[in] nBuffers Number of buffers, at least 2 (double buffering); 3 gives the producer more slack
+ * @param[in] bufSize Size of each buffer in bytes, e.g. 1048576; a buffer is handed over after each
+   read of the source, so lines from a pipe are not held back until a buffer is full
+ * @pre ls_create*, no line read yet
+ * @note Has no effect on line streams created by ls_createFromBuffer() and on terminals.
+ */
+void ls_setReadAhead(LineStream this1, int nBuffers, int bufSize)
+{ 
+  if (this1->readAhead || this1->count)
+    die("ls_setReadAhead() more than once or too late") ;
+  if (this1->index && this1->index->chunks)
+    die("ls_setReadAhead() cannot be combined with ls_indexBuild()") ;
+  if (nBuffers < 2 || bufSize < 1)
+    die("ls_setReadAhead(): need at least 2 buffers of at least 1 byte") ;
+  if (!this1->blk || this1->eof)
+    return ; /* buffer stream or already at end */
+  if (this1->fp && PLABLA_ISATTY(fileno(this1->fp)))
+    return ;
+  readAheadStart (this1,nBuffers,bufSize) ;
 }
 
 
@@ -389,9 +1867,9 @@ int ls_skipStatusGet(LineStream this1)
   }
   else if (this1->nextLine_hook == nextLineFile) {
     if (this1->fp) {
+      readAheadStop (this1);
       fclose (this1->fp);
       this1->fp = NULL;
-      hlr_free (this1->line);
     }
   }
   else if (this1->nextLine_hook == nextLinePipe) {
@@ -399,6 +1877,10 @@ int ls_skipStatusGet(LineStream this1)
       while(nextLinePipe(this1))
 	;
   }
+  else if (this1->nextLine_hook == nextLineBgzf) {
+    readAheadStop (this1);
+  }
+  this1->eof = 1 ;
 
   return this1->status ;
 }
@@ -444,8 +1926,5 @@ void ls_cat(LineStream this1, char *filename)
  */
 int ls_isEof(LineStream this1) 
 { 
-  if (this1->nextLine_hook == nextLineBuffer)
-    return this1->wi == NULL ? 1 : 0 ;
-  else
-    return this1->fp == NULL ? 1 : 0 ;
+  return this1->eof && this1->backCnt == 0 ? 1 : 0 ;
 }
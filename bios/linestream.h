@@ -36,6 +36,63 @@
 #define _nextline_h_
 
 #include "format.h"
+#include "bgzf.h"
+
+struct _lineStreamStruct_ ;
+
+
+
+/**
+ * LsReadAhead.
+ * State of the read-ahead thread of a LineStream; PRIVATE to the LineStream module.
+ */
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;    /* producer -> consumer */
+  pthread_cond_t emptied;   /* consumer -> producer */
+  int nBuffers;
+  int bufSize;
+  char **bufs;
+  int *lens;
+  int head;                 /* buffer the consumer reads from */
+  int nFull;                /* filled buffers, starting at 'head' */
+  int pos;                  /* consumer position in buffer 'head' */
+  int eof;                  /* source exhausted */
+  int stop;                 /* producer must terminate */
+  int (*sourceFill_hook)(struct _lineStreamStruct_ *, char *, int);
+} LsReadAhead;
+
+
+
+/**
+ * LsStats.
+ * Statistics collected by a line stream, see ls_statsEnable().
+ */
+typedef struct {
+  long long bytes;       /* bytes delivered by the source (uncompressed bytes for BGZF files) */
+  long long lines;
+  long long refills;     /* number of times more input was requested */
+  double readSeconds;    /* time spent waiting for input, including decompression */
+  long long lineBytes;   /* sum of the line lengths; lineBytes/lines is the average */
+  int maxLineLen;
+  int streams;           /* number of line streams summed up */
+} LsStats;
+
+
+
+/**
+ * LsIndex.
+ * Offsets of every 'every'-th line of a file; PRIVATE to the LineStream module.
+ */
+typedef struct {
+  int every ;
+  long long lineCnt ; /* number of lines in the indexed file */
+  Array offsets ;    /* of long long: file or virtual offsets of lines 0, every, 2*every, ... */
+  Array chunks ;     /* while building: where the pieces of the block came from; NULL when loaded */
+} LsIndex ;
+
+
 
 /**
  * LineStream.
@@ -45,22 +102,82 @@ typedef struct _lineStreamStruct_ {
      LineStream module -- DO NOT access from outside
      the LineStream module */
   FILE *fp;
-  char *line;
-  int lineLen;
+  char *line;   /* copy of the last line (read-only buffers only) */
+  int lineLen;  /* length of the last line */
+  int lineSize; /* allocated size of 'line' */
   WordIter wi;
-  int count;
+  const char *cbuf ; /* read-only buffer from ls_createFromConstBuffer() */
+  size_t cbufLen ;
+  size_t cbufPos ;
+  long long count; /* lines read so far */
   int status ;  /* exit status of popen() */
+  int eof ;     /* 1 once the source returned its last line */
   char *(*nextLine_hook)(struct _lineStreamStruct_ *);
-  Stringa buffer ;    /* NULL if not in buffered mode, else used
-                         used for remembering last line seen */
-  char *bufferLine ;  /* pointer to 'buffer' or NULL if EOF */
-  int bufferBack ;    /* 0=normal, 1=take next line from buffer */
+  char **history ;    /* NULL if not in buffered mode, else ring of the 
+                         last lines seen (pointers into 'blk' or the 
+                         caller's buffer; NULL marks EOF) */
+  int historySize ;   /* lineCnt from ls_bufferSet() */
+  int historyCnt ;    /* number of valid entries in 'history' */
+  int historyNext ;   /* slot for the next line */
+  int backCnt ;       /* number of lines pushed back by ls_back() */
+  BgzfReader bgzf ;   /* NULL if not created by ls_createFromBgzf() */
+  char *blk ;         /* block of raw input lines are split from */
+  int blkSize ;       /* allocated size of 'blk' */
+  int blkPos ;        /* start of the next line in 'blk' */
+  int blkLen ;        /* number of valid bytes in 'blk' */
+  int blkEof ;        /* 1 if the source has no more bytes */
+  int (*fill_hook)(struct _lineStreamStruct_ *, char *, int); /* reads raw input into 'blk' */
+  LsReadAhead *readAhead ; /* NULL unless ls_setReadAhead() is in effect */
+  long long filePos ;      /* plain file: offset of the next byte to read */
+  long long fillPos ;      /* where the data of the last fill_hook call came from */
+  long long rangeEnd ;     /* -1 unless created by ls_createFromFileRange() */
+  LsIndex *index ;         /* NULL unless ls_indexBuild() or ls_indexRead() was called */
+  LsStats *stats ;         /* NULL unless ls_statsEnable() was called */
+  char *statsLabel ;       /* NULL means "linestream" */
+  int statsLog ;           /* 1 to print the statistics at ls_destroy() */
 } *LineStream;
 
+/**
+ * LsRange.
+ * A part of a file as returned by ls_splitFile(), starting at the start of a line (or record).
+ */
+typedef struct {
+  long long start;  /* file offset; virtual offset for BGZF files */
+  long long end;    /* exclusive; LLONG_MAX means up to the end of the file */
+} LsRange;
+
+
+
+/**
+ * LineView.
+ * A line inside a LineBatch or from ls_nextLineView(), without trailing newline: null-terminated,
+   except for lines from ls_nextLineView() on line streams created by ls_createFromConstBuffer().
+ */
+typedef struct {
+  char *line;
+  int len;
+} LineView;
+
+
+
+/**
+ * LineBatch.
+ * Lines returned by ls_nextBatch(); 'lines' is an Array of LineView pointing into 'block'.
+ */
+typedef struct _lineBatchStruct_ {
+  Array lines;   /* of LineView */
+  char *block;   /* owned by the batch; NULL for buffer streams */
+} *LineBatch;
+
+
+
 extern LineStream ls_createFromFile (const char *fn);
 extern LineStream ls_createFromPipe (char *command);
 extern LineStream ls_createFromBuffer (char *buffer);
+extern LineStream ls_createFromBgzf (const char *fn, int nThreads);
+extern LineStream ls_createFromConstBuffer (const char *buffer, size_t len);
 extern char *ls_nextLine (LineStream this1);
+extern int ls_nextLineView (LineStream this1, LineView *view);
 extern void ls_destroy_func (LineStream this1); /* do not use this function */
 
 /**
@@ -74,4 +191,30 @@ extern int ls_skipStatusGet(LineStream this1) ;
 extern int ls_isEof(LineStream this1) ;
 extern void ls_bufferSet(LineStream this1, int lineCnt) ;
 extern void ls_back(LineStream this1, int lineCnt) ;
+extern void ls_bgzfSeek(LineStream this1, long long virtualOffset) ;
+extern void ls_setReadAhead(LineStream this1, int nBuffers, int bufSize) ;
+extern LineBatch ls_nextBatch(LineStream this1, int maxLines, int maxBytes) ;
+extern void ls_batchDestroy_func(LineBatch this1) ; /* do not use this function */
+extern LineStream ls_createFromFileRange (const char *fn, long long start, long long end);
+extern Array ls_splitFile (const char *fn, int nRanges, int (*recordStart_hook)(char *text, int len, int atEof));
+extern int ls_rangeCount (const char *fn, long long rangeSize, int minRanges);
+extern int ls_parallel (const char *fn, int nThreads, int (*recordStart_hook)(char *text, int len, int atEof),
+                        void (*func)(LineStream ls, int rangeIndex, void *arg), void *arg);
+extern void ls_indexBuild (LineStream this1, int every);
+extern void ls_indexWrite (LineStream this1, char *indexFileName);
+extern int ls_indexRead (LineStream this1, char *indexFileName);
+extern long long ls_indexCreate (char *fileName, int every);
+extern void ls_seekLine (LineStream this1, long long lineNumber);
+extern void ls_statsEnable (LineStream this1, int logAtDestroy);
+extern void ls_statsEnableAll (int on, int logAtDestroy);
+extern void ls_statsLabelSet (LineStream this1, char *label);
+extern LsStats *ls_statsGet (LineStream this1);
+extern void ls_statsTotalGet (char *label, LsStats *stats);
+extern void ls_statsReport (FILE *fp);
+
+/**
+ * Destroy a line batch.
+ * @see ls_batchDestroy_func()
+ */
+#define ls_batchDestroy(this1) (ls_batchDestroy_func(this1),this1=NULL) /* use this one */
 #endif
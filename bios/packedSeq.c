@@ -0,0 +1,349 @@
+/**
+ *   \file packedSeq.c Module for DNA packed 2 bits per base
+ */
+
+
+/*
+   Module packedSeq
+   A PackedSeq keeps 32 bases per 64-bit word, which takes a quarter of
+   the memory of a Seq. Bases that are not A, C, G or T are recorded as
+   runs of N; lower case bases are recorded in a bit mask. Since the
+   complement of a base code is the code xor 2, complementing works on
+   whole words.
+*/
+
+
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "fasta.h"
+#include "packedSeq.h"
+
+
+
+#define PACKED_SEQ_UNPACK_CHUNK 65536
+
+
+static int packedSeq_wordCount (int size)
+{
+  return (size + PACKED_SEQ_BASES_PER_WORD - 1) / PACKED_SEQ_BASES_PER_WORD;
+}
+
+
+
+/**
+ * Pack DNA.
+ * @param[in] name Name of the sequence (copied)
+ * @param[in] dna Bases; characters other than ACGTU (either case) become N, lower case bases are masked
+ * @param[in] size Number of bases
+ * @return A packed sequence
+ */
+PackedSeq packedSeq_fromDna (char *name, DNA *dna, int size)
+{
+  PackedSeq this1;
+  PackedSeqBlock *block;
+  int nWords = packedSeq_wordCount (size);
+  int nStart = -1;
+  unsigned char c;
+  int val;
+  int i;
+
+  this1 = (PackedSeq) hlr_malloc (sizeof (struct _packedSeqStruct_));
+  this1->name = hlr_strdup (name ? name : "");
+  this1->size = size;
+  this1->words = (unsigned long long *) hlr_malloc ((nWords + 1) * sizeof (unsigned long long));
+  memset (this1->words,0,(nWords + 1) * sizeof (unsigned long long));
+  this1->nBlocks = arrayCreate (8,PackedSeqBlock);
+  this1->mask = NULL;
+  for (i = 0; i <= size; i++) {
+    c = i < size ? dna[i] : 'A';
+    if (islower (c)) {
+      if (!this1->mask)
+        this1->mask = bitAlloc (size);
+      bitSetOne (this1->mask,i);
+    }
+    val = ntVal[c];
+    if (val < 0) {
+      if (nStart < 0)
+        nStart = i;
+      continue;
+    }
+    if (nStart >= 0) {
+      block = arrayp (this1->nBlocks,arrayMax (this1->nBlocks),PackedSeqBlock);
+      block->start = nStart;
+      block->size = i - nStart;
+      nStart = -1;
+    }
+    if (i < size)
+      this1->words[i >> 5] |= (unsigned long long)val << (62 - 2 * (i & 31));
+  }
+  return this1;
+}
+
+
+
+/**
+ * Pack a sequence.
+ * @param[in] seq A sequence, e.g. from fasta_nextSequence()
+ * @return A packed sequence; 'seq' is not modified
+ */
+PackedSeq packedSeq_fromSeq (Seq *seq)
+{
+  return packedSeq_fromDna (seq->name,seq->sequence,seq->size);
+}
+
+
+
+/**
+ * Read the next sequence from the fasta module and pack it.
+ * The unpacked sequence is not kept, so a genome can be loaded in a quarter of the memory.
+ * @param[in] truncateName See fasta_nextSequence()
+ * @return A packed sequence (the caller owns it), or NULL at the end of the input
+ * @pre fasta_initFromFile() or fasta_initFromPipe() was called
+ */
+PackedSeq packedSeq_nextFromFasta (int truncateName)
+{
+  Seq *seq;
+
+  if (!(seq = fasta_nextSequence (truncateName)))
+    return NULL;
+  return packedSeq_fromSeq (seq);
+}
+
+
+
+/**
+ * Get the name of a packed sequence; belongs to the packed sequence.
+ */
+char *packedSeq_nameGet (PackedSeq this1)
+{
+  return this1->name;
+}
+
+
+
+/**
+ * Get the number of bases of a packed sequence.
+ */
+int packedSeq_sizeGet (PackedSeq this1)
+{
+  return this1->size;
+}
+
+
+
+/**
+ * Index of the first N run ending after 'pos'.
+ */
+static int packedSeq_firstBlockAfter (PackedSeq this1, int pos)
+{
+  PackedSeqBlock *block;
+  int lo = 0;
+  int hi = arrayMax (this1->nBlocks);
+  int mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    block = arrp (this1->nBlocks,mid,PackedSeqBlock);
+    if (block->start + block->size <= pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+
+
+/**
+ * Unpack the bases [start,end) of a packed sequence.
+ * @param[in] this1 A packed sequence
+ * @param[in] start First base, 0-based
+ * @param[in] end One past the last base
+ * @param[out] out Room for end - start + 1 characters; receives the bases, null-terminated.
+   N runs are N, masked bases are lower case, all other bases upper case.
+ */
+void packedSeq_unpack (PackedSeq this1, int start, int end, DNA *out)
+{
+  PackedSeqBlock *block;
+  unsigned long long *words = this1->words;
+  DNA *o = out;
+  int pos = start;
+  int from;
+  int to;
+  int i;
+
+  if (start < 0 || end > this1->size || start > end)
+    die ("packedSeq_unpack: invalid range %d-%d for sequence of size %d",start,end,this1->size);
+  for (; pos < end && (pos & 3); pos++)
+    *o++ = packedByteToNt[(words[pos >> 5] >> (56 - 8 * ((pos & 31) >> 2))) & 0xff][pos & 3];
+  for (; pos + 4 <= end; pos += 4) {
+    memcpy (o,packedByteToNt[(words[pos >> 5] >> (56 - 8 * ((pos & 31) >> 2))) & 0xff],4);
+    o += 4;
+  }
+  for (; pos < end; pos++)
+    *o++ = packedByteToNt[(words[pos >> 5] >> (56 - 8 * ((pos & 31) >> 2))) & 0xff][pos & 3];
+  *o = '\0';
+  for (i = packedSeq_firstBlockAfter (this1,start); i < arrayMax (this1->nBlocks); i++) {
+    block = arrp (this1->nBlocks,i,PackedSeqBlock);
+    if (block->start >= end)
+      break;
+    from = MAX (block->start,start);
+    to = MIN (block->start + block->size,end);
+    memset (out + from - start,'N',to - from);
+  }
+  if (this1->mask) {
+    from = bitFindSet (this1->mask,start,end);
+    while (from < end) {
+      to = bitFindClear (this1->mask,from,end);
+      for (i = from; i < to; i++)
+        out[i - start] = tolower (out[i - start]);
+      from = bitFindSet (this1->mask,to,end);
+    }
+  }
+}
+
+
+
+/**
+ * Convert a packed sequence into a Seq.
+ * @return A new sequence (free with seq_free()); seq->mask is a copy of the mask, or NULL
+ */
+Seq *packedSeq_toSeq (PackedSeq this1)
+{
+  Seq *seq;
+
+  AllocVar (seq);
+  seq->name = hlr_strdup (this1->name);
+  seq->size = this1->size;
+  seq->sequence = hlr_malloc (this1->size + 1);
+  packedSeq_unpack (this1,0,this1->size,seq->sequence);
+  seq->mask = this1->mask ? bitClone (this1->mask,this1->size) : NULL;
+  return seq;
+}
+
+
+
+/**
+ * Get the k-mer starting at 'pos' as an integer.
+ * @param[in] this1 A packed sequence
+ * @param[in] pos First base of the k-mer, 0-based
+ * @param[in] k Length of the k-mer, 1 <= k <= 32
+ * @param[out] kmer The bases as X_BASE_VAL codes, 2 bits each, first base in the highest bits used
+ * @return 1 if the k-mer was extracted, 0 if it overlaps an N run
+ */
+int packedSeq_kmer (PackedSeq this1, int pos, int k, unsigned long long *kmer)
+{
+  PackedSeqBlock *block;
+  unsigned long long bits;
+  int off = pos & 31;
+  int i;
+
+  if (k < 1 || k > PACKED_SEQ_BASES_PER_WORD || pos < 0 || pos + k > this1->size)
+    die ("packedSeq_kmer: invalid %d-mer at %d for sequence of size %d",k,pos,this1->size);
+  i = packedSeq_firstBlockAfter (this1,pos);
+  if (i < arrayMax (this1->nBlocks)) {
+    block = arrp (this1->nBlocks,i,PackedSeqBlock);
+    if (block->start < pos + k)
+      return 0;
+  }
+  bits = this1->words[pos >> 5] << (2 * off);
+  if (off + k > PACKED_SEQ_BASES_PER_WORD)
+    bits |= this1->words[(pos >> 5) + 1] >> (64 - 2 * off);
+  *kmer = bits >> (64 - 2 * k);
+  return 1;
+}
+
+
+
+/**
+ * Reverse complement a packed sequence in place, a word at a time.
+ * N runs and the mask are mirrored accordingly.
+ */
+void packedSeq_reverseComplement (PackedSeq this1)
+{
+  unsigned long long *words = this1->words;
+  unsigned long long tmp;
+  PackedSeqBlock *a;
+  PackedSeqBlock *b;
+  PackedSeqBlock swap;
+  Bits *mask;
+  int nWords = packedSeq_wordCount (this1->size);
+  int shift;
+  int i;
+
+  for (i = 0; i < nWords / 2; i++) {
+    tmp = seq_reverseComplementPacked (words[i],PACKED_SEQ_BASES_PER_WORD);
+    words[i] = seq_reverseComplementPacked (words[nWords - 1 - i],PACKED_SEQ_BASES_PER_WORD);
+    words[nWords - 1 - i] = tmp;
+  }
+  if (nWords & 1)
+    words[nWords / 2] = seq_reverseComplementPacked (words[nWords / 2],PACKED_SEQ_BASES_PER_WORD);
+  /* the unused bases at the end of the last word are now at the start */
+  shift = 2 * (nWords * PACKED_SEQ_BASES_PER_WORD - this1->size);
+  if (shift > 0) {
+    for (i = 0; i < nWords - 1; i++)
+      words[i] = (words[i] << shift) | (words[i + 1] >> (64 - shift));
+    words[nWords - 1] <<= shift;
+  }
+  for (i = 0; i < arrayMax (this1->nBlocks); i++) {
+    a = arrp (this1->nBlocks,i,PackedSeqBlock);
+    a->start = this1->size - a->start - a->size;
+  }
+  for (i = 0; i < arrayMax (this1->nBlocks) / 2; i++) {
+    a = arrp (this1->nBlocks,i,PackedSeqBlock);
+    b = arrp (this1->nBlocks,arrayMax (this1->nBlocks) - 1 - i,PackedSeqBlock);
+    swap = *a;
+    *a = *b;
+    *b = swap;
+  }
+  if (this1->mask) {
+    mask = bitAlloc (this1->size);
+    for (i = 0; i < this1->size; i++)
+      if (bitReadOne (this1->mask,i))
+        bitSetOne (mask,this1->size - 1 - i);
+    bitFree (&this1->mask);
+    this1->mask = mask;
+  }
+}
+
+
+
+/**
+ * Write a packed sequence as FASTA, unpacking it in chunks.
+ * @param[in] this1 A packed sequence
+ * @param[in] writer A FASTA writer
+ */
+void packedSeq_writeFasta (PackedSeq this1, FastaWriter writer)
+{
+  char *buf = hlr_malloc (PACKED_SEQ_UNPACK_CHUNK + 1);
+  int pos;
+  int n;
+
+  fasta_writerBegin (writer,this1->name);
+  for (pos = 0; pos < this1->size; pos += n) {
+    n = MIN (PACKED_SEQ_UNPACK_CHUNK,this1->size - pos);
+    packedSeq_unpack (this1,pos,pos + n,buf);
+    fasta_writerAppend (writer,buf,n);
+  }
+  fasta_writerEnd (writer);
+  hlr_free (buf);
+}
+
+
+
+/**
+ * Destroy a packed sequence.
+ * @param[in] this1 A packed sequence
+ * @note Do not call this function, but use the macro packedSeq_destroy
+ */
+void packedSeq_destroy_func (PackedSeq this1)
+{
+  if (!this1)
+    return;
+  hlr_free (this1->name);
+  hlr_free (this1->words);
+  arrayDestroy (this1->nBlocks);
+  bitFree (&this1->mask);
+  hlr_free (this1);
+}
@@ -0,0 +1,70 @@
+/**
+ *   \file packedSeq.h
+ */
+
+
+#ifndef DEF_PACKED_SEQ_H
+#define DEF_PACKED_SEQ_H
+
+
+#include "seq.h"
+#include "fasta.h"
+
+
+/**
+ * Number of bases in one word of a PackedSeq.
+ */
+#define PACKED_SEQ_BASES_PER_WORD 32
+
+
+
+/**
+ * PackedSeqBlock.
+ * A run of N in a PackedSeq.
+ */
+typedef struct {
+  int start;
+  int size;
+} PackedSeqBlock;
+
+
+
+/**
+ * PackedSeq.
+ * DNA with 2 bits per base, using the X_BASE_VAL codes of the seq module
+ * (T=0, C=1, A=2, G=3); the first base of a word is in its highest bits.
+ * Bases in an N run are stored as T.
+ */
+typedef struct _packedSeqStruct_ {
+  /* the members of this struct are PRIVATE for the
+     packedSeq module -- DO NOT access from outside
+     the packedSeq module */
+  char *name;
+  int size;                    /* number of bases */
+  unsigned long long *words;   /* (size + 31) / 32 words */
+  Array nBlocks;               /* of PackedSeqBlock, sorted by start */
+  Bits *mask;                  /* bit set for soft-masked (lower case) bases; NULL if there are none */
+} *PackedSeq;
+
+
+
+extern PackedSeq packedSeq_fromDna (char *name, DNA *dna, int size);
+extern PackedSeq packedSeq_fromSeq (Seq *seq);
+extern PackedSeq packedSeq_nextFromFasta (int truncateName);
+extern Seq *packedSeq_toSeq (PackedSeq this1);
+extern char *packedSeq_nameGet (PackedSeq this1);
+extern int packedSeq_sizeGet (PackedSeq this1);
+extern void packedSeq_unpack (PackedSeq this1, int start, int end, DNA *out);
+extern int packedSeq_kmer (PackedSeq this1, int pos, int k, unsigned long long *kmer);
+extern void packedSeq_reverseComplement (PackedSeq this1);
+extern void packedSeq_writeFasta (PackedSeq this1, FastaWriter writer);
+extern void packedSeq_destroy_func (PackedSeq this1); /* do not use this function */
+
+/**
+ * Destroy a packed sequence.
+ * @see packedSeq_destroy_func()
+ */
+#define packedSeq_destroy(this1) (packedSeq_destroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -0,0 +1,247 @@
+/**
+ *   \file qualStore.c Module for compact storage of FASTQ qualities
+ */
+
+
+/*
+   Module qualStore
+   Qualities of neighbouring bases differ little and often repeat, so each
+   quality string is stored as a sequence of one-byte tokens: the upper 5
+   bits hold the difference to the previous quality (-15..15) and the lower
+   3 bits the number of repeats (1..8). A difference out of range is
+   escaped by the code 31 and followed by the quality itself. With binning,
+   qualities are quantised to the 8 Illumina bins, which turns most of a
+   read into long runs; a token then holds the bin in its upper 3 bits and
+   the number of repeats (1..32) in its lower 5 bits.
+   Qualities are expected in Phred+33 encoding.
+*/
+
+
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "qualStore.h"
+
+
+
+#define QUAL_STORE_ESCAPE 31
+#define QUAL_STORE_MAX_DELTA 15
+#define QUAL_STORE_MAX_RUN 8
+#define QUAL_STORE_MAX_BIN_RUN 32
+#define QUAL_STORE_START ('!' + 30)  /* previous quality assumed before the first one */
+
+
+
+/**
+ * Create an empty quality store.
+ * @param[in] binned If 1, qualities are quantised to the Illumina 8-level scheme 
+   (0-2: 2, 3-9: 6, 10-19: 15, 20-24: 22, 25-29: 27, 30-34: 33, 35-39: 37, 40 and up: 40);
+   this is lossy but much more compact. If 0, qualities are kept exactly.
+ * @return A quality store
+ */
+QualStore qualStore_create (int binned)
+{
+  QualStore this1 = (QualStore) hlr_malloc (sizeof (struct _qualStoreStruct_));
+
+  this1->dataSize = 1 << 16;
+  this1->data = (unsigned char *) hlr_malloc (this1->dataSize);
+  this1->dataLen = 0;
+  this1->offsets = arrayCreate (10000,long long);
+  this1->lengths = arrayCreate (10000,int);
+  this1->binned = binned;
+  return this1;
+}
+
+
+
+/* quality of each bin */
+static char binQuality[8] = {'!' + 2,'!' + 6,'!' + 15,'!' + 22,'!' + 27,'!' + 33,'!' + 37,'!' + 40};
+
+
+
+static int qualStore_bin (char c)
+{
+  int q = c - '!';
+
+  if (q < 3)
+    return 0;
+  if (q < 10)
+    return 1;
+  if (q < 20)
+    return 2;
+  if (q < 25)
+    return 3;
+  if (q < 30)
+    return 4;
+  if (q < 35)
+    return 5;
+  if (q < 40)
+    return 6;
+  return 7;
+}
+
+
+
+static unsigned char *qualStore_encodeBinned (char *quality, int len, unsigned char *out)
+{
+  int bin;
+  int run;
+  int i = 0;
+
+  while (i < len) {
+    bin = qualStore_bin (quality[i]);
+    run = 1;
+    while (i + run < len && run < QUAL_STORE_MAX_BIN_RUN && qualStore_bin (quality[i + run]) == bin)
+      run++;
+    *out++ = (bin << 5) | (run - 1);
+    i += run;
+  }
+  return out;
+}
+
+
+
+static unsigned char *qualStore_encode (char *quality, int len, unsigned char *out)
+{
+  int prev = QUAL_STORE_START;
+  int delta;
+  int run;
+  int c;
+  int i = 0;
+
+  while (i < len) {
+    c = (unsigned char)quality[i];
+    run = 1;
+    while (i + run < len && run < QUAL_STORE_MAX_RUN && quality[i + run] == c)
+      run++;
+    delta = c - prev;
+    if (delta < -QUAL_STORE_MAX_DELTA || delta > QUAL_STORE_MAX_DELTA) {
+      *out++ = (QUAL_STORE_ESCAPE << 3) | (run - 1);
+      *out++ = c;
+    }
+    else
+      *out++ = ((delta + QUAL_STORE_MAX_DELTA) << 3) | (run - 1);
+    prev = c;
+    i += run;
+  }
+  return out;
+}
+
+
+
+/**
+ * Add the quality string of the next record.
+ * @param[in] this1 A quality store
+ * @param[in] quality Quality string, Phred+33, need not be null-terminated
+ * @param[in] len Number of characters in quality
+ * @return Index of the record, 0 for the first one
+ */
+int qualStore_add (QualStore this1, char *quality, int len)
+{
+  unsigned char *end;
+
+  if (this1->dataLen + 2LL * len > this1->dataSize) {
+    while (this1->dataLen + 2LL * len > this1->dataSize)
+      this1->dataSize *= 2;
+    this1->data = (unsigned char *) hlr_realloc (this1->data,this1->dataSize);
+    if (!this1->data)
+      die ("qualStore: out of memory for %lld bytes",this1->dataSize);
+  }
+  array (this1->offsets,arrayMax (this1->offsets),long long) = this1->dataLen;
+  array (this1->lengths,arrayMax (this1->lengths),int) = len;
+  if (this1->binned)
+    end = qualStore_encodeBinned (quality,len,this1->data + this1->dataLen);
+  else
+    end = qualStore_encode (quality,len,this1->data + this1->dataLen);
+  this1->dataLen = end - this1->data;
+  return arrayMax (this1->offsets) - 1;
+}
+
+
+
+/**
+ * Number of records in a quality store.
+ */
+int qualStore_countGet (QualStore this1)
+{
+  return arrayMax (this1->offsets);
+}
+
+
+
+/**
+ * Length of the quality string of record i.
+ */
+int qualStore_lengthGet (QualStore this1, int i)
+{
+  if (i < 0 || i >= arrayMax (this1->lengths))
+    die ("qualStore_lengthGet: no record %d",i);
+  return arru (this1->lengths,i,int);
+}
+
+
+
+/**
+ * Decode the quality string of record i.
+ * @param[in] this1 A quality store
+ * @param[in] i Index of the record, see qualStore_add()
+ * @param[out] quality Receives the null-terminated quality string; must have room for 
+   qualStore_lengthGet() + 1 characters
+ * @note Can be called from several threads at the same time.
+ */
+void qualStore_get (QualStore this1, int i, char *quality)
+{
+  unsigned char *in;
+  char *end;
+  int prev = QUAL_STORE_START;
+  int code;
+  int run;
+
+  if (i < 0 || i >= arrayMax (this1->offsets))
+    die ("qualStore_get: no record %d",i);
+  in = this1->data + arru (this1->offsets,i,long long);
+  end = quality + arru (this1->lengths,i,int);
+  if (this1->binned) {
+    while (quality < end) {
+      run = (*in & 31) + 1;
+      memset (quality,binQuality[*in++ >> 5],run);
+      quality += run;
+    }
+    *quality = '\0';
+    return;
+  }
+  while (quality < end) {
+    code = *in >> 3;
+    run = (*in++ & 7) + 1;
+    prev = code == QUAL_STORE_ESCAPE ? *in++ : prev + code - QUAL_STORE_MAX_DELTA;
+    memset (quality,prev,run);
+    quality += run;
+  }
+  *quality = '\0';
+}
+
+
+
+/**
+ * Number of bytes used by a quality store, for comparing against plain strings.
+ */
+long long qualStore_bytesGet (QualStore this1)
+{
+  return this1->dataLen + arrayMax (this1->offsets) * (sizeof (long long) + sizeof (int));
+}
+
+
+
+/**
+ * Destroy a quality store.
+ * @note Do not call this function, but use the macro qualStore_destroy
+ */
+void qualStore_destroy_func (QualStore this1)
+{
+  if (!this1)
+    return;
+  hlr_free (this1->data);
+  arrayDestroy (this1->offsets);
+  arrayDestroy (this1->lengths);
+  hlr_free (this1);
+}
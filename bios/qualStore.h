@@ -0,0 +1,47 @@
+/**
+ *   \file qualStore.h
+ */
+
+
+#ifndef DEF_QUAL_STORE_H
+#define DEF_QUAL_STORE_H
+
+
+#include "format.h"
+
+
+/**
+ * QualStore.
+ * Quality strings of many reads, each compressed with delta and run-length coding;
+   record i can be decoded on its own.
+ */
+typedef struct _qualStoreStruct_ {
+  /* the members of this struct are PRIVATE for the
+     qualStore module -- DO NOT access from outside
+     the qualStore module */
+  unsigned char *data;    /* encoded qualities of all records */
+  long long dataLen;
+  long long dataSize;
+  Array offsets;          /* of long long, into data, one per record */
+  Array lengths;          /* of int, decoded length of each record */
+  int binned;             /* 1 if qualities are quantised to 8 bins before encoding */
+} *QualStore;
+
+
+
+extern QualStore qualStore_create (int binned);
+extern int qualStore_add (QualStore this1, char *quality, int len);
+extern int qualStore_countGet (QualStore this1);
+extern int qualStore_lengthGet (QualStore this1, int i);
+extern void qualStore_get (QualStore this1, int i, char *quality);
+extern long long qualStore_bytesGet (QualStore this1);
+extern void qualStore_destroy_func (QualStore this1); /* do not use this function */
+
+/**
+ * Destroy a quality store.
+ * @see qualStore_destroy_func()
+ */
+#define qualStore_destroy(this1) (qualStore_destroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -127,82 +127,184 @@ struct codonTable codonTable[] =
 			     3 for g
  * (which is order aa's are in biochemistry codon tables)
  * and gives -1 for all others. */
-int ntVal[256];
-int ntValLower[256];	/* NT values only for lower case. */
-int ntValUpper[256];	/* NT values only for upper case. */
-int ntVal5[256];
-int ntValNoN[256]; /* Like ntVal, but with T_BASE_VAL in place of -1 for nonexistent ones. */
-DNA valToNt[(N_BASE_VAL|MASKED_BASE_BIT)+1];
+const int ntVal[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,2,-1,1,-1,-1,-1,3,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,0,0,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,2,-1,1,-1,-1,-1,3,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,0,0,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
 
-/* convert tables for bit-4 indicating masked */
-int ntValMasked[256];
-DNA valToNtMasked[256];
+/* NT values only for lower case. */
+const int ntValLower[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,2,-1,1,-1,-1,-1,3,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,0,0,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
 
+/* NT values only for upper case. */
+const int ntValUpper[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,2,-1,1,-1,-1,-1,3,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,0,0,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
 
-static int inittedNtVal = 0;
+/* Like ntVal, but with N_BASE_VAL for all other characters except white space and digits. */
+const int ntVal5[256] = {
+  4,4,4,4,4,4,4,4,4,-1,-1,-1,-1,-1,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  -1,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,4,4,4,4,4,4,
+  4,2,4,1,4,4,4,3,4,4,4,4,4,4,4,4,
+  4,4,4,4,0,0,4,4,4,4,4,4,4,4,4,4,
+  4,2,4,1,4,4,4,3,4,4,4,4,4,4,4,4,
+  4,4,4,4,0,0,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4
+};
 
-static void initNtVal()
-{
-  if (!inittedNtVal)
-    {
-      int i;
-      for (i=0; i<NUMELE(ntVal); i++)
-        {
-	  ntValUpper[i] = ntValLower[i] = ntVal[i] = -1;
-	  ntValNoN[i] = T_BASE_VAL;
-	  if (isspace(i) || isdigit(i))
-	    ntVal5[i] = ntValMasked[i] = -1;
-	  else
-            {
-	      ntVal5[i] = N_BASE_VAL;
-	      ntValMasked[i] = (islower(i) ? (N_BASE_VAL|MASKED_BASE_BIT) : N_BASE_VAL);
-            }
-        }
-      ntVal5['t'] = ntVal5['T'] = ntValNoN['t'] = ntValNoN['T'] = ntVal['t'] = ntVal['T'] = 
-    	ntValLower['t'] = ntValUpper['T'] = T_BASE_VAL;
-      ntVal5['u'] = ntVal5['U'] = ntValNoN['u'] = ntValNoN['U'] = ntVal['u'] = ntVal['U'] = 
-    	ntValLower['u'] = ntValUpper['U'] = U_BASE_VAL;
-      ntVal5['c'] = ntVal5['C'] = ntValNoN['c'] = ntValNoN['C'] = ntVal['c'] = ntVal['C'] = 
-    	ntValLower['c'] = ntValUpper['C'] = C_BASE_VAL;
-      ntVal5['a'] = ntVal5['A'] = ntValNoN['a'] = ntValNoN['A'] = ntVal['a'] = ntVal['A'] = 
-    	ntValLower['a'] = ntValUpper['A'] = A_BASE_VAL;
-      ntVal5['g'] = ntVal5['G'] = ntValNoN['g'] = ntValNoN['G'] = ntVal['g'] = ntVal['G'] = 
-    	ntValLower['g'] = ntValUpper['G'] = G_BASE_VAL;
-      
-      valToNt[T_BASE_VAL] = valToNt[T_BASE_VAL|MASKED_BASE_BIT] = 't';
-      valToNt[C_BASE_VAL] = valToNt[C_BASE_VAL|MASKED_BASE_BIT] = 'c';
-      valToNt[A_BASE_VAL] = valToNt[A_BASE_VAL|MASKED_BASE_BIT] = 'a';
-      valToNt[G_BASE_VAL] = valToNt[G_BASE_VAL|MASKED_BASE_BIT] = 'g';
-      valToNt[N_BASE_VAL] = valToNt[N_BASE_VAL|MASKED_BASE_BIT] = 'n';
-      
-      /* masked values */
-      ntValMasked['T'] = T_BASE_VAL;
-      ntValMasked['U'] = U_BASE_VAL;
-      ntValMasked['C'] = C_BASE_VAL;
-      ntValMasked['A'] = A_BASE_VAL;
-      ntValMasked['G'] = G_BASE_VAL;
-      
-      ntValMasked['t'] = T_BASE_VAL|MASKED_BASE_BIT;
-      ntValMasked['u'] = U_BASE_VAL|MASKED_BASE_BIT;
-      ntValMasked['c'] = C_BASE_VAL|MASKED_BASE_BIT;
-      ntValMasked['a'] = A_BASE_VAL|MASKED_BASE_BIT;
-      ntValMasked['g'] = G_BASE_VAL|MASKED_BASE_BIT;
-      
-      valToNtMasked[T_BASE_VAL] = 'T';
-      valToNtMasked[C_BASE_VAL] = 'C';
-      valToNtMasked[A_BASE_VAL] = 'A';
-      valToNtMasked[G_BASE_VAL] = 'G';
-      valToNtMasked[N_BASE_VAL] = 'N';
-      
-      valToNtMasked[T_BASE_VAL|MASKED_BASE_BIT] = 't';
-      valToNtMasked[C_BASE_VAL|MASKED_BASE_BIT] = 'c';
-      valToNtMasked[A_BASE_VAL|MASKED_BASE_BIT] = 'a';
-      valToNtMasked[G_BASE_VAL|MASKED_BASE_BIT] = 'g';
-      valToNtMasked[N_BASE_VAL|MASKED_BASE_BIT] = 'n';
-      
-      inittedNtVal = 1;
-    }
-}
+/* Like ntVal, but with T_BASE_VAL in place of -1 for nonexistent ones. */
+const int ntValNoN[256] = {
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,2,0,1,0,0,0,3,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,2,0,1,0,0,0,3,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
+
+const DNA valToNt[(N_BASE_VAL|MASKED_BASE_BIT)+1] = {
+  't','c','a','g','n',0,0,0,'t','c','a','g','n'
+};
+
+/* Four upper case bases for each byte of DNA packed 2 bits per base with the
+ * X_BASE_VAL codes, first base in the highest bits; used by packedSeq and twoBit. */
+const DNA packedByteToNt[256][4] = {
+  "TTTT","TTTC","TTTA","TTTG","TTCT","TTCC","TTCA","TTCG",
+  "TTAT","TTAC","TTAA","TTAG","TTGT","TTGC","TTGA","TTGG",
+  "TCTT","TCTC","TCTA","TCTG","TCCT","TCCC","TCCA","TCCG",
+  "TCAT","TCAC","TCAA","TCAG","TCGT","TCGC","TCGA","TCGG",
+  "TATT","TATC","TATA","TATG","TACT","TACC","TACA","TACG",
+  "TAAT","TAAC","TAAA","TAAG","TAGT","TAGC","TAGA","TAGG",
+  "TGTT","TGTC","TGTA","TGTG","TGCT","TGCC","TGCA","TGCG",
+  "TGAT","TGAC","TGAA","TGAG","TGGT","TGGC","TGGA","TGGG",
+  "CTTT","CTTC","CTTA","CTTG","CTCT","CTCC","CTCA","CTCG",
+  "CTAT","CTAC","CTAA","CTAG","CTGT","CTGC","CTGA","CTGG",
+  "CCTT","CCTC","CCTA","CCTG","CCCT","CCCC","CCCA","CCCG",
+  "CCAT","CCAC","CCAA","CCAG","CCGT","CCGC","CCGA","CCGG",
+  "CATT","CATC","CATA","CATG","CACT","CACC","CACA","CACG",
+  "CAAT","CAAC","CAAA","CAAG","CAGT","CAGC","CAGA","CAGG",
+  "CGTT","CGTC","CGTA","CGTG","CGCT","CGCC","CGCA","CGCG",
+  "CGAT","CGAC","CGAA","CGAG","CGGT","CGGC","CGGA","CGGG",
+  "ATTT","ATTC","ATTA","ATTG","ATCT","ATCC","ATCA","ATCG",
+  "ATAT","ATAC","ATAA","ATAG","ATGT","ATGC","ATGA","ATGG",
+  "ACTT","ACTC","ACTA","ACTG","ACCT","ACCC","ACCA","ACCG",
+  "ACAT","ACAC","ACAA","ACAG","ACGT","ACGC","ACGA","ACGG",
+  "AATT","AATC","AATA","AATG","AACT","AACC","AACA","AACG",
+  "AAAT","AAAC","AAAA","AAAG","AAGT","AAGC","AAGA","AAGG",
+  "AGTT","AGTC","AGTA","AGTG","AGCT","AGCC","AGCA","AGCG",
+  "AGAT","AGAC","AGAA","AGAG","AGGT","AGGC","AGGA","AGGG",
+  "GTTT","GTTC","GTTA","GTTG","GTCT","GTCC","GTCA","GTCG",
+  "GTAT","GTAC","GTAA","GTAG","GTGT","GTGC","GTGA","GTGG",
+  "GCTT","GCTC","GCTA","GCTG","GCCT","GCCC","GCCA","GCCG",
+  "GCAT","GCAC","GCAA","GCAG","GCGT","GCGC","GCGA","GCGG",
+  "GATT","GATC","GATA","GATG","GACT","GACC","GACA","GACG",
+  "GAAT","GAAC","GAAA","GAAG","GAGT","GAGC","GAGA","GAGG",
+  "GGTT","GGTC","GGTA","GGTG","GGCT","GGCC","GGCA","GGCG",
+  "GGAT","GGAC","GGAA","GGAG","GGGT","GGGC","GGGA","GGGG"
+};
+
+/* convert tables for bit-4 indicating masked */
+const int ntValMasked[256] = {
+  4,4,4,4,4,4,4,4,4,-1,-1,-1,-1,-1,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  -1,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,4,4,4,4,4,4,
+  4,2,4,1,4,4,4,3,4,4,4,4,4,4,4,4,
+  4,4,4,4,0,0,4,4,4,4,4,4,4,4,4,4,
+  4,10,12,9,12,12,12,11,12,12,12,12,12,12,12,12,
+  12,12,12,12,8,8,12,12,12,12,12,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+  4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4
+};
+
+const DNA valToNtMasked[256] = {
+  'T','C','A','G','N',0,0,0,'t','c','a','g','n',0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
 
 
 
@@ -213,10 +315,7 @@ AA seq_lookupCodon(DNA *dna)
 {
   int ix;
   int i;
-  char c;
-  
-  if (!inittedNtVal)
-    initNtVal();
+
   ix = 0;
   for (i=0; i<3; ++i)
     {
@@ -225,9 +324,7 @@ AA seq_lookupCodon(DNA *dna)
 	return 'X';
       ix = (ix<<2) + bv;
     }
-  c = codonTable[ix].protCode;
-  c = toupper(c);
-  return c;
+  return codonTable[ix].protCode;
 }
 
 
@@ -239,10 +336,7 @@ AA seq_lookupMitochondrialCodon(DNA *dna)
 {
   int ix;
   int i;
-  char c;
 
-  if (!inittedNtVal)
-    initNtVal();
   ix = 0;
   for (i=0; i<3; ++i)
     {
@@ -251,9 +345,7 @@ AA seq_lookupMitochondrialCodon(DNA *dna)
 	return 'X';
       ix = (ix<<2) + bv;
     }
-  c = codonTable[ix].mitoCode;
-  c = toupper(c);
-  return c;
+  return codonTable[ix].mitoCode;
 }
 
 
@@ -312,103 +404,202 @@ char* seq_dnaTranslate (DNA *dna, int terminateAtStopCodon)
 
 /* A little array to help us decide if a character is a 
  * nucleotide, and if so convert it to lower case. */
-char ntChars[256];
+const DNA ntChars[256] = {
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,'n',0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,'a',0,'c',0,0,0,'g',0,0,0,0,0,0,'n',0,
+  0,0,0,0,'t','u',0,0,0,0,0,0,0,0,0,0,
+  0,'a',0,'c',0,0,0,'g',0,0,0,0,0,0,'n',0,
+  0,0,0,0,'t','u',0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
+
+/* Like ntChars, but keeps the case. */
+const DNA ntMixedCaseChars[256] = {
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,'n',0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,'A',0,'C',0,0,0,'G',0,0,0,0,0,0,'N',0,
+  0,0,0,0,'T','U',0,0,0,0,0,0,0,0,0,0,
+  0,'a',0,'c',0,0,0,'g',0,0,0,0,0,0,'n',0,
+  0,0,0,0,'t','u',0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
+
+
+
+/* Complement of IUPAC codes, keeping the case; 0 for other characters. */
+const DNA ntCompTable[256] = {
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  ' ',0,0,0,0,0,0,0,')','(',0,0,0,'-','.',0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,'=',0,0,
+  0,'T','V','G','H',0,0,'C','D',0,0,'M',0,'K','N',0,
+  0,0,'Y','S','A','A','B','W','N','R',0,0,0,0,0,0,
+  0,'t','v','g','h',0,0,'c','d',0,0,'m',0,'k','n',0,
+  0,0,'y','s','a','a','b','w','n','r',0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
+
 
-static void initNtChars()
+
+static void seq_complementScalar (DNA *dna, long length)
 {
-  static int initted = 0;
+  long i;
 
-  if (!initted)
-    {
-      zeroBytes(ntChars, sizeof(ntChars));
-      ntChars['a'] = ntChars['A'] = 'a';
-      ntChars['c'] = ntChars['C'] = 'c';
-      ntChars['g'] = ntChars['G'] = 'g';
-      ntChars['t'] = ntChars['T'] = 't';
-      ntChars['n'] = ntChars['N'] = 'n';
-      ntChars['u'] = ntChars['U'] = 'u';
-      ntChars['-'] = 'n';
-      initted = 1;
-    }
+  for (i = 0; i < length; i++)
+    dna[i] = ntCompTable[(unsigned char)dna[i]];
+}
+
+
+
+static void seq_reverseComplementScalar (DNA *front, long n, DNA *back)
+{ /* swaps and complements front[0..n-1] with back[n-1..0] */
+  DNA c;
+  long i;
+
+  for (i = 0; i < n; i++) {
+    c = ntCompTable[(unsigned char)front[i]];
+    front[i] = ntCompTable[(unsigned char)back[n - 1 - i]];
+    back[n - 1 - i] = c;
+  }
+}
+
+
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define SEQ_SSSE3
+#include <tmmintrin.h>
+
+
+
+/* 
+ * Letters are complemented 16 at a time with two pshufb lookups on their
+ * lower 5 bits, which are the same for upper and lower case; the case bits
+ * are kept. 0 means the letter has no complement (ntCompTable gives 0 too).
+ * Blocks with other characters than letters go the scalar way.
+ */
+static const char compLow5[32] = {
+  0,20,22,7,8,0,0,3,4,0,0,13,0,11,14,0,
+  0,0,25,19,1,1,2,23,14,18,0,0,0,0,0,0,
+};
+
+
+
+__attribute__ ((target ("ssse3")))
+static int seq_complementVector (__m128i *v)
+{ /* complements the letters in v; returns 0 if v contains other characters */
+  __m128i letters = _mm_cmpeq_epi8 (_mm_and_si128 (*v,_mm_set1_epi8 ((char)0xC0)),_mm_set1_epi8 (0x40));
+  __m128i idx;
+  __m128i lo,hi,comp;
+
+  if (_mm_movemask_epi8 (letters) != 0xFFFF)
+    return 0;
+  idx = _mm_and_si128 (*v,_mm_set1_epi8 (0x1F));
+  lo = _mm_shuffle_epi8 (_mm_loadu_si128 ((__m128i *)compLow5),idx);
+  hi = _mm_shuffle_epi8 (_mm_loadu_si128 ((__m128i *)(compLow5 + 16)),idx);
+  comp = _mm_cmpgt_epi8 (idx,_mm_set1_epi8 (15));
+  comp = _mm_or_si128 (_mm_and_si128 (comp,hi),_mm_andnot_si128 (comp,lo));
+  *v = _mm_andnot_si128 (_mm_cmpeq_epi8 (comp,_mm_setzero_si128 ()),
+                         _mm_or_si128 (_mm_and_si128 (*v,_mm_set1_epi8 ((char)0xE0)),comp));
+  return 1;
 }
 
-char ntMixedCaseChars[256];
 
-static void initNtMixedCaseChars()
+
+__attribute__ ((target ("ssse3")))
+static __m128i seq_reverseVector (__m128i v)
 {
-  static int initted = 0;
-  
-  if (!initted)
-    {
-      zeroBytes(ntMixedCaseChars, sizeof(ntMixedCaseChars));
-      ntMixedCaseChars['a'] = 'a';
-      ntMixedCaseChars['A'] = 'A';
-      ntMixedCaseChars['c'] = 'c';
-      ntMixedCaseChars['C'] = 'C';
-      ntMixedCaseChars['g'] = 'g';
-      ntMixedCaseChars['G'] = 'G';
-      ntMixedCaseChars['t'] = 't';
-      ntMixedCaseChars['T'] = 'T';
-      ntMixedCaseChars['n'] = 'n';
-      ntMixedCaseChars['N'] = 'N';
-      ntMixedCaseChars['u'] = 'u';
-      ntMixedCaseChars['U'] = 'U';
-      ntMixedCaseChars['-'] = 'n';
-      initted = 1;
-    }
+  return _mm_shuffle_epi8 (v,_mm_set_epi8 (0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15));
 }
 
 
 
-DNA ntCompTable[256];
-static int inittedCompTable = 0;
+__attribute__ ((target ("ssse3")))
+static long seq_complementSsse3 (DNA *dna, long length)
+{ /* returns the number of bases done */
+  __m128i v;
+  long i;
+
+  for (i = 0; i + 16 <= length; i += 16) {
+    v = _mm_loadu_si128 ((__m128i *)(dna + i));
+    if (seq_complementVector (&v))
+      _mm_storeu_si128 ((__m128i *)(dna + i),v);
+    else
+      seq_complementScalar (dna + i,16);
+  }
+  return i;
+}
+
+
 
-static void initNtCompTable()
+__attribute__ ((target ("ssse3")))
+static void seq_reverseComplementSsse3 (DNA *dna, long length)
 {
-  zeroBytes(ntCompTable, sizeof(ntCompTable));
-  ntCompTable[' '] = ' ';
-  ntCompTable['-'] = '-';
-  ntCompTable['='] = '=';
-  ntCompTable['a'] = 't';
-  ntCompTable['c'] = 'g';
-  ntCompTable['g'] = 'c';
-  ntCompTable['t'] = 'a';
-  ntCompTable['u'] = 'a';
-  ntCompTable['n'] = 'n';
-  ntCompTable['-'] = '-';
-  ntCompTable['.'] = '.';
-  ntCompTable['A'] = 'T';
-  ntCompTable['C'] = 'G';
-  ntCompTable['G'] = 'C';
-  ntCompTable['T'] = 'A';
-  ntCompTable['U'] = 'A';
-  ntCompTable['N'] = 'N';
-  ntCompTable['R'] = 'Y';
-  ntCompTable['Y'] = 'R';
-  ntCompTable['M'] = 'K';
-  ntCompTable['K'] = 'M';
-  ntCompTable['S'] = 'S';
-  ntCompTable['W'] = 'W';
-  ntCompTable['V'] = 'B';
-  ntCompTable['H'] = 'D';
-  ntCompTable['D'] = 'H';
-  ntCompTable['B'] = 'V';
-  ntCompTable['X'] = 'N';
-  ntCompTable['r'] = 'y';
-  ntCompTable['y'] = 'r';
-  ntCompTable['s'] = 's';
-  ntCompTable['w'] = 'w';
-  ntCompTable['m'] = 'k';
-  ntCompTable['k'] = 'm';
-  ntCompTable['v'] = 'b';
-  ntCompTable['h'] = 'd';
-  ntCompTable['d'] = 'h';
-  ntCompTable['b'] = 'v';
-  ntCompTable['x'] = 'n';
-  ntCompTable['('] = ')';
-  ntCompTable[')'] = '(';
-  inittedCompTable = 1;
+  DNA *front = dna;
+  DNA *back = dna + length;
+  __m128i a,b;
+
+  while (back - front >= 32) {
+    a = _mm_loadu_si128 ((__m128i *)front);
+    b = _mm_loadu_si128 ((__m128i *)(back - 16));
+    if (seq_complementVector (&a) && seq_complementVector (&b)) {
+      _mm_storeu_si128 ((__m128i *)front,seq_reverseVector (b));
+      _mm_storeu_si128 ((__m128i *)(back - 16),seq_reverseVector (a));
+    }
+    else {
+      seq_reverseComplementScalar (front,16,back - 16);
+    }
+    front += 16;
+    back -= 16;
+  }
+  seq_reverseComplementScalar (front,(back - front) / 2,back - (back - front) / 2);
+  if ((back - front) & 1)
+    front[(back - front) / 2] = ntCompTable[(unsigned char)front[(back - front) / 2]];
+}
+
+
+
+__attribute__ ((target ("ssse3")))
+static long seq_reverseComplementCopySsse3 (DNA *dna, long length, DNA *out)
+{ /* returns the number of bases done */
+  __m128i v;
+  long i;
+
+  for (i = 0; i + 16 <= length; i += 16) {
+    v = _mm_loadu_si128 ((__m128i *)(dna + length - 16 - i));
+    if (seq_complementVector (&v))
+      _mm_storeu_si128 ((__m128i *)(out + i),seq_reverseVector (v));
+    else
+      break;
+  }
+  return i;
 }
+#endif
 
 
 
@@ -417,26 +608,91 @@ static void initNtCompTable()
  */
 void seq_complement(DNA *dna, long length)
 {
-  int i;
-  
-  if (!inittedCompTable) 
-    initNtCompTable();
-  for (i=0; i<length; ++i)
-    {
-      *dna = ntCompTable[(int)*dna];
-      ++dna;
-    }
+  long done = 0;
+
+#ifdef SEQ_SSSE3
+  if (__builtin_cpu_supports ("ssse3"))
+    done = seq_complementSsse3 (dna,length);
+#endif
+  seq_complementScalar (dna + done,length - done);
 }
 
 
 
 /**
- * Reverse complement DNA. 
+ * Reverse complement DNA in a single pass; 16 bases at a time if the CPU has SSSE3.
  */
 void seq_reverseComplement(DNA *dna, long length)
 {
-  reverseBytes(dna, length);
-  seq_complement(dna, length);
+#ifdef SEQ_SSSE3
+  if (__builtin_cpu_supports ("ssse3")) {
+    seq_reverseComplementSsse3 (dna,length);
+    return;
+  }
+#endif
+  seq_reverseComplementScalar (dna,length / 2,dna + length - length / 2);
+  if (length & 1)
+    dna[length / 2] = ntCompTable[(unsigned char)dna[length / 2]];
+}
+
+
+
+/**
+ * Write the reverse complement of DNA to another buffer.
+ * @param[in] dna Bases, left unchanged
+ * @param[in] length Number of bases
+ * @param[out] out Receives length bases (no terminating '\0'); must not overlap dna
+ */
+void seq_reverseComplementCopy(DNA *dna, long length, DNA *out)
+{
+  long done = 0;
+  long i;
+
+#ifdef SEQ_SSSE3
+  if (__builtin_cpu_supports ("ssse3"))
+    done = seq_reverseComplementCopySsse3 (dna,length,out);
+#endif
+  for (i = done; i < length; i++)
+    out[i] = ntCompTable[(unsigned char)dna[length - 1 - i]];
+}
+
+
+
+/**
+ * Reverse complement a k-mer packed 2 bits per base with the X_BASE_VAL codes
+   (first base in the highest bits), using that the complement of a code is the code xor 2.
+ * @param[in] packed The k-mer, in the lowest 2*k bits
+ * @param[in] k Number of bases, 1 to 32
+ * @return The reverse complement, in the lowest 2*k bits
+ */
+unsigned long long seq_reverseComplementPacked(unsigned long long packed, int k)
+{
+  unsigned long long x = packed;
+
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  x = ((x >> 8) & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+  x = ((x >> 16) & 0x0000FFFF0000FFFFULL) | ((x & 0x0000FFFF0000FFFFULL) << 16);
+  x = (x >> 32) | (x << 32);
+  x ^= 0xAAAAAAAAAAAAAAAAULL;
+  return x >> (64 - 2 * k);
+}
+
+
+
+/**
+ * Free a sequence together with its name, bases and mask, and set *pSeq to NULL.
+ */
+void seq_free(Seq **pSeq)
+{
+  Seq *seq = *pSeq;
+
+  if (seq == NULL)
+    return;
+  hlr_free(seq->name);
+  hlr_free(seq->sequence);
+  bitFree(&seq->mask);
+  freez(pSeq);
 }
 
 
@@ -549,10 +805,10 @@ void seq_toRna(DNA *dna)
 
 
 /* Run chars through filter. */
-static void dnaOrAaFilter(char *in, char *out, char filter[256])
+static void dnaOrAaFilter(char *in, char *out, const char filter[256])
 {
   char c;
-  seq_init();
+
   while ((c = *in++) != 0)
     {
       if ((c = filter[(int)c]) != 0) *out++ = c;
@@ -653,12 +909,6 @@ int seq_dnaOrAaScoreMatch(char *a, char *b, int size, int matchScore, int mismat
 
 
 
-/* Tables to convert from 0-20 to ASCII single letter representation of proteins. */
-int aaVal[256];
-AA valToAa[20];
-AA aaChars[256]; /* 0 except for value aa characters. Converts to upper case rest. */
-
-
 
 struct aminoAcidTable
 {
@@ -693,41 +943,59 @@ struct aminoAcidTable aminoAcidTable[] =
 };
 
 
-static void initAaVal()
-/* Initialize aaVal and valToAa tables. */
-{
-  int i;
-  char c, lowc;
-  
-  for (i=0; i<NUMELE(aaVal); ++i)
-    aaVal[i] = -1;
-  for (i=0; i<NUMELE(aminoAcidTable); ++i)
-    {
-      c = aminoAcidTable[i].letter;
-      lowc = tolower(c);
-      aaVal[(int)c] = aaVal[(int)lowc] = i;
-      aaChars[(int)c] = aaChars[(int)lowc] = c;
-      valToAa[i] = c;
-    }
-  aaChars['x'] = aaChars['X'] = 'X';
-}
+/* Tables to convert from 0-20 to ASCII single letter representation of proteins; they follow aminoAcidTable. */
+const int aaVal[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,0,-1,1,2,3,4,5,6,7,-1,8,9,10,11,-1,
+  12,13,14,15,16,-1,17,18,-1,19,-1,-1,-1,-1,-1,-1,
+  -1,0,-1,1,2,3,4,5,6,7,-1,8,9,10,11,-1,
+  12,13,14,15,16,-1,17,18,-1,19,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+
+const AA valToAa[20] = {
+  'A','C','D','E','F','G','H','I','K','L','M','N','P','Q','R','S',
+  'T','V','W','Y'
+};
+
+/* 0 except for value aa characters. Converts to upper case rest. */
+const AA aaChars[256] = {
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,'A',0,'C','D','E','F','G','H','I',0,'K','L','M','N',0,
+  'P','Q','R','S','T',0,'V','W','X','Y',0,0,0,0,0,0,
+  0,'A',0,'C','D','E','F','G','H','I',0,'K','L','M','N',0,
+  'P','Q','R','S','T',0,'V','W','X','Y',0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
 
 
 
 /**
  * Initialize the seq module. 
+ * The tables of the module are constant and initialized at compile time, so
+ * this does nothing; kept for compatibility.
  */
 void seq_init()
 {
-  static int opened = 0;
-  if (!opened)
-    {
-      initNtVal();
-      initAaVal();
-      initNtChars();
-      initNtMixedCaseChars();
-      initNtCompTable();
-      opened = 1;
-    }
 }
 
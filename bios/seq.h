@@ -57,43 +57,49 @@ typedef char Codon;
  * nucleotide, and if so convert it to lower case. 
  * Contains zeroes for characters that aren't used
  * in DNA sequence. */
-extern DNA ntChars[256];
-extern AA aaChars[256];
+extern const DNA ntChars[256];
+extern const AA aaChars[256];
 
 /* An array that converts alphabetical DNA representation
  * to numerical one: X_BASE_VAL as above.  For charaters
  * other than [atgcATGC], has -1. */
-extern int ntVal[256];
-extern int aaVal[256];
-extern int ntValLower[256];	/* NT values only for lower case. */
-extern int ntValUpper[256];	/* NT values only for upper case. */
+extern const int ntVal[256];
+extern const int aaVal[256];
+extern const int ntValLower[256];	/* NT values only for lower case. */
+extern const int ntValUpper[256];	/* NT values only for upper case. */
 
 /* Like ntVal, but with T_BASE_VAL in place of -1 for nonexistent nucleotides. */
-extern int ntValNoN[256];     
+extern const int ntValNoN[256];     
 
 /* Like ntVal but with N_BASE_VAL in place of -1 for 'n', 'x', '-', etc. */
-extern int ntVal5[256];
+extern const int ntVal5[256];
 
 /* Inverse array - takes X_BASE_VAL int to a DNA char value. */
-extern DNA valToNt[];
+extern const DNA valToNt[];
+
+/* Four upper case bases for each byte of 2-bit packed DNA, first base in the highest bits. */
+extern const DNA packedByteToNt[256][4];
 
 /* Similar array that doesn't convert to lower case. */
-extern DNA ntMixedCaseChars[256];
+extern const DNA ntMixedCaseChars[256];
 
 /* Another array to help us do complement of DNA  */
-extern DNA ntCompTable[256];
+extern const DNA ntCompTable[256];
 
 /* Arrays to convert between lower case indicating repeat masking, and
  * a 1/2 byte representation where the 4th bit indicates if the characeter
  * is masked. Uses N_BASE_VAL for `n', `x', etc.
  */
-extern int ntValMasked[256];
-extern DNA valToNtMasked[256];
+extern const int ntValMasked[256];
+extern const DNA valToNtMasked[256];
  
 
 void seq_init (); 
 void seq_complement (DNA *dna, long length);
 void seq_reverseComplement (DNA *dna, long length);
+void seq_reverseComplementCopy (DNA *dna, long length, DNA *out);
+unsigned long long seq_reverseComplementPacked (unsigned long long packed, int k);
+void seq_free (Seq **pSeq);
 aaSeq* seq_translateSeqN (dnaSeq *inSeq, unsigned offset, unsigned size, int stop);
 aaSeq* seq_translateSeq (dnaSeq *inSeq, unsigned offset, int stop);
 int seq_seqIsLower (Seq *seq);
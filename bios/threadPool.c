@@ -0,0 +1,182 @@
+/**
+ *   \file threadPool.c Fixed-size pool of worker threads
+ */
+
+
+/*
+   Module threadPool
+   A fixed number of worker threads take jobs from a FIFO queue.
+   Jobs are owned by the caller, so that the caller can wait for
+   individual jobs in the order it submitted them (ordered output)
+   or for all of them (barrier).
+*/
+
+
+#include <unistd.h>
+
+#include "log.h"
+#include "hlrmisc.h"
+#include "threadPool.h"
+
+
+
+static void *threadPool_worker (void *arg)
+{
+  ThreadPool this1 = (ThreadPool)arg;
+  ThreadPoolJob *job;
+
+  pthread_mutex_lock (&this1->lock);
+  for (;;) {
+    while (this1->first == NULL && !this1->shutdown)
+      pthread_cond_wait (&this1->workAvailable,&this1->lock);
+    if (this1->first == NULL)
+      break; /* shutdown and queue drained */
+    job = this1->first;
+    this1->first = job->next;
+    if (this1->first == NULL)
+      this1->last = NULL;
+    pthread_mutex_unlock (&this1->lock);
+    job->func (job->arg);
+    pthread_mutex_lock (&this1->lock);
+    job->done = 1;
+    this1->nPending--;
+    pthread_cond_broadcast (&this1->workDone);
+  }
+  pthread_mutex_unlock (&this1->lock);
+  return NULL;
+}
+
+
+
+/**
+ * Create a pool of worker threads.
+ * @param[in] nThreads Number of worker threads, must be > 0
+ * @return A thread pool
+ * @see threadPool_cpuCount()
+ */
+ThreadPool threadPool_create (int nThreads)
+{
+  ThreadPool this1;
+  int i;
+
+  if (nThreads < 1)
+    die ("threadPool_create: invalid number of threads: %d",nThreads);
+  this1 = (ThreadPool) hlr_malloc (sizeof (struct _threadPoolStruct_));
+  this1->nThreads = nThreads;
+  this1->first = NULL;
+  this1->last = NULL;
+  this1->nPending = 0;
+  this1->shutdown = 0;
+  pthread_mutex_init (&this1->lock,NULL);
+  pthread_cond_init (&this1->workAvailable,NULL);
+  pthread_cond_init (&this1->workDone,NULL);
+  this1->threads = (pthread_t *) hlr_malloc (nThreads * sizeof (pthread_t));
+  for (i = 0; i < nThreads; i++) {
+    if (pthread_create (&this1->threads[i],NULL,threadPool_worker,this1) != 0)
+      die ("threadPool_create: cannot start thread %d",i);
+  }
+  return this1;
+}
+
+
+
+/**
+ * Queue a job for execution by one of the worker threads.
+ * @param[in] this1 A thread pool
+ * @param[in] job Caller-owned job; must stay valid until threadPool_waitJob() or threadPool_waitAll() returned
+ * @param[in] func Function to execute
+ * @param[in] arg Argument passed to func
+ */
+void threadPool_submit (ThreadPool this1, ThreadPoolJob *job, void (*func)(void *arg), void *arg)
+{
+  job->func = func;
+  job->arg = arg;
+  job->done = 0;
+  job->next = NULL;
+  pthread_mutex_lock (&this1->lock);
+  if (this1->last)
+    this1->last->next = job;
+  else
+    this1->first = job;
+  this1->last = job;
+  this1->nPending++;
+  pthread_cond_signal (&this1->workAvailable);
+  pthread_mutex_unlock (&this1->lock);
+}
+
+
+
+/**
+ * Wait until a job has been executed.
+ * @param[in] this1 A thread pool
+ * @param[in] job A job previously submitted via threadPool_submit()
+ */
+void threadPool_waitJob (ThreadPool this1, ThreadPoolJob *job)
+{
+  pthread_mutex_lock (&this1->lock);
+  while (!job->done)
+    pthread_cond_wait (&this1->workDone,&this1->lock);
+  pthread_mutex_unlock (&this1->lock);
+}
+
+
+
+/**
+ * Wait until all submitted jobs have been executed.
+ * @param[in] this1 A thread pool
+ */
+void threadPool_waitAll (ThreadPool this1)
+{
+  pthread_mutex_lock (&this1->lock);
+  while (this1->nPending > 0)
+    pthread_cond_wait (&this1->workDone,&this1->lock);
+  pthread_mutex_unlock (&this1->lock);
+}
+
+
+
+/**
+ * Get the number of worker threads of a pool.
+ */
+int threadPool_threadCountGet (ThreadPool this1)
+{
+  return this1->nThreads;
+}
+
+
+
+/**
+ * Get the number of processors currently online.
+ * @return Number of processors, at least 1
+ */
+int threadPool_cpuCount (void)
+{
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+
+
+/**
+ * Destroy a thread pool. Jobs that are still queued are executed before the threads terminate.
+ * @param[in] this1 A thread pool
+ * @note Do not call this function, but use the macro threadPool_destroy
+ */
+void threadPool_destroy_func (ThreadPool this1)
+{
+  int i;
+
+  if (!this1)
+    return;
+  pthread_mutex_lock (&this1->lock);
+  this1->shutdown = 1;
+  pthread_cond_broadcast (&this1->workAvailable);
+  pthread_mutex_unlock (&this1->lock);
+  for (i = 0; i < this1->nThreads; i++)
+    pthread_join (this1->threads[i],NULL);
+  pthread_mutex_destroy (&this1->lock);
+  pthread_cond_destroy (&this1->workAvailable);
+  pthread_cond_destroy (&this1->workDone);
+  hlr_free (this1->threads);
+  hlr_free (this1);
+}
@@ -0,0 +1,63 @@
+/**
+ *   \file threadPool.h
+ */
+
+
+#ifndef DEF_THREAD_POOL_H
+#define DEF_THREAD_POOL_H
+
+
+#include <pthread.h>
+
+
+/**
+ * ThreadPoolJob.
+ * A unit of work handed to a ThreadPool. The memory of a job belongs to the caller
+ * (typically it is embedded in the caller's own data structure), so submitting a job
+ * does not allocate. The members are PRIVATE to the threadPool module.
+ */
+typedef struct _threadPoolJobStruct_ {
+  void (*func)(void *arg);
+  void *arg;
+  int done;
+  struct _threadPoolJobStruct_ *next;
+} ThreadPoolJob;
+
+
+
+/**
+ * ThreadPool.
+ */
+typedef struct _threadPoolStruct_ {
+  /* the members of this struct are PRIVATE for the
+     threadPool module -- DO NOT access from outside
+     the threadPool module */
+  pthread_t *threads;
+  int nThreads;
+  pthread_mutex_t lock;
+  pthread_cond_t workAvailable;
+  pthread_cond_t workDone;
+  ThreadPoolJob *first;
+  ThreadPoolJob *last;
+  int nPending;       /* queued or running */
+  int shutdown;
+} *ThreadPool;
+
+
+
+extern ThreadPool threadPool_create (int nThreads);
+extern void threadPool_submit (ThreadPool this1, ThreadPoolJob *job, void (*func)(void *arg), void *arg);
+extern void threadPool_waitJob (ThreadPool this1, ThreadPoolJob *job);
+extern void threadPool_waitAll (ThreadPool this1);
+extern int threadPool_threadCountGet (ThreadPool this1);
+extern int threadPool_cpuCount (void);
+extern void threadPool_destroy_func (ThreadPool this1); /* do not use this function */
+
+/**
+ * Destroy a thread pool.
+ * @see threadPool_destroy_func()
+ */
+#define threadPool_destroy(this1) (threadPool_destroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
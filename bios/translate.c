@@ -0,0 +1,154 @@
+/**
+ *   \file translate.c Module for translating DNA in all six reading frames
+ */
+
+
+/*
+   Module translate
+   Every base is turned into a 3-bit code (T, C, A, G or other) with one
+   table lookup, and the codes of the last three bases form a 9-bit codon
+   index. Two 512-entry tables give the amino acid of that codon and of its
+   reverse complement, so one pass over the DNA fills all six frames.
+   Stop codons are translated to '*', codons with other bases than
+   A, C, G, T (or U) to 'X'. The frames are kept in buffers owned by the
+   Translator, which are reused by the next translation.
+*/
+
+
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "translate.h"
+
+
+
+#define TRANSLATE_OTHER 4
+
+
+
+/**
+ * Create a translator.
+ * @param[in] geneticCode TRANSLATE_STANDARD or TRANSLATE_VERTEBRATE_MITOCHONDRIAL
+ * @return A translator
+ */
+Translator translate_create (int geneticCode)
+{
+  Translator this1;
+  DNA *codon;
+  AA aa;
+  int v[3];
+  int c,i;
+
+  if (geneticCode != TRANSLATE_STANDARD && geneticCode != TRANSLATE_VERTEBRATE_MITOCHONDRIAL)
+    die ("translate_create: genetic code %d is not supported",geneticCode);
+  this1 = (Translator) hlr_calloc (1,sizeof (struct _translatorStruct_));
+  for (c = 0; c < 256; c++)
+    this1->baseCode[c] = ntVal[c] < 0 ? TRANSLATE_OTHER : ntVal[c];
+  for (i = 0; i < 512; i++) {
+    v[0] = i >> 6;
+    v[1] = (i >> 3) & 7;
+    v[2] = i & 7;
+    if (v[0] >= TRANSLATE_OTHER || v[1] >= TRANSLATE_OTHER || v[2] >= TRANSLATE_OTHER) {
+      this1->forward[i] = this1->reverse[i] = 'X';
+      continue;
+    }
+    codon = seq_valToCodon ((v[0] << 4) | (v[1] << 2) | v[2]);
+    aa = geneticCode == TRANSLATE_STANDARD ? seq_lookupCodon (codon) : seq_lookupMitochondrialCodon (codon);
+    this1->forward[i] = aa ? aa : '*';
+    /* the complement of a base code is the code xor 2 */
+    codon = seq_valToCodon (((v[2] ^ 2) << 4) | ((v[1] ^ 2) << 2) | (v[0] ^ 2));
+    aa = geneticCode == TRANSLATE_STANDARD ? seq_lookupCodon (codon) : seq_lookupMitochondrialCodon (codon);
+    this1->reverse[i] = aa ? aa : '*';
+  }
+  return this1;
+}
+
+
+
+/**
+ * Translate DNA in all six frames; the results are read with translate_frameGet().
+ * Frames 0, 1 and 2 start at base 0, 1 and 2; frames 3, 4 and 5 are those of the reverse 
+   complement, starting at its base 0, 1 and 2, i.e. at the last, second last and third last base of dna.
+ * @param[in] this1 A translator
+ * @param[in] dna Bases, case does not matter
+ * @param[in] length Number of bases
+ */
+void translate_sixFrames (Translator this1, DNA *dna, long length)
+{
+  unsigned int code = 0;
+  long codons = length / 3 + 1;
+  long fk = 0;        /* codon number in the forward frame */
+  long rk;            /* codon number in the reverse frame */
+  int ff = 0;         /* forward frame of the codon ending at base i */
+  int rf;
+  long i;
+  int f;
+
+  if (codons > this1->capacity) {
+    this1->capacity = MAX (codons,2 * this1->capacity);
+    for (f = 0; f < 6; f++) {
+      hlr_free (this1->frames[f]);
+      this1->frames[f] = (AA *) hlr_malloc (this1->capacity + 1);
+    }
+  }
+  for (f = 0; f < 3; f++) {
+    this1->frameLens[f] = this1->frameLens[3 + f] = length > f + 2 ? (length - f) / 3 : 0;
+    this1->frames[f][this1->frameLens[f]] = '\0';
+    this1->frames[3 + f][this1->frameLens[f]] = '\0';
+  }
+  if (length < 3)
+    return;
+  /* the codon starting at s = i - 2 is codon r / 3 of reverse frame r % 3, with r = length - 3 - s */
+  rf = (length - 3) % 3;
+  rk = (length - 3) / 3;
+  code = (this1->baseCode[(unsigned char)dna[0]] << 3) | this1->baseCode[(unsigned char)dna[1]];
+  for (i = 2; i < length; i++) {
+    code = ((code << 3) | this1->baseCode[(unsigned char)dna[i]]) & 0x1FF;
+    this1->frames[ff][fk] = this1->forward[code];
+    this1->frames[3 + rf][rk] = this1->reverse[code];
+    if (++ff == 3) {
+      ff = 0;
+      fk++;
+    }
+    if (--rf < 0) {
+      rf = 2;
+      rk--;
+    }
+  }
+}
+
+
+
+/**
+ * One frame of the last translation.
+ * @param[in] this1 A translator
+ * @param[in] frame 0 to 5, see translate_sixFrames()
+ * @param[out] length If not NULL, receives the number of amino acids
+ * @return The null-terminated amino acids; the memory belongs to the translator and 
+   is overwritten by the next call of translate_sixFrames()
+ */
+AA *translate_frameGet (Translator this1, int frame, long *length)
+{
+  if (frame < 0 || frame > 5)
+    die ("translate_frameGet: there is no frame %d",frame);
+  if (length)
+    *length = this1->frameLens[frame];
+  return this1->frames[frame] ? this1->frames[frame] : "";
+}
+
+
+
+/**
+ * Destroy a translator.
+ * @note Do not call this function, but use the macro translate_destroy
+ */
+void translate_destroy_func (Translator this1)
+{
+  int f;
+
+  if (!this1)
+    return;
+  for (f = 0; f < 6; f++)
+    hlr_free (this1->frames[f]);
+  hlr_free (this1);
+}
@@ -0,0 +1,51 @@
+/**
+ *   \file translate.h
+ */
+
+
+#ifndef DEF_TRANSLATE_H
+#define DEF_TRANSLATE_H
+
+
+#include "seq.h"
+
+
+/**
+ * Genetic codes, numbered as the NCBI translation tables.
+ */
+#define TRANSLATE_STANDARD 1
+#define TRANSLATE_VERTEBRATE_MITOCHONDRIAL 2
+
+
+
+/**
+ * Translator.
+ * Lookup tables for one genetic code and the six reading frames of the last translation.
+ */
+typedef struct _translatorStruct_ {
+  /* the members of this struct are PRIVATE for the
+     translate module -- DO NOT access from outside
+     the translate module */
+  unsigned char baseCode[256];  /* 0..3 like ntVal, 4 for all other characters */
+  AA forward[512];              /* by 3 base codes of 3 bits each */
+  AA reverse[512];              /* amino acid of the reverse complement of the codon */
+  AA *frames[6];
+  long frameLens[6];
+  long capacity;                /* room in each frame, without the terminating '\0' */
+} *Translator;
+
+
+
+extern Translator translate_create (int geneticCode);
+extern void translate_sixFrames (Translator this1, DNA *dna, long length);
+extern AA *translate_frameGet (Translator this1, int frame, long *length);
+extern void translate_destroy_func (Translator this1); /* do not use this function */
+
+/**
+ * Destroy a translator.
+ * @see translate_destroy_func()
+ */
+#define translate_destroy(this1) (translate_destroy_func(this1),this1=NULL) /* use this one */
+
+
+#endif
@@ -0,0 +1,587 @@
+/**
+ *   \file twoBit.c Read and write UCSC .2bit sequence files
+ */
+
+
+/*
+   Module twoBit
+   A .2bit file starts with a header (signature, version, number of
+   sequences, reserved word) followed by an index of sequence names
+   and record offsets. Each record holds the sequence size, the runs
+   of N, the runs of lower case (soft-masked) bases and the bases
+   packed four per byte, first base in the high bits, using the
+   X_BASE_VAL codes of the seq module (T=0, C=1, A=2, G=3).
+   All integers are 32 bit in the byte order of the writing machine;
+   version 1 files use 64-bit record offsets in the index.
+*/
+
+
+#include <unistd.h>
+#include <errno.h>
+
+#include "log.h"
+#include "format.h"
+#include "hlrmisc.h"
+#include "fasta.h"
+#include "twoBit.h"
+
+
+
+/**
+ * TwoBitRecord.
+ * Header of one sequence record; PRIVATE to the twoBit module.
+ */
+typedef struct {
+  char *name;
+  unsigned int size;
+  unsigned int nBlockCount;
+  unsigned int *nBlocks;      /* nBlockCount starts followed by nBlockCount sizes */
+  unsigned int maskBlockCount;
+  unsigned int *maskBlocks;   /* maskBlockCount starts followed by maskBlockCount sizes */
+  unsigned char *packed;      /* writer only */
+  long long dnaOffset;        /* file offset of the packed bases (reader only) */
+} TwoBitRecord;
+
+
+static unsigned int twoBit_swap32 (unsigned int x)
+{
+  return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+
+
+static void twoBit_pread (TwoBit this1, void *buf, size_t n, long long offset)
+{
+  size_t done = 0;
+  ssize_t k;
+
+  while (done < n) {
+    k = pread (fileno (this1->fp),(char *)buf + done,n - done,offset + done);
+    if (k < 0 && errno == EINTR)
+      continue;
+    if (k <= 0)
+      die ("twoBit: cannot read at offset %lld: %s",offset + done,
+           k < 0 ? strerror (errno) : "unexpected end of file");
+    done += k;
+  }
+}
+
+
+
+static void twoBit_readInts (TwoBit this1, unsigned int *ints, int n, long long offset)
+{
+  int i;
+
+  twoBit_pread (this1,ints,n * sizeof (unsigned int),offset);
+  if (this1->isSwapped)
+    for (i = 0; i < n; i++)
+      ints[i] = twoBit_swap32 (ints[i]);
+}
+
+
+
+static unsigned int twoBit_fread32 (TwoBit this1, char *fileName)
+{
+  unsigned int x;
+
+  if (fread (&x,sizeof (x),1,this1->fp) != 1)
+    die ("twoBit_open: '%s' is truncated",fileName);
+  return this1->isSwapped ? twoBit_swap32 (x) : x;
+}
+
+
+
+static int twoBit_entryCmp (TwoBitEntry **a, TwoBitEntry **b)
+{
+  return strcmp ((*a)->name,(*b)->name);
+}
+
+
+
+/**
+ * Open a .2bit file and read its index.
+ * @param[in] fileName Name of a .2bit file
+ * @return A .2bit file handle, or NULL if the file could not be opened (see warnReport())
+ * @note Sequences are read with pread(), so twoBit_readSeq() and twoBit_fetchRegion()
+   may be called from several threads on the same handle.
+ */
+TwoBit twoBit_open (char *fileName)
+{
+  TwoBit this1;
+  TwoBitEntry *entry;
+  unsigned int signature;
+  unsigned int seqCount;
+  unsigned int lo;
+  unsigned int hi;
+  unsigned char nameLen;
+  int i;
+
+  this1 = (TwoBit) hlr_malloc (sizeof (struct _twoBitStruct_));
+  if (!(this1->fp = fopen (fileName,"rb"))) {
+    warnAdd ("twoBit_open",
+             stringPrintBuf ("'%s': %s",fileName,strerror (errno)));
+    hlr_free (this1);
+    return NULL;
+  }
+  if (fread (&signature,sizeof (signature),1,this1->fp) != 1)
+    die ("twoBit_open: '%s' is not a .2bit file",fileName);
+  if (signature == TWO_BIT_SIGNATURE)
+    this1->isSwapped = 0;
+  else if (twoBit_swap32 (signature) == TWO_BIT_SIGNATURE)
+    this1->isSwapped = 1;
+  else
+    die ("twoBit_open: '%s' is not a .2bit file",fileName);
+  this1->version = twoBit_fread32 (this1,fileName);
+  if (this1->version > 1)
+    die ("twoBit_open: '%s': unsupported version %d",fileName,this1->version);
+  seqCount = twoBit_fread32 (this1,fileName);
+  twoBit_fread32 (this1,fileName); /* reserved */
+  this1->entries = arrayCreate (seqCount,TwoBitEntry);
+  this1->sorted = arrayCreate (seqCount,TwoBitEntry *);
+  for (i = 0; i < (int)seqCount; i++) {
+    entry = arrayp (this1->entries,i,TwoBitEntry);
+    if (fread (&nameLen,1,1,this1->fp) != 1)
+      die ("twoBit_open: '%s' is truncated",fileName);
+    entry->name = hlr_malloc (nameLen + 1);
+    if (fread (entry->name,1,nameLen,this1->fp) != nameLen)
+      die ("twoBit_open: '%s' is truncated",fileName);
+    entry->name[nameLen] = '\0';
+    lo = twoBit_fread32 (this1,fileName);
+    if (this1->version == 0)
+      entry->offset = lo;
+    else {
+      hi = twoBit_fread32 (this1,fileName);
+      if (this1->isSwapped) /* the 64-bit value was swapped as a whole */
+        entry->offset = ((long long)lo << 32) | hi;
+      else
+        entry->offset = ((long long)hi << 32) | lo;
+    }
+  }
+  for (i = 0; i < (int)seqCount; i++)
+    array (this1->sorted,i,TwoBitEntry *) = arrp (this1->entries,i,TwoBitEntry);
+  arraySort (this1->sorted,(ARRAYORDERF)twoBit_entryCmp);
+  return this1;
+}
+
+
+
+/**
+ * Get the number of sequences in a .2bit file.
+ */
+int twoBit_seqCountGet (TwoBit this1)
+{
+  return arrayMax (this1->entries);
+}
+
+
+
+/**
+ * Get the name of the i-th sequence, in file order.
+ * @param[in] this1 A .2bit file handle
+ * @param[in] i 0 <= i < twoBit_seqCountGet()
+ * @return The name; belongs to the handle
+ */
+char *twoBit_seqNameGet (TwoBit this1, int i)
+{
+  return arrp (this1->entries,i,TwoBitEntry)->name;
+}
+
+
+
+static TwoBitEntry *twoBit_find (TwoBit this1, char *name)
+{
+  TwoBitEntry key;
+  TwoBitEntry *keyp = &key;
+  int i;
+
+  key.name = name;
+  if (!arrayFind (this1->sorted,&keyp,&i,(ARRAYORDERF)twoBit_entryCmp))
+    return NULL;
+  return arru (this1->sorted,i,TwoBitEntry *);
+}
+
+
+
+/**
+ * Get the number of bases of a sequence.
+ * @return The size, or -1 if there is no sequence 'name'
+ */
+int twoBit_seqSizeGet (TwoBit this1, char *name)
+{
+  TwoBitEntry *entry;
+  unsigned int size;
+
+  if (!(entry = twoBit_find (this1,name)))
+    return -1;
+  twoBit_readInts (this1,&size,1,entry->offset);
+  return size;
+}
+
+
+
+static void twoBit_recordRead (TwoBit this1, TwoBitEntry *entry, TwoBitRecord *rec)
+{
+  unsigned int ints[2];
+  long long offset = entry->offset;
+
+  rec->name = entry->name;
+  twoBit_readInts (this1,ints,2,offset);
+  rec->size = ints[0];
+  rec->nBlockCount = ints[1];
+  offset += 2 * sizeof (unsigned int);
+  rec->nBlocks = hlr_malloc (2 * rec->nBlockCount * sizeof (unsigned int) + 1);
+  twoBit_readInts (this1,rec->nBlocks,2 * rec->nBlockCount,offset);
+  offset += 2 * rec->nBlockCount * sizeof (unsigned int);
+  twoBit_readInts (this1,&rec->maskBlockCount,1,offset);
+  offset += sizeof (unsigned int);
+  rec->maskBlocks = hlr_malloc (2 * rec->maskBlockCount * sizeof (unsigned int) + 1);
+  twoBit_readInts (this1,rec->maskBlocks,2 * rec->maskBlockCount,offset);
+  offset += 2 * rec->maskBlockCount * sizeof (unsigned int);
+  rec->dnaOffset = offset + sizeof (unsigned int); /* skip reserved word */
+  rec->packed = NULL;
+}
+
+
+
+static void twoBit_recordFree (TwoBitRecord *rec)
+{
+  hlr_free (rec->nBlocks);
+  hlr_free (rec->maskBlocks);
+  hlr_free (rec->packed);
+}
+
+
+
+/**
+ * Intersect block i of 'blocks' with [start,end).
+ * @return 1 and the overlap in *from, *to if they overlap
+ */
+static int twoBit_blockClip (unsigned int *blocks, unsigned int count, int i,
+                             int start, int end, int *from, int *to)
+{
+  long long s = blocks[i];
+  long long e = s + blocks[count + i];
+
+  *from = MAX (s,start);
+  *to = MIN (e,end);
+  return *from < *to;
+}
+
+
+
+/**
+ * Decode bases [start,end) of a record into 'out' (not null-terminated).
+ * Masked bases are lower case; if 'mask' is given, bit i is set for masked base start+i.
+ */
+static void twoBit_decode (TwoBit this1, TwoBitRecord *rec, int start, int end, char *out, Bits *mask)
+{
+  unsigned char *packed;
+  unsigned char *p;
+  char *o = out;
+  int pos = start;
+  int from;
+  int to;
+  int i;
+  int j;
+
+  if (start >= end)
+    return;
+  packed = hlr_malloc ((end - 1) / 4 - start / 4 + 1);
+  twoBit_pread (this1,packed,(end - 1) / 4 - start / 4 + 1,rec->dnaOffset + start / 4);
+  p = packed;
+  for (; pos < end && (pos & 3); pos++)
+    *o++ = packedByteToNt[*p][pos & 3];
+  if (pos != start)
+    p++;
+  for (; pos + 4 <= end; pos += 4) {
+    memcpy (o,packedByteToNt[*p++],4);
+    o += 4;
+  }
+  for (i = 0; pos < end; pos++)
+    *o++ = packedByteToNt[*p][i++];
+  hlr_free (packed);
+  for (i = 0; i < (int)rec->nBlockCount; i++)
+    if (twoBit_blockClip (rec->nBlocks,rec->nBlockCount,i,start,end,&from,&to))
+      memset (out + from - start,'N',to - from);
+  for (i = 0; i < (int)rec->maskBlockCount; i++)
+    if (twoBit_blockClip (rec->maskBlocks,rec->maskBlockCount,i,start,end,&from,&to)) {
+      for (j = from; j < to; j++)
+        out[j - start] = tolower (out[j - start]);
+      if (mask)
+        bitSetRange (mask,from - start,to - from);
+    }
+}
+
+
+
+/**
+ * Read a complete sequence.
+ * @param[in] this1 A .2bit file handle
+ * @param[in] name Sequence name
+ * @return The sequence, or NULL if there is no sequence 'name'. Soft-masked bases are
+   lower case and their bits are set in seq->mask. The caller owns the memory (free with seq_free()).
+ */
+Seq *twoBit_readSeq (TwoBit this1, char *name)
+{
+  TwoBitEntry *entry;
+  TwoBitRecord rec;
+  Seq *seq;
+
+  if (!(entry = twoBit_find (this1,name)))
+    return NULL;
+  twoBit_recordRead (this1,entry,&rec);
+  AllocVar (seq);
+  seq->name = hlr_strdup (entry->name);
+  seq->size = rec.size;
+  seq->sequence = hlr_malloc (rec.size + 1);
+  seq->mask = bitAlloc (rec.size);
+  twoBit_decode (this1,&rec,0,rec.size,seq->sequence,seq->mask);
+  seq->sequence[rec.size] = '\0';
+  twoBit_recordFree (&rec);
+  return seq;
+}
+
+
+
+/**
+ * Fetch a region of a sequence.
+ * Only the packed bytes covering the region are read from disk.
+ * @param[in] this1 A .2bit file handle
+ * @param[in] name Sequence name
+ * @param[in] start First base of the region, 0-based
+ * @param[in] end One past the last base of the region; the region is clipped to the sequence
+ * @param[in] reverseComplement If 1, return the reverse complement of the region
+ * @return Null-terminated bases, soft-masked bases in lower case, or NULL if there is
+   no sequence 'name'. The caller owns the memory (free with hlr_free()).
+ */
+char *twoBit_fetchRegion (TwoBit this1, char *name, int start, int end, int reverseComplement)
+{
+  TwoBitEntry *entry;
+  TwoBitRecord rec;
+  char *buf;
+
+  if (!(entry = twoBit_find (this1,name)))
+    return NULL;
+  twoBit_recordRead (this1,entry,&rec);
+  if (start < 0)
+    start = 0;
+  if (end > (int)rec.size)
+    end = rec.size;
+  if (start > end)
+    start = end;
+  buf = hlr_malloc (end - start + 1);
+  twoBit_decode (this1,&rec,start,end,buf,NULL);
+  buf[end - start] = '\0';
+  if (reverseComplement)
+    seq_reverseComplement (buf,end - start);
+  twoBit_recordFree (&rec);
+  return buf;
+}
+
+
+
+/**
+ * Close a .2bit file.
+ * @param[in] this1 A .2bit file handle
+ * @note Do not call this function, but use the macro twoBit_close
+ */
+void twoBit_close_func (TwoBit this1)
+{
+  int i;
+
+  if (!this1)
+    return;
+  for (i = 0; i < arrayMax (this1->entries); i++)
+    hlr_free (arrp (this1->entries,i,TwoBitEntry)->name);
+  arrayDestroy (this1->entries);
+  arrayDestroy (this1->sorted);
+  fclose (this1->fp);
+  hlr_free (this1);
+}
+
+
+
+static void twoBit_blocksFinish (Array blocks, unsigned int *count, unsigned int **ints)
+{
+  int i;
+
+  *count = arrayMax (blocks) / 2;
+  *ints = hlr_malloc (arrayMax (blocks) * sizeof (unsigned int) + 1);
+  for (i = 0; i < (int)*count; i++) {
+    (*ints)[i] = arru (blocks,2 * i,unsigned int);
+    (*ints)[*count + i] = arru (blocks,2 * i + 1,unsigned int);
+  }
+}
+
+
+
+/**
+ * Pack one sequence into a record: N runs, lower case runs and 2-bit bases.
+ */
+static void twoBit_pack (TwoBitRecord *rec, char *name, char *dna, int size)
+{
+  Array nBlocks = arrayCreate (16,unsigned int);
+  Array maskBlocks = arrayCreate (16,unsigned int);
+  int nStart = -1;
+  int maskStart = -1;
+  unsigned char c;
+  int val;
+  int i;
+
+  if (strlen (name) > 255)
+    die ("twoBit_write: sequence name too long: %s",name);
+  rec->name = name;
+  rec->size = size;
+  rec->packed = hlr_malloc ((size + 3) / 4 + 1);
+  memset (rec->packed,0,(size + 3) / 4 + 1);
+  for (i = 0; i <= size; i++) {
+    c = i < size ? dna[i] : 'A';
+    val = ntVal[c];
+    if (val < 0 && nStart < 0)
+      nStart = i;
+    else if (val >= 0 && nStart >= 0) {
+      array (nBlocks,arrayMax (nBlocks),unsigned int) = nStart;
+      array (nBlocks,arrayMax (nBlocks),unsigned int) = i - nStart;
+      nStart = -1;
+    }
+    if (islower (c) && maskStart < 0)
+      maskStart = i;
+    else if (!islower (c) && maskStart >= 0) {
+      array (maskBlocks,arrayMax (maskBlocks),unsigned int) = maskStart;
+      array (maskBlocks,arrayMax (maskBlocks),unsigned int) = i - maskStart;
+      maskStart = -1;
+    }
+    if (i < size && val > 0)
+      rec->packed[i / 4] |= val << (6 - 2 * (i & 3));
+  }
+  twoBit_blocksFinish (nBlocks,&rec->nBlockCount,&rec->nBlocks);
+  twoBit_blocksFinish (maskBlocks,&rec->maskBlockCount,&rec->maskBlocks);
+  arrayDestroy (nBlocks);
+  arrayDestroy (maskBlocks);
+}
+
+
+
+static long long twoBit_recordSize (TwoBitRecord *rec)
+{
+  return (4 + 2 * rec->nBlockCount + 2 * rec->maskBlockCount) * sizeof (unsigned int) +
+    (rec->size + 3) / 4;
+}
+
+
+
+static void twoBit_fwrite32 (FILE *fp, unsigned int x)
+{
+  fwrite (&x,sizeof (x),1,fp);
+}
+
+
+
+static void twoBit_writeRecords (char *fileName, Array recs)
+{
+  TwoBitRecord *rec;
+  FILE *fp;
+  long long offset;
+  long long total;
+  int version;
+  int i;
+
+  /* the index uses 32-bit offsets unless the file gets larger than that */
+  offset = 4 * sizeof (unsigned int);
+  for (i = 0; i < arrayMax (recs); i++)
+    offset += 1 + strlen (arrp (recs,i,TwoBitRecord)->name) + sizeof (unsigned int);
+  total = offset;
+  for (i = 0; i < arrayMax (recs); i++)
+    total += twoBit_recordSize (arrp (recs,i,TwoBitRecord));
+  version = total > 0xffffffffLL ? 1 : 0;
+  if (version == 1)
+    offset += arrayMax (recs) * sizeof (unsigned int);
+  if (!(fp = fopen (fileName,"wb")))
+    die ("twoBit_write: '%s': %s",fileName,strerror (errno));
+  twoBit_fwrite32 (fp,TWO_BIT_SIGNATURE);
+  twoBit_fwrite32 (fp,version);
+  twoBit_fwrite32 (fp,arrayMax (recs));
+  twoBit_fwrite32 (fp,0);
+  for (i = 0; i < arrayMax (recs); i++) {
+    rec = arrp (recs,i,TwoBitRecord);
+    fputc (strlen (rec->name),fp);
+    fputs (rec->name,fp);
+    if (version == 0)
+      twoBit_fwrite32 (fp,offset);
+    else
+      fwrite (&offset,sizeof (offset),1,fp);
+    offset += twoBit_recordSize (rec);
+  }
+  for (i = 0; i < arrayMax (recs); i++) {
+    rec = arrp (recs,i,TwoBitRecord);
+    twoBit_fwrite32 (fp,rec->size);
+    twoBit_fwrite32 (fp,rec->nBlockCount);
+    fwrite (rec->nBlocks,sizeof (unsigned int),2 * rec->nBlockCount,fp);
+    twoBit_fwrite32 (fp,rec->maskBlockCount);
+    fwrite (rec->maskBlocks,sizeof (unsigned int),2 * rec->maskBlockCount,fp);
+    twoBit_fwrite32 (fp,0);
+    fwrite (rec->packed,1,(rec->size + 3) / 4,fp);
+  }
+  if (fclose (fp) != 0)
+    die ("twoBit_write: '%s': %s",fileName,strerror (errno));
+}
+
+
+
+/**
+ * Write sequences to a .2bit file.
+ * Runs of characters other than ACGTU are stored as N; lower case bases are stored as masked.
+ * @param[in] fileName Name of the .2bit file to create
+ * @param[in] seqs Array of Seq, e.g. from fasta_readAllSequences() with truncateName
+ */
+void twoBit_write (char *fileName, Array seqs)
+{
+  Array recs = arrayCreate (arrayMax (seqs),TwoBitRecord);
+  Seq *seq;
+  int i;
+
+  for (i = 0; i < arrayMax (seqs); i++) {
+    seq = arrp (seqs,i,Seq);
+    twoBit_pack (arrayp (recs,i,TwoBitRecord),seq->name,seq->sequence,seq->size);
+  }
+  twoBit_writeRecords (fileName,recs);
+  for (i = 0; i < arrayMax (recs); i++)
+    twoBit_recordFree (arrp (recs,i,TwoBitRecord));
+  arrayDestroy (recs);
+}
+
+
+
+/**
+ * Convert a FASTA file to a .2bit file.
+ * Sequences are packed as they are read, so only a quarter of the genome is held in memory.
+ * Sequence names are the first word of the header lines.
+ * @param[in] fastaFileName Name of the FASTA file
+ * @param[in] fileName Name of the .2bit file to create
+ * @return Number of sequences written
+ */
+int twoBit_writeFromFasta (char *fastaFileName, char *fileName)
+{
+  Array recs = arrayCreate (100,TwoBitRecord);
+  FastaReader reader;
+  TwoBitRecord *rec;
+  Seq *seq;
+  int i;
+
+  if (!(reader = fasta_readerOpen (fastaFileName)))
+    die ("twoBit_writeFromFasta: %s",warnReport ());
+  while ((seq = fasta_readerNext (reader,1)) != NULL) {
+    rec = arrayp (recs,arrayMax (recs),TwoBitRecord);
+    twoBit_pack (rec,hlr_strdup (seq->name),seq->sequence,seq->size);
+  }
+  fasta_readerClose (reader);
+  twoBit_writeRecords (fileName,recs);
+  for (i = 0; i < arrayMax (recs); i++) {
+    rec = arrp (recs,i,TwoBitRecord);
+    hlr_free (rec->name);
+    twoBit_recordFree (rec);
+  }
+  i = arrayMax (recs);
+  arrayDestroy (recs);
+  return i;
+}
@@ -0,0 +1,66 @@
+/**
+ *   \file twoBit.h
+ */
+
+
+#ifndef DEF_TWO_BIT_H
+#define DEF_TWO_BIT_H
+
+
+#include <stdio.h>
+#include "seq.h"
+
+
+/**
+ * Signature at the start of a .2bit file, in the byte order of the machine that wrote it.
+ */
+#define TWO_BIT_SIGNATURE 0x1A412743
+
+
+
+/**
+ * TwoBitEntry.
+ * One sequence in the index of a .2bit file.
+ */
+typedef struct {
+  char *name;
+  long long offset;       /* file offset of the sequence record */
+} TwoBitEntry;
+
+
+
+/**
+ * TwoBit.
+ */
+typedef struct _twoBitStruct_ {
+  /* the members of this struct are PRIVATE for the
+     twoBit module -- DO NOT access from outside
+     the twoBit module */
+  FILE *fp;               /* read via pread() on its descriptor */
+  int isSwapped;          /* file was written on a machine of the other byte order */
+  int version;            /* 0: 32-bit offsets, 1: 64-bit offsets */
+  Array entries;          /* of TwoBitEntry, in file order */
+  Array sorted;           /* of TwoBitEntry *, sorted by name */
+} *TwoBit;
+
+
+
+extern TwoBit twoBit_open (char *fileName);
+extern int twoBit_seqCountGet (TwoBit this1);
+extern char *twoBit_seqNameGet (TwoBit this1, int i);
+extern int twoBit_seqSizeGet (TwoBit this1, char *name);
+extern Seq *twoBit_readSeq (TwoBit this1, char *name);
+extern char *twoBit_fetchRegion (TwoBit this1, char *name, int start, int end, int reverseComplement);
+extern void twoBit_close_func (TwoBit this1); /* do not use this function */
+
+/**
+ * Close a .2bit file.
+ * @see twoBit_close_func()
+ */
+#define twoBit_close(this1) (twoBit_close_func(this1),this1=NULL) /* use this one */
+
+extern void twoBit_write (char *fileName, Array seqs);
+extern int twoBit_writeFromFasta (char *fastaFileName, char *fileName);
+
+
+#endif